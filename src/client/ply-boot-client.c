@@ -28,9 +28,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "ply-array.h"
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
@@ -45,15 +48,25 @@ struct _ply_boot_client
         ply_list_t                          *requests_waiting_for_replies;
         int                                  socket_fd;
 
+        int                                  protocol_version;
+        uint32_t                             next_request_id;
+        ply_buffer_t                        *reply_buffer;
+        int                                  received_fd;
+
+        ply_boot_protocol_progress_page_t   *progress_page;
+
         ply_boot_client_disconnect_handler_t disconnect_handler;
         void                                *disconnect_handler_user_data;
 
         uint32_t                             is_connected : 1;
+        uint32_t                             has_asked_for_protocol_version : 1;
+        uint32_t                             is_negotiating_protocol : 1;
 };
 
 typedef struct
 {
         ply_boot_client_t                 *client;
+        uint32_t                           id;
         char                              *command;
         char                              *argument;
         ply_boot_client_response_handler_t handler;
@@ -63,6 +76,7 @@ typedef struct
 
 static void ply_boot_client_cancel_request (ply_boot_client_t         *client,
                                             ply_boot_client_request_t *request);
+static void ply_boot_client_close_progress_channel (ply_boot_client_t *client);
 
 ply_boot_client_t *
 ply_boot_client_new (void)
@@ -74,6 +88,8 @@ ply_boot_client_new (void)
         client->daemon_has_reply_watch = NULL;
         client->requests_to_send = ply_list_new ();
         client->requests_waiting_for_replies = ply_list_new ();
+        client->reply_buffer = ply_buffer_new ();
+        client->received_fd = -1;
         client->loop = NULL;
         client->is_connected = false;
         client->disconnect_handler = NULL;
@@ -161,6 +177,8 @@ ply_boot_client_free (ply_boot_client_t *client)
 
         ply_list_free (client->requests_to_send);
         ply_list_free (client->requests_waiting_for_replies);
+        ply_buffer_free (client->reply_buffer);
+        ply_boot_client_close_progress_channel (client);
 
         free (client);
 }
@@ -195,6 +213,11 @@ ply_boot_client_connect (ply_boot_client_t                   *client,
         client->disconnect_handler = disconnect_handler;
         client->disconnect_handler_user_data = user_data;
 
+        client->protocol_version = 1;
+        client->has_asked_for_protocol_version = false;
+        client->is_negotiating_protocol = false;
+        ply_buffer_clear (client->reply_buffer);
+
         client->is_connected = true;
         return true;
 }
@@ -246,74 +269,82 @@ ply_boot_client_cancel_request (ply_boot_client_t         *client,
 }
 
 static void
-ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+ply_boot_client_close_progress_channel (ply_boot_client_t *client)
 {
-        ply_list_node_t *request_node;
-        ply_boot_client_request_t *request;
-        bool processed_reply;
-        uint8_t byte[2] = "";
-        uint32_t size;
-
-        assert (client != NULL);
+        if (client->received_fd >= 0) {
+                close (client->received_fd);
+                client->received_fd = -1;
+        }
 
-        processed_reply = false;
-        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
-                ply_error ("received unexpected response from boot status daemon");
+        if (client->progress_page == NULL)
                 return;
-        }
 
-        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
-        assert (request_node != NULL);
+        munmap (client->progress_page, sizeof(ply_boot_protocol_progress_page_t));
+        client->progress_page = NULL;
+}
 
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+static bool
+ply_boot_client_map_progress_channel (ply_boot_client_t *client)
+{
+        ply_boot_protocol_progress_page_t *page;
 
-        if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
-                goto out;
+        if (client->received_fd < 0) {
+                ply_trace ("daemon didn't pass a progress page");
+                return false;
+        }
 
-        if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK, sizeof(uint8_t)) == 0) {
-                if (request->handler != NULL)
-                        request->handler (request->user_data, client);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER, sizeof(uint8_t)) == 0) {
-                char *answer;
+        page = mmap (NULL, sizeof(ply_boot_protocol_progress_page_t),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, client->received_fd, 0);
+        close (client->received_fd);
+        client->received_fd = -1;
 
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
+        if (page == MAP_FAILED) {
+                ply_trace ("could not map progress page: %m");
+                return false;
+        }
 
-                answer = malloc ((size + 1) * sizeof(char));
-                if (size > 0) {
-                        if (!ply_read (client->socket_fd, answer, size)) {
-                                free (answer);
-                                goto out;
-                        }
-                }
+        if (page->magic != PLY_BOOT_PROTOCOL_PROGRESS_PAGE_MAGIC) {
+                ply_trace ("progress page has unexpected contents");
+                munmap (page, sizeof(ply_boot_protocol_progress_page_t));
+                return false;
+        }
 
-                answer[size] = '\0';
-                if (request->handler != NULL)
-                        ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, answer, client);
-                free (answer);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS, sizeof(uint8_t)) == 0) {
-                ply_array_t *array;
-                char **answers;
-                char *answer;
-                char *p;
-                char *q;
-                uint8_t i;
+        ply_boot_client_close_progress_channel (client);
+        client->progress_page = page;
 
-                array = NULL;
-                answers = NULL;
+        return true;
+}
 
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
+static bool
+ply_boot_client_handle_reply (ply_boot_client_t         *client,
+                              ply_boot_client_request_t *request,
+                              char                       response_type,
+                              const char                *answer,
+                              uint32_t                   size)
+{
+        if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK[0]) {
+                if (strcmp (request->command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_CHANNEL) == 0 &&
+                    !ply_boot_client_map_progress_channel (client))
+                        return false;
 
-                assert (size > 0);
+                if (request->handler != NULL)
+                        request->handler (request->user_data, client);
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER[0]) {
+                char *string;
 
-                answer = malloc (size);
+                string = strndup (answer, size);
+                if (request->handler != NULL)
+                        ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, string, client);
+                free (string);
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS[0]) {
+                ply_array_t *array;
+                char **answers;
+                const char *p;
+                const char *q;
+                uint32_t i;
 
-                if (!ply_read (client->socket_fd, answer, size)) {
-                        free (answer);
-                        goto out;
-                }
+                if (size == 0)
+                        return false;
 
                 array = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
 
@@ -325,7 +356,6 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
                                 p = q + 1;
                         }
                 }
-                free (answer);
 
                 answers = (char **) ply_array_steal_pointer_elements (array);
                 ply_array_free (array);
@@ -334,14 +364,187 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
                         ((ply_boot_client_multiple_answers_handler_t) request->handler)(request->user_data, (const char *const *) answers, client);
 
                 ply_free_string_array (answers);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER[0]) {
                 if (request->handler != NULL)
                         ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, NULL, client);
         } else {
+                return false;
+        }
+
+        return true;
+}
+
+static void
+ply_boot_client_stop_watching_for_replies_if_idle (ply_boot_client_t *client)
+{
+        if (ply_list_get_length (client->requests_waiting_for_replies) != 0)
+                return;
+
+        if (client->daemon_has_reply_watch != NULL) {
+                assert (client->loop != NULL);
+                ply_event_loop_stop_watching_fd (client->loop,
+                                                 client->daemon_has_reply_watch);
+                client->daemon_has_reply_watch = NULL;
+        }
+}
+
+static ply_list_node_t *
+ply_boot_client_find_request_waiting_for_reply (ply_boot_client_t *client,
+                                                uint32_t           id)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (client->requests_waiting_for_replies, node) {
+                ply_boot_client_request_t *request = ply_list_node_get_data (node);
+
+                if (request->id == id)
+                        return node;
+        }
+
+        return NULL;
+}
+
+static void
+ply_boot_client_read_frames (ply_boot_client_t *client)
+{
+        char bytes[4096];
+        char control[CMSG_SPACE (sizeof(int))];
+        struct iovec iov = { bytes, sizeof(bytes) };
+        struct msghdr message = { 0 };
+        struct cmsghdr *control_message;
+        ssize_t bytes_read;
+
+        /* Replies can carry file descriptors, so read with recvmsg
+         * rather than ply_buffer_append_from_fd
+         */
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        bytes_read = recvmsg (client->socket_fd, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+
+        if (bytes_read <= 0)
+                return;
+
+        for (control_message = CMSG_FIRSTHDR (&message);
+             control_message != NULL;
+             control_message = CMSG_NXTHDR (&message, control_message)) {
+                int fd;
+
+                if (control_message->cmsg_level != SOL_SOCKET ||
+                    control_message->cmsg_type != SCM_RIGHTS)
+                        continue;
+
+                memcpy (&fd, CMSG_DATA (control_message), sizeof(int));
+
+                if (client->received_fd >= 0)
+                        close (client->received_fd);
+                client->received_fd = fd;
+        }
+
+        ply_buffer_append_bytes (client->reply_buffer, bytes, bytes_read);
+}
+
+static void
+ply_boot_client_process_incoming_frames (ply_boot_client_t *client)
+{
+        ply_boot_client_read_frames (client);
+
+        while (ply_buffer_get_size (client->reply_buffer) >= PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE) {
+                const char *bytes;
+                uint32_t payload_size, id;
+                ply_list_node_t *request_node;
+                ply_boot_client_request_t *request;
+
+                bytes = ply_buffer_get_bytes (client->reply_buffer);
+                payload_size = ply_boot_protocol_get_uint32 (bytes);
+                id = ply_boot_protocol_get_uint32 (bytes + 4);
+
+                if (payload_size == 0) {
+                        ply_error ("received malformed response from boot status daemon");
+                        ply_buffer_clear (client->reply_buffer);
+                        break;
+                }
+
+                if (ply_buffer_get_size (client->reply_buffer) < PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + payload_size)
+                        break;
+
+                bytes += PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE;
+
+                request_node = ply_boot_client_find_request_waiting_for_reply (client, id);
+                if (request_node == NULL) {
+                        ply_error ("received unexpected response from boot status daemon");
+                } else {
+                        request = ply_list_node_get_data (request_node);
+                        ply_list_remove_node (client->requests_waiting_for_replies, request_node);
+
+                        if (!ply_boot_client_handle_reply (client, request, bytes[0],
+                                                           bytes + 1, payload_size - 1))
+                                if (request->failed_handler != NULL)
+                                        request->failed_handler (request->user_data, client);
+
+                        ply_boot_client_request_free (request);
+                }
+
+                ply_buffer_remove_bytes (client->reply_buffer,
+                                         PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + payload_size);
+        }
+
+        ply_boot_client_stop_watching_for_replies_if_idle (client);
+}
+
+static void
+ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+{
+        ply_list_node_t *request_node;
+        ply_boot_client_request_t *request;
+        bool processed_reply;
+        uint8_t byte[2] = "";
+        uint32_t size;
+        char *answer;
+
+        assert (client != NULL);
+
+        if (client->protocol_version >= 2) {
+                ply_boot_client_process_incoming_frames (client);
+                return;
+        }
+
+        processed_reply = false;
+        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
+                ply_error ("received unexpected response from boot status daemon");
+                return;
+        }
+
+        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
+        assert (request_node != NULL);
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+        assert (request != NULL);
+
+        if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
                 goto out;
+
+        size = 0;
+        answer = NULL;
+        if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER, sizeof(uint8_t)) == 0 ||
+            memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS, sizeof(uint8_t)) == 0) {
+                if (!ply_read_uint32 (client->socket_fd, &size))
+                        goto out;
+
+                answer = malloc (size + 1);
+                if (size > 0) {
+                        if (!ply_read (client->socket_fd, answer, size)) {
+                                free (answer);
+                                goto out;
+                        }
+                }
         }
 
-        processed_reply = true;
+        processed_reply = ply_boot_client_handle_reply (client, request, byte[0],
+                                                        answer, size);
+        free (answer);
 
 out:
         if (!processed_reply)
@@ -349,15 +552,9 @@ out:
                         request->failed_handler (request->user_data, client);
 
         ply_list_remove_node (client->requests_waiting_for_replies, request_node);
+        ply_boot_client_request_free (request);
 
-        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
-                if (client->daemon_has_reply_watch != NULL) {
-                        assert (client->loop != NULL);
-                        ply_event_loop_stop_watching_fd (client->loop,
-                                                         client->daemon_has_reply_watch);
-                        client->daemon_has_reply_watch = NULL;
-                }
-        }
+        ply_boot_client_stop_watching_for_replies_if_idle (client);
 }
 
 static char *
@@ -366,6 +563,7 @@ ply_boot_client_get_request_string (ply_boot_client_t         *client,
                                     size_t                    *request_size)
 {
         char *request_string;
+        size_t argument_size;
 
         assert (client != NULL);
         assert (request != NULL);
@@ -373,17 +571,42 @@ ply_boot_client_get_request_string (ply_boot_client_t         *client,
 
         assert (request->command != NULL);
 
+        argument_size = 0;
+        if (request->argument != NULL)
+                argument_size = strlen (request->argument) + 1;
+
+        if (client->protocol_version >= 2) {
+                size_t payload_size = strlen (request->command) + argument_size;
+
+                if (payload_size > PLY_BOOT_PROTOCOL_MAX_FRAME_PAYLOAD_SIZE)
+                        return NULL;
+
+                *request_size = PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + payload_size;
+                request_string = malloc (*request_size);
+                ply_boot_protocol_put_uint32 (request_string, payload_size);
+                ply_boot_protocol_put_uint32 (request_string + 4, request->id);
+                memcpy (request_string + PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE,
+                        request->command, strlen (request->command));
+                if (argument_size > 0)
+                        memcpy (request_string + PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + strlen (request->command),
+                                request->argument, argument_size);
+
+                return request_string;
+        }
+
         if (request->argument == NULL) {
                 request_string = strdup (request->command);
                 *request_size = strlen (request_string) + 1;
                 return request_string;
         }
 
-        assert (strlen (request->argument) <= UCHAR_MAX);
+        /* Version 1 framing only has one byte for the argument size */
+        if (argument_size > UCHAR_MAX)
+                return NULL;
 
         request_string = NULL;
         asprintf (&request_string, "%s\002%c%s", request->command,
-                  (char) (strlen (request->argument) + 1), request->argument);
+                  (char) argument_size, request->argument);
         *request_size = strlen (request_string) + 1;
 
         return request_string;
@@ -399,8 +622,20 @@ ply_boot_client_send_request (ply_boot_client_t         *client,
         assert (client != NULL);
         assert (request != NULL);
 
+        request->id = client->next_request_id++;
+
+        if (strcmp (request->command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_USE_VERSION) == 0)
+                client->is_negotiating_protocol = true;
+
         request_string = ply_boot_client_get_request_string (client, request,
                                                              &request_size);
+        if (request_string == NULL) {
+                ply_trace ("request argument is too long for protocol version %d",
+                           client->protocol_version);
+                ply_boot_client_cancel_request (client, request);
+                return false;
+        }
+
         if (!ply_write (client->socket_fd, request_string, request_size)) {
                 free (request_string);
                 ply_boot_client_cancel_request (client, request);
@@ -440,8 +675,10 @@ ply_boot_client_process_pending_requests (ply_boot_client_t *client)
         if (ply_boot_client_send_request (client, request))
                 ply_list_append_data (client->requests_waiting_for_replies, request);
 
-        if (ply_list_get_length (client->requests_to_send) == 0) {
-                if (client->daemon_has_reply_watch != NULL) {
+        /* Nothing else can go out until the daemon says which framing to use */
+        if (ply_list_get_length (client->requests_to_send) == 0 ||
+            client->is_negotiating_protocol) {
+                if (client->daemon_can_take_request_watch != NULL) {
                         assert (client->loop != NULL);
 
                         ply_event_loop_stop_watching_fd (client->loop,
@@ -451,6 +688,61 @@ ply_boot_client_process_pending_requests (ply_boot_client_t *client)
         }
 }
 
+static void
+ply_boot_client_watch_for_daemon_to_take_requests (ply_boot_client_t *client)
+{
+        if (client->daemon_can_take_request_watch != NULL ||
+            client->socket_fd < 0 ||
+            client->is_negotiating_protocol)
+                return;
+
+        if (ply_list_get_length (client->requests_to_send) == 0)
+                return;
+
+        client->daemon_can_take_request_watch =
+                ply_event_loop_watch_fd (client->loop, client->socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
+                                         (ply_event_handler_t)
+                                         ply_boot_client_process_pending_requests,
+                                         NULL, client);
+}
+
+static void
+ply_boot_client_on_protocol_negotiated (void              *user_data,
+                                        ply_boot_client_t *client)
+{
+        ply_trace ("using protocol version 2");
+        client->protocol_version = 2;
+        client->is_negotiating_protocol = false;
+
+        if (client->loop != NULL)
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
+}
+
+static void
+ply_boot_client_on_protocol_negotiation_failed (void              *user_data,
+                                                ply_boot_client_t *client)
+{
+        ply_trace ("daemon doesn't support protocol version 2, using version 1");
+        client->protocol_version = 1;
+        client->is_negotiating_protocol = false;
+
+        if (client->loop != NULL)
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
+}
+
+static bool
+ply_boot_client_request_needs_version_2 (const char *request_command,
+                                         const char *request_argument)
+{
+        /* The progress page is passed along with a version 2 reply */
+        if (strcmp (request_command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_CHANNEL) == 0)
+                return true;
+
+        /* Longer arguments don't fit in version 1 framing */
+        return request_argument != NULL && strlen (request_argument) + 1 > UCHAR_MAX;
+}
+
 static void
 ply_boot_client_queue_request (ply_boot_client_t                 *client,
                                const char                        *request_command,
@@ -462,18 +754,6 @@ ply_boot_client_queue_request (ply_boot_client_t                 *client,
         assert (client != NULL);
         assert (client->loop != NULL);
         assert (request_command != NULL);
-        assert (request_argument == NULL || strlen (request_argument) <= UCHAR_MAX);
-
-        if (client->daemon_can_take_request_watch == NULL &&
-            client->socket_fd >= 0) {
-                assert (ply_list_get_length (client->requests_to_send) == 0);
-                client->daemon_can_take_request_watch =
-                        ply_event_loop_watch_fd (client->loop, client->socket_fd,
-                                                 PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
-                                                 (ply_event_handler_t)
-                                                 ply_boot_client_process_pending_requests,
-                                                 NULL, client);
-        }
 
         if (!client->is_connected) {
                 if (failed_handler != NULL)
@@ -481,10 +761,31 @@ ply_boot_client_queue_request (ply_boot_client_t                 *client,
         } else {
                 ply_boot_client_request_t *request;
 
+                /* Version 2 framing is only asked for once a request needs
+                 * it, so connections that don't never pay for the round
+                 * trip, and older daemons don't see a command they don't
+                 * know.  Those refuse, and the connection keeps using
+                 * version 1.
+                 */
+                if (!client->has_asked_for_protocol_version &&
+                    ply_boot_client_request_needs_version_2 (request_command,
+                                                             request_argument)) {
+                        request = ply_boot_client_request_new (client,
+                                                               PLY_BOOT_PROTOCOL_REQUEST_TYPE_USE_VERSION,
+                                                               PLY_BOOT_PROTOCOL_VERSION_2,
+                                                               ply_boot_client_on_protocol_negotiated,
+                                                               ply_boot_client_on_protocol_negotiation_failed,
+                                                               NULL);
+                        ply_list_append_data (client->requests_to_send, request);
+                        client->has_asked_for_protocol_version = true;
+                }
+
                 request = ply_boot_client_request_new (client, request_command,
                                                        request_argument,
                                                        handler, failed_handler, user_data);
                 ply_list_append_data (client->requests_to_send, request);
+
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
         }
 }
 
@@ -770,6 +1071,32 @@ ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t                 *cli
                                        NULL, handler, failed_handler, user_data);
 }
 
+void
+ply_boot_client_ask_daemon_for_startup_times (ply_boot_client_t                 *client,
+                                              ply_boot_client_answer_handler_t   handler,
+                                              ply_boot_client_response_handler_t failed_handler,
+                                              void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STARTUP_TIMES,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
+void
+ply_boot_client_ask_daemon_for_statistics (ply_boot_client_t                 *client,
+                                           ply_boot_client_answer_handler_t   handler,
+                                           ply_boot_client_response_handler_t failed_handler,
+                                           void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
 void
 ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *client,
                                          ply_boot_client_response_handler_t handler,
@@ -780,6 +1107,67 @@ ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *clie
                                        NULL, handler, failed_handler, user_data);
 }
 
+void
+ply_boot_client_open_progress_channel (ply_boot_client_t                 *client,
+                                       ply_boot_client_response_handler_t handler,
+                                       ply_boot_client_response_handler_t failed_handler,
+                                       void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_CHANNEL,
+                                       NULL, handler, failed_handler, user_data);
+}
+
+static bool
+ply_boot_client_request_list_has_command (ply_list_t *requests,
+                                          const char *command)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (requests, node) {
+                ply_boot_client_request_t *request = ply_list_node_get_data (node);
+
+                if (strcmp (request->command, command) == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+bool
+ply_boot_client_publish_system_update (ply_boot_client_t *client,
+                                       int                progress)
+{
+        ply_boot_protocol_progress_page_t *page;
+        uint32_t sequence;
+
+        assert (client != NULL);
+
+        page = client->progress_page;
+
+        if (page == NULL)
+                return false;
+
+        /* An update still going over the socket would land after this one
+         * and move progress backwards, so keep using the socket until the
+         * daemon has answered all of them
+         */
+        if (ply_boot_client_request_list_has_command (client->requests_to_send,
+                                                      PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE) ||
+            ply_boot_client_request_list_has_command (client->requests_waiting_for_replies,
+                                                      PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE))
+                return false;
+
+        sequence = page->sequence;
+        __atomic_store_n (&page->sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+        __atomic_store_n (&page->system_update_progress, progress, __ATOMIC_RELAXED);
+        __atomic_store_n (&page->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+        return true;
+}
+
 void
 ply_boot_client_flush (ply_boot_client_t *client)
 {
@@ -798,6 +1186,8 @@ ply_boot_client_disconnect (ply_boot_client_t *client)
         close (client->socket_fd);
         client->socket_fd = -1;
         client->is_connected = false;
+
+        ply_boot_client_close_progress_channel (client);
 }
 
 static void
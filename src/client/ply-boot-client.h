@@ -148,6 +148,20 @@ void ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t
                                                ply_boot_client_response_handler_t handler,
                                                ply_boot_client_response_handler_t failed_handler,
                                                void                              *user_data);
+void ply_boot_client_ask_daemon_for_startup_times (ply_boot_client_t                 *client,
+                                                   ply_boot_client_answer_handler_t   handler,
+                                                   ply_boot_client_response_handler_t failed_handler,
+                                                   void                              *user_data);
+void ply_boot_client_ask_daemon_for_statistics (ply_boot_client_t                 *client,
+                                                ply_boot_client_answer_handler_t   handler,
+                                                ply_boot_client_response_handler_t failed_handler,
+                                                void                              *user_data);
+void ply_boot_client_open_progress_channel (ply_boot_client_t                 *client,
+                                            ply_boot_client_response_handler_t handler,
+                                            ply_boot_client_response_handler_t failed_handler,
+                                            void                              *user_data);
+bool ply_boot_client_publish_system_update (ply_boot_client_t *client,
+                                            int                progress);
 void ply_boot_client_flush (ply_boot_client_t *client);
 void ply_boot_client_disconnect (ply_boot_client_t *client);
 void ply_boot_client_attach_to_event_loop (ply_boot_client_t *client,
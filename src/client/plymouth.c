@@ -28,11 +28,13 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "ply-boot-client.h"
+#include "ply-buffer.h"
 #include "ply-command-parser.h"
 #include "ply-event-loop.h"
 #include "ply-logger.h"
@@ -55,6 +57,11 @@ typedef struct
         ply_event_loop_t     *loop;
         ply_boot_client_t    *client;
         ply_command_parser_t *command_parser;
+
+        ply_buffer_t         *batch_input;
+        int                   number_of_pending_batch_requests;
+        uint32_t              batch_input_ended : 1;
+        uint32_t              batch_request_failed : 1;
 } state_t;
 
 typedef struct
@@ -198,6 +205,31 @@ on_success (state_t *state)
         ply_event_loop_exit (state->loop, 0);
 }
 
+static void
+on_statistics_answer (state_t           *state,
+                      const char        *answer,
+                      ply_boot_client_t *client)
+{
+        if (answer == NULL) {
+                ply_event_loop_exit (state->loop, 1);
+                return;
+        }
+
+        write (STDOUT_FILENO, answer, strlen (answer));
+        ply_event_loop_exit (state->loop, 0);
+}
+
+static void
+on_startup_times_answer (state_t           *state,
+                         const char        *answer,
+                         ply_boot_client_t *client)
+{
+        if (answer != NULL)
+                write (STDOUT_FILENO, answer, strlen (answer));
+
+        ply_event_loop_exit (state->loop, 0);
+}
+
 static void
 on_password_answer_failure (password_answer_state_t *answer_state,
                             ply_boot_client_t       *client)
@@ -879,12 +911,288 @@ on_system_update_request (state_t    *state,
         }
 }
 
+static void
+finish_batch_if_done (state_t *state)
+{
+        if (!state->batch_input_ended || state->number_of_pending_batch_requests > 0)
+                return;
+
+        ply_trace ("batch: all commands answered");
+        ply_event_loop_exit (state->loop, state->batch_request_failed ? 1 : 0);
+}
+
+static void
+on_batch_request_success (state_t *state)
+{
+        state->number_of_pending_batch_requests--;
+        finish_batch_if_done (state);
+}
+
+static void
+on_batch_request_failure (state_t *state)
+{
+        state->batch_request_failed = true;
+        state->number_of_pending_batch_requests--;
+        finish_batch_if_done (state);
+}
+
+typedef void (*batch_request_handler_t) (ply_boot_client_t                 *client,
+                                         ply_boot_client_response_handler_t handler,
+                                         ply_boot_client_response_handler_t failed_handler,
+                                         void                              *user_data);
+typedef void (*batch_request_with_argument_handler_t) (ply_boot_client_t                 *client,
+                                                       const char                        *argument,
+                                                       ply_boot_client_response_handler_t handler,
+                                                       ply_boot_client_response_handler_t failed_handler,
+                                                       void                              *user_data);
+
+typedef struct
+{
+        const char                           *name;
+        batch_request_handler_t               handler;
+        batch_request_with_argument_handler_t handler_with_argument;
+} batch_command_t;
+
+static const batch_command_t batch_commands[] = {
+        { "update",           NULL,                                               ply_boot_client_update_daemon                  },
+        { "system-update",    NULL,                                               ply_boot_client_system_update                  },
+        { "change-mode",      NULL,                                               ply_boot_client_change_mode                    },
+        { "display-message",  NULL,                                               ply_boot_client_tell_daemon_to_display_message },
+        { "hide-message",     NULL,                                               ply_boot_client_tell_daemon_to_hide_message    },
+        { "pause-progress",   ply_boot_client_tell_daemon_to_progress_pause,      NULL                                           },
+        { "unpause-progress", ply_boot_client_tell_daemon_to_progress_unpause,    NULL                                           },
+        { "show-splash",      ply_boot_client_tell_daemon_to_show_splash,         NULL                                           },
+        { "hide-splash",      ply_boot_client_tell_daemon_to_hide_splash,         NULL                                           },
+        { "report-error",     ply_boot_client_tell_daemon_about_error,            NULL                                           },
+        { "sysinit",          ply_boot_client_tell_daemon_system_is_initialized,  NULL                                           },
+        { "ping",             ply_boot_client_ping_daemon,                        NULL                                           },
+        { NULL,               NULL,                                               NULL                                           }
+};
+
+static const batch_command_t *
+find_batch_command (const char *name)
+{
+        int i;
+
+        for (i = 0; batch_commands[i].name != NULL; i++) {
+                if (strcmp (batch_commands[i].name, name) == 0)
+                        return &batch_commands[i];
+        }
+
+        return NULL;
+}
+
+static void
+run_batch_command (state_t *state,
+                   char    *command)
+{
+        const batch_command_t *batch_command;
+        char *argument;
+
+        if (command[0] == '\0' || command[0] == '#')
+                return;
+
+        argument = strchr (command, ' ');
+        if (argument != NULL) {
+                *argument = '\0';
+                argument++;
+        }
+
+        ply_trace ("batch: running '%s'", command);
+
+        /* The requests are only queued here, so they get pipelined to the
+         * daemon instead of waiting for each other's replies
+         */
+        state->number_of_pending_batch_requests++;
+
+        batch_command = find_batch_command (command);
+
+        if (batch_command == NULL ||
+            (batch_command->handler_with_argument != NULL && argument == NULL)) {
+                ply_error ("batch: unknown command or missing argument: %s", command);
+                on_batch_request_failure (state);
+                return;
+        }
+
+        if (strcmp (command, "system-update") == 0) {
+                char *end;
+                long progress;
+
+                errno = 0;
+                progress = strtol (argument, &end, 10);
+                if (errno != 0 || end == argument || *end != '\0' ||
+                    progress < 0 || progress > 100) {
+                        ply_error ("batch: invalid system update progress: %s", argument);
+                        on_batch_request_failure (state);
+                        return;
+                }
+
+                /* Progress goes through the shared page when the daemon
+                 * gave us one, which saves a round trip per update
+                 */
+                if (ply_boot_client_publish_system_update (state->client, (int) progress)) {
+                        on_batch_request_success (state);
+                        return;
+                }
+        }
+
+        if (batch_command->handler_with_argument != NULL)
+                batch_command->handler_with_argument (state->client, argument,
+                                                      (ply_boot_client_response_handler_t)
+                                                      on_batch_request_success,
+                                                      (ply_boot_client_response_handler_t)
+                                                      on_batch_request_failure, state);
+        else
+                batch_command->handler (state->client,
+                                        (ply_boot_client_response_handler_t)
+                                        on_batch_request_success,
+                                        (ply_boot_client_response_handler_t)
+                                        on_batch_request_failure, state);
+}
+
+static void
+run_batch_input_lines (state_t *state)
+{
+        while (ply_buffer_get_size (state->batch_input) > 0) {
+                const char *bytes;
+                const char *end_of_line;
+                char *command;
+                size_t size;
+
+                bytes = ply_buffer_get_bytes (state->batch_input);
+                size = ply_buffer_get_size (state->batch_input);
+
+                end_of_line = memchr (bytes, '\n', size);
+                if (end_of_line == NULL)
+                        break;
+
+                command = strndup (bytes, end_of_line - bytes);
+                ply_buffer_remove_bytes (state->batch_input, end_of_line - bytes + 1);
+
+                run_batch_command (state, command);
+                free (command);
+        }
+}
+
+static void
+on_batch_input (state_t *state)
+{
+        ply_buffer_append_from_fd (state->batch_input, STDIN_FILENO);
+        run_batch_input_lines (state);
+}
+
+static void
+on_batch_input_hangup (state_t *state)
+{
+        /* Run a last command that wasn't terminated by a newline */
+        if (ply_buffer_get_size (state->batch_input) > 0) {
+                char *command;
+
+                command = ply_buffer_steal_bytes (state->batch_input);
+                run_batch_command (state, command);
+                free (command);
+        }
+
+        ply_trace ("batch: end of input");
+        state->batch_input_ended = true;
+        finish_batch_if_done (state);
+}
+
+/* epoll refuses files that can't be polled, like regular files and
+ * /dev/null
+ */
+static bool
+fd_can_be_watched (int fd)
+{
+        struct epoll_event event = { 0 };
+        bool can_be_watched;
+        int epoll_fd;
+
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+        if (epoll_fd < 0)
+                return false;
+
+        event.events = EPOLLIN;
+        can_be_watched = epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+        close (epoll_fd);
+
+        return can_be_watched;
+}
+
+static void
+read_batch_input (state_t *state)
+{
+        char bytes[4096];
+        ssize_t bytes_read;
+
+        while ((bytes_read = read (STDIN_FILENO, bytes, sizeof(bytes))) != 0) {
+                if (bytes_read < 0) {
+                        if (errno == EINTR || errno == EAGAIN)
+                                continue;
+
+                        ply_error ("batch: could not read commands: %m");
+                        state->batch_request_failed = true;
+                        break;
+                }
+
+                ply_buffer_append_bytes (state->batch_input, bytes, bytes_read);
+                run_batch_input_lines (state);
+        }
+
+        on_batch_input_hangup (state);
+}
+
+static void
+on_batch_progress_channel_opened (state_t *state)
+{
+        ply_trace ("batch: sending system updates through progress channel");
+        state->number_of_pending_batch_requests--;
+        finish_batch_if_done (state);
+}
+
+static void
+on_batch_progress_channel_failed (state_t *state)
+{
+        ply_trace ("batch: no progress channel, sending system updates as requests");
+        state->number_of_pending_batch_requests--;
+        finish_batch_if_done (state);
+}
+
+static void
+start_batch (state_t *state)
+{
+        state->batch_input = ply_buffer_new ();
+
+        state->number_of_pending_batch_requests++;
+        ply_boot_client_open_progress_channel (state->client,
+                                               (ply_boot_client_response_handler_t)
+                                               on_batch_progress_channel_opened,
+                                               (ply_boot_client_response_handler_t)
+                                               on_batch_progress_channel_failed,
+                                               state);
+
+        if (!fd_can_be_watched (STDIN_FILENO)) {
+                ply_trace ("batch: standard input can't be watched, reading it all now");
+                read_batch_input (state);
+                return;
+        }
+
+        ply_event_loop_watch_fd (state->loop, STDIN_FILENO,
+                                 PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                 (ply_event_handler_t)
+                                 on_batch_input,
+                                 (ply_event_handler_t)
+                                 on_batch_input_hangup,
+                                 state);
+}
+
 int
 main (int    argc,
       char **argv)
 {
         state_t state = { 0 };
-        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path;
+        bool should_help, should_batch, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path, should_show_startup_times, should_show_statistics;
         bool is_connected;
         char *status, *chroot_dir, *ignore_keystroke;
         int exit_code;
@@ -913,6 +1221,9 @@ main (int    argc,
                                         "update", "Tell boot daemon an update about boot progress", PLY_COMMAND_OPTION_TYPE_STRING,
                                         "details", "Tell boot daemon there were errors during boot", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "wait", "Wait for boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "startup-times", "Show how long the boot daemon took to reach startup milestones", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "stats", "Show boot daemon runtime statistics", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "batch", "Send commands read from standard input, one per line (e.g. \"update STATUS\")", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         NULL);
 
         ply_command_parser_add_command (state.command_parser,
@@ -1100,7 +1411,10 @@ main (int    argc,
                                         "ignore-keystroke", &ignore_keystroke,
                                         "update", &status,
                                         "wait", &should_wait,
+                                        "startup-times", &should_show_startup_times,
+                                        "stats", &should_show_statistics,
                                         "details", &report_error,
+                                        "batch", &should_batch,
                                         NULL);
 
         if (should_help || argc < 2) {
@@ -1144,6 +1458,10 @@ main (int    argc,
                         exit_code = 1;
                         goto out;
                 }
+                if (should_show_startup_times || should_show_statistics) {
+                        exit_code = 1;
+                        goto out;
+                }
                 if (should_wait) {
                         ply_trace ("no need to wait");
                         goto out;
@@ -1152,7 +1470,9 @@ main (int    argc,
 
         ply_boot_client_attach_to_event_loop (state.client, state.loop);
 
-        if (should_show_splash) {
+        if (should_batch) {
+                start_batch (&state);
+        } else if (should_show_splash) {
                 ply_boot_client_tell_daemon_to_show_splash (state.client,
                                                             (ply_boot_client_response_handler_t)
                                                             on_success,
@@ -1180,6 +1500,18 @@ main (int    argc,
                 ply_event_loop_watch_for_timeout (state.loop, PLY_PING_TIMEOUT,
                                                   (ply_event_loop_timeout_handler_t)
                                                   on_ping_timeout, &state);
+        } else if (should_show_statistics) {
+                ply_boot_client_ask_daemon_for_statistics (state.client,
+                                                           (ply_boot_client_answer_handler_t)
+                                                           on_statistics_answer,
+                                                           (ply_boot_client_response_handler_t)
+                                                           on_failure, &state);
+        } else if (should_show_startup_times) {
+                ply_boot_client_ask_daemon_for_startup_times (state.client,
+                                                              (ply_boot_client_answer_handler_t)
+                                                              on_startup_times_answer,
+                                                              (ply_boot_client_response_handler_t)
+                                                              on_failure, &state);
         } else if (should_check_for_active_vt) {
                 ply_boot_client_ask_daemon_has_active_vt (state.client,
                                                           (ply_boot_client_response_handler_t)
@@ -1237,6 +1569,8 @@ main (int    argc,
 out:
         ply_boot_client_free (state.client);
 
+        ply_buffer_free (state.batch_input);
+
         ply_event_loop_free (state.loop);
 
         ply_command_parser_free (state.command_parser);
@@ -36,6 +36,7 @@
 #include "ply-boot-splash-plugin.h"
 #include "ply-terminal.h"
 #include "ply-event-loop.h"
+#include "ply-frame-governor.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-trigger.h"
@@ -67,6 +68,7 @@ struct _ply_boot_splash
         char                                     *status;
 
         ply_progress_t                           *progress;
+        ply_frame_governor_t                     *progress_governor;
         ply_boot_splash_on_idle_handler_t         idle_handler;
         void                                     *idle_handler_user_data;
 
@@ -93,6 +95,8 @@ ply_boot_splash_new (const char   *theme_path,
         splash->loop = NULL;
         splash->theme_path = strdup (theme_path);
         splash->plugin_dir = strdup (plugin_dir);
+        splash->progress_governor = ply_frame_governor_new ("boot progress updates",
+                                                            UPDATES_PER_SECOND);
         splash->module_handle = NULL;
         splash->mode = PLY_BOOT_SPLASH_MODE_INVALID;
 
@@ -418,6 +422,7 @@ ply_boot_splash_free (ply_boot_splash_t *splash)
         if (splash->idle_trigger != NULL)
                 ply_trigger_free (splash->idle_trigger);
 
+        ply_frame_governor_free (splash->progress_governor);
         free (splash->theme_path);
         free (splash->plugin_dir);
         free (splash);
@@ -428,9 +433,12 @@ ply_boot_splash_update_progress (ply_boot_splash_t *splash)
 {
         double percentage = 0.0;
         double time = 0.0;
+        double delay;
 
         assert (splash != NULL);
 
+        ply_frame_governor_begin_frame (splash->progress_governor);
+
         if (splash->progress) {
                 percentage = ply_progress_get_percentage (splash->progress);
                 time = ply_progress_get_time (splash->progress);
@@ -441,8 +449,9 @@ ply_boot_splash_update_progress (ply_boot_splash_t *splash)
                                                             time,
                                                             percentage);
 
+        delay = ply_frame_governor_end_frame (splash->progress_governor);
         ply_event_loop_watch_for_timeout (splash->loop,
-                                          1.0 / UPDATES_PER_SECOND,
+                                          delay,
                                           (ply_event_loop_timeout_handler_t)
                                           ply_boot_splash_update_progress, splash);
 }
@@ -494,8 +503,10 @@ ply_boot_splash_show (ply_boot_splash_t     *splash,
                 return false;
         }
 
-        if (splash->plugin_interface->on_boot_progress != NULL)
+        if (splash->plugin_interface->on_boot_progress != NULL) {
+                ply_frame_governor_reset (splash->progress_governor);
                 ply_boot_splash_update_progress (splash);
+        }
 
         splash->mode = mode;
         return true;
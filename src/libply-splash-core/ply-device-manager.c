@@ -22,7 +22,9 @@
 #include "ply-renderer.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -30,6 +32,7 @@
 #include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #ifdef HAVE_UDEV
 #include <libudev.h>
@@ -42,6 +45,7 @@
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-key-file.h"
+#include "ply-phase-tracer.h"
 #include "ply-utils.h"
 #include "ply-input-device.h"
 
@@ -49,16 +53,52 @@
 #define SUBSYSTEM_FRAME_BUFFER "graphics"
 #define SUBSYSTEM_INPUT "input"
 
+/* How long after a renderer shows up to fully probe its outputs */
+#define CONNECTOR_PROBE_DELAY 2.0
+
 #ifdef HAVE_UDEV
 static void create_devices_from_udev (ply_device_manager_t *manager);
+static bool start_connector_probe (ply_device_manager_t *manager,
+                                   ply_renderer_t       *renderer);
+static void cancel_connector_probe (ply_device_manager_t *manager,
+                                    ply_renderer_t       *renderer);
 #endif
 
 static bool create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                                                            const char           *device_path,
                                                            ply_terminal_t       *terminal,
                                                            ply_renderer_type_t   renderer_type);
+static void create_non_graphical_devices (ply_device_manager_t *manager);
 static void create_pixel_displays_for_renderer (ply_device_manager_t *manager,
                                                 ply_renderer_t       *renderer);
+static bool add_devices_for_terminal_and_renderer (ply_device_manager_t *manager,
+                                                   ply_terminal_t       *terminal,
+                                                   ply_renderer_t       *renderer);
+
+/* A renderer being brought up on its own thread, so a slow device
+ * doesn't hold up the others */
+typedef struct
+{
+        ply_device_manager_t *manager;
+        char                 *device_path;
+        ply_renderer_type_t   renderer_type;
+        ply_renderer_t       *renderer;
+        ply_terminal_t       *terminal;
+        pthread_t             thread;
+
+        uint32_t              is_probed : 1;
+        uint32_t              is_done : 1;
+} ply_renderer_probe_t;
+
+/* The full connector probe of a renderer that is already up, run on its
+ * own thread since reading EDID can take a while.  renderer is cleared
+ * if the renderer goes away first */
+typedef struct
+{
+        ply_device_manager_t *manager;
+        ply_renderer_t       *renderer;
+        pthread_t             thread;
+} ply_connector_probe_t;
 
 struct _ply_device_manager
 {
@@ -76,6 +116,12 @@ struct _ply_device_manager
         struct udev_monitor                *udev_monitor;
         ply_fd_watch_t                     *fd_watch;
 
+        ply_list_t                         *renderer_probes;
+        ply_list_t                         *connector_probes;
+        int                                 probe_sender_fd;
+        int                                 probe_receiver_fd;
+        ply_fd_watch_t                     *probe_watch;
+
         struct xkb_context                 *xkb_context;
         struct xkb_keymap                  *xkb_keymap;
 
@@ -97,6 +143,8 @@ struct _ply_device_manager
         uint32_t                            device_timeout_elapsed : 1;
         uint32_t                            found_drm_device : 1;
         uint32_t                            found_fb_device : 1;
+        uint32_t                            connector_probe_is_scheduled : 1;
+        uint32_t                            fallback_is_pending : 1;
 };
 
 static void
@@ -193,6 +241,10 @@ free_devices_from_device_path (ply_device_manager_t *manager,
         if (renderer == NULL)
                 return;
 
+#ifdef HAVE_UDEV
+        cancel_connector_probe (manager, renderer);
+#endif
+
         free_displays_for_renderer (manager, renderer);
         free_keyboards_for_renderer (manager, renderer);
 
@@ -213,6 +265,68 @@ free_devices_from_device_path (ply_device_manager_t *manager,
         ply_renderer_free (renderer);
 }
 
+static void
+handle_change_event_for_renderer (ply_device_manager_t *manager,
+                                  ply_renderer_t       *renderer)
+{
+        bool changed;
+
+        changed = ply_renderer_handle_change_event (renderer);
+        if (changed) {
+                free_displays_for_renderer (manager, renderer);
+                create_pixel_displays_for_renderer (manager, renderer);
+        }
+}
+
+static void
+on_each_renderer_probe_connectors (const char           *device_path,
+                                   ply_renderer_t       *renderer,
+                                   ply_device_manager_t *manager)
+{
+#ifdef HAVE_UDEV
+        if (start_connector_probe (manager, renderer))
+                return;
+#endif
+
+        handle_change_event_for_renderer (manager, renderer);
+}
+
+static void schedule_connector_probe (ply_device_manager_t *manager);
+
+/* Renderers come up using the output state the kernel already has, so
+ * the first frame doesn't wait on slow connector probing.  Do the full
+ * probe once things are on screen, off the main thread where possible.
+ */
+static void
+on_connector_probe_timeout (ply_device_manager_t *manager)
+{
+        manager->connector_probe_is_scheduled = false;
+
+        if (manager->paused) {
+                schedule_connector_probe (manager);
+                return;
+        }
+
+        ply_trace ("probing outputs of all renderers");
+        ply_hashtable_foreach (manager->renderers,
+                               (ply_hashtable_foreach_func_t *)
+                               on_each_renderer_probe_connectors,
+                               manager);
+}
+
+static void
+schedule_connector_probe (ply_device_manager_t *manager)
+{
+        if (manager->connector_probe_is_scheduled || manager->loop == NULL)
+                return;
+
+        ply_event_loop_watch_for_timeout (manager->loop,
+                                          CONNECTOR_PROBE_DELAY,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_connector_probe_timeout, manager);
+        manager->connector_probe_is_scheduled = true;
+}
+
 #ifdef HAVE_UDEV
 static bool
 drm_device_in_use (ply_device_manager_t *manager,
@@ -374,6 +488,477 @@ verify_drm_device (struct udev_device *device)
         return false;
 }
 
+static void
+mark_renderer_type_found (ply_device_manager_t *manager,
+                          ply_renderer_type_t   renderer_type)
+{
+        if (renderer_type == PLY_RENDERER_TYPE_DRM)
+                manager->found_drm_device = 1;
+        if (renderer_type == PLY_RENDERER_TYPE_FRAME_BUFFER)
+                manager->found_fb_device = 1;
+}
+
+static bool
+renderer_probe_is_pending (ply_device_manager_t *manager,
+                           const char           *device_path)
+{
+        ply_renderer_probe_t *probe;
+        ply_list_node_t *node;
+
+        ply_list_foreach (manager->renderer_probes, node) {
+                probe = ply_list_node_get_data (node);
+
+                if (strcmp (probe->device_path, device_path) == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+static bool
+local_console_is_claimed (ply_device_manager_t *manager)
+{
+        ply_renderer_probe_t *probe;
+        ply_list_node_t *node;
+
+        if (manager->local_console_managed)
+                return true;
+
+        ply_list_foreach (manager->renderer_probes, node) {
+                probe = ply_list_node_get_data (node);
+
+                if (probe->terminal == manager->local_console_terminal)
+                        return true;
+        }
+
+        return false;
+}
+
+/* The local console goes to the first graphics device that gets set up */
+static ply_terminal_t *
+get_unclaimed_local_console (ply_device_manager_t *manager)
+{
+        if (local_console_is_claimed (manager))
+                return NULL;
+
+        if (manager->local_console_terminal == NULL ||
+            !ply_terminal_is_vt (manager->local_console_terminal))
+                return NULL;
+
+        return manager->local_console_terminal;
+}
+
+static bool
+create_devices_with_local_console (ply_device_manager_t *manager,
+                                   const char           *device_path,
+                                   ply_renderer_type_t   renderer_type)
+{
+        ply_trace ("giving the local console to %s", device_path);
+
+        if (create_devices_for_terminal_and_renderer_type (manager,
+                                                           device_path,
+                                                           manager->local_console_terminal,
+                                                           renderer_type))
+                return true;
+
+        ply_trace ("could not open %s with the local console, trying without it", device_path);
+        return create_devices_for_terminal_and_renderer_type (manager,
+                                                              device_path,
+                                                              NULL,
+                                                              renderer_type);
+}
+
+static void
+find_first_renderer (const char      *device_path,
+                     ply_renderer_t  *renderer,
+                     ply_renderer_t **first_renderer)
+{
+        if (*first_renderer == NULL)
+                *first_renderer = renderer;
+}
+
+/* Called when the device that was probing with the local console didn't
+ * come up. Probes that are still running take the console over when they
+ * finish, otherwise a device that is already up gets reopened with it.
+ */
+static void
+hand_off_local_console (ply_device_manager_t *manager)
+{
+        ply_renderer_t *renderer = NULL;
+        ply_renderer_type_t renderer_type;
+        char *device_path;
+
+        if (get_unclaimed_local_console (manager) == NULL)
+                return;
+
+        if (ply_list_get_length (manager->renderer_probes) > 0)
+                return;
+
+        ply_hashtable_foreach (manager->renderers,
+                               (ply_hashtable_foreach_func_t *)
+                               find_first_renderer,
+                               &renderer);
+
+        if (renderer == NULL)
+                return;
+
+        device_path = strdup (ply_renderer_get_device_name (renderer));
+        renderer_type = ply_renderer_get_type (renderer);
+
+        free_devices_from_device_path (manager, device_path, true);
+        create_devices_with_local_console (manager, device_path, renderer_type);
+        free (device_path);
+}
+
+static void
+free_renderer_probe (ply_renderer_probe_t *probe)
+{
+        free (probe->device_path);
+        free (probe);
+}
+
+static void
+finish_renderer_probe (ply_device_manager_t *manager,
+                       ply_renderer_probe_t *probe)
+{
+        bool was_added = false;
+
+        if (!probe->is_probed) {
+                ply_trace ("could not probe renderer for %s", probe->device_path);
+                ply_renderer_free (probe->renderer);
+        } else if (probe->terminal == NULL && get_unclaimed_local_console (manager) != NULL) {
+                /* The backend only learns about the terminal when it's
+                 * created, so probe again with it */
+                ply_renderer_free (probe->renderer);
+                was_added = create_devices_with_local_console (manager,
+                                                               probe->device_path,
+                                                               probe->renderer_type);
+        } else if (!ply_renderer_open (probe->renderer)) {
+                ply_trace ("could not open renderer for %s", probe->device_path);
+                ply_renderer_free (probe->renderer);
+        } else {
+                was_added = add_devices_for_terminal_and_renderer (manager,
+                                                                   probe->terminal,
+                                                                   probe->renderer);
+        }
+
+        if (was_added)
+                mark_renderer_type_found (manager, probe->renderer_type);
+
+        hand_off_local_console (manager);
+
+        free_renderer_probe (probe);
+}
+
+static void
+finish_renderer_probes (ply_device_manager_t *manager)
+{
+        ply_renderer_probe_t *probe;
+        ply_list_node_t *node, *next_node;
+
+        if (manager->paused)
+                return;
+
+        node = ply_list_get_first_node (manager->renderer_probes);
+        while (node != NULL) {
+                probe = ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (manager->renderer_probes, node);
+
+                if (probe->is_done) {
+                        ply_list_remove_node (manager->renderer_probes, node);
+                        finish_renderer_probe (manager, probe);
+                }
+
+                node = next_node;
+        }
+
+        if (!manager->fallback_is_pending ||
+            ply_list_get_length (manager->renderer_probes) > 0)
+                return;
+
+        manager->fallback_is_pending = false;
+
+        if (manager->found_drm_device || manager->found_fb_device)
+                return;
+
+        ply_trace ("Creating non-graphical devices, since there's no suitable graphics hardware");
+        create_non_graphical_devices (manager);
+}
+
+static void
+finish_connector_probe (ply_device_manager_t  *manager,
+                        ply_connector_probe_t *probe)
+{
+        ply_list_remove_data (manager->connector_probes, probe);
+
+        /* Already joined if the renderer went away */
+        if (probe->renderer == NULL) {
+                free (probe);
+                return;
+        }
+
+        pthread_join (probe->thread, NULL);
+
+        if (manager->paused) {
+                free (probe);
+                schedule_connector_probe (manager);
+                return;
+        }
+
+        ply_trace ("connector probe for %s is done",
+                   ply_renderer_get_device_name (probe->renderer));
+        handle_change_event_for_renderer (manager, probe->renderer);
+        free (probe);
+}
+
+static void
+on_renderer_probe_done (ply_device_manager_t *manager)
+{
+        ply_renderer_probe_t *probe;
+        void *data;
+
+        if (read (manager->probe_receiver_fd, &data, sizeof(data)) != sizeof(data))
+                return;
+
+        if (ply_list_find_node (manager->connector_probes, data) != NULL) {
+                finish_connector_probe (manager, data);
+                return;
+        }
+
+        probe = data;
+
+        pthread_join (probe->thread, NULL);
+        probe->is_done = true;
+
+        ply_trace ("renderer probe for %s is done", probe->device_path);
+        finish_renderer_probes (manager);
+}
+
+static void *
+run_renderer_probe (ply_renderer_probe_t *probe)
+{
+        ssize_t bytes_written;
+
+        probe->is_probed = ply_renderer_probe (probe->renderer);
+
+        do {
+                bytes_written = write (probe->manager->probe_sender_fd, &probe, sizeof(probe));
+        } while (bytes_written < 0 && errno == EINTR);
+
+        return NULL;
+}
+
+static void *
+run_connector_probe (ply_connector_probe_t *probe)
+{
+        ssize_t bytes_written;
+
+        ply_renderer_probe_connectors (probe->renderer);
+
+        do {
+                bytes_written = write (probe->manager->probe_sender_fd, &probe, sizeof(probe));
+        } while (bytes_written < 0 && errno == EINTR);
+
+        return NULL;
+}
+
+static bool
+watch_for_renderer_probes (ply_device_manager_t *manager)
+{
+        if (manager->probe_watch != NULL)
+                return true;
+
+        if (manager->loop == NULL)
+                return false;
+
+        if (!ply_open_unidirectional_pipe (&manager->probe_sender_fd,
+                                           &manager->probe_receiver_fd)) {
+                ply_trace ("could not create pipe for renderer probes: %m");
+                return false;
+        }
+
+        manager->probe_watch = ply_event_loop_watch_fd (manager->loop,
+                                                        manager->probe_receiver_fd,
+                                                        PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                        (ply_event_handler_t)
+                                                        on_renderer_probe_done,
+                                                        NULL,
+                                                        manager);
+        return true;
+}
+
+static void
+free_renderer_probes (ply_device_manager_t *manager)
+{
+        ply_renderer_probe_t *probe;
+        ply_list_node_t *node;
+
+        ply_list_foreach (manager->renderer_probes, node) {
+                probe = ply_list_node_get_data (node);
+
+                if (!probe->is_done)
+                        pthread_join (probe->thread, NULL);
+
+                ply_renderer_free (probe->renderer);
+                free_renderer_probe (probe);
+        }
+        ply_list_free (manager->renderer_probes);
+
+        ply_list_foreach (manager->connector_probes, node) {
+                ply_connector_probe_t *connector_probe = ply_list_node_get_data (node);
+
+                if (connector_probe->renderer != NULL)
+                        pthread_join (connector_probe->thread, NULL);
+
+                free (connector_probe);
+        }
+        ply_list_free (manager->connector_probes);
+
+        if (manager->probe_watch != NULL && manager->loop != NULL)
+                ply_event_loop_stop_watching_fd (manager->loop, manager->probe_watch);
+
+        if (manager->probe_sender_fd >= 0)
+                close (manager->probe_sender_fd);
+
+        if (manager->probe_receiver_fd >= 0)
+                close (manager->probe_receiver_fd);
+}
+
+/* Opening a device, reading its connectors and so on can take a while,
+ * especially for a GPU that has to be woken up first. So each one is
+ * probed on its own thread, and gets added on the main loop as soon as
+ * it's done rather than after every other device.
+ */
+static bool
+start_renderer_probe (ply_device_manager_t *manager,
+                      const char           *device_path,
+                      ply_terminal_t       *terminal,
+                      ply_renderer_type_t   renderer_type)
+{
+        ply_renderer_probe_t *probe;
+        int result;
+
+        if (ply_hashtable_lookup (manager->renderers, (void *) device_path) != NULL) {
+                ply_trace ("ignoring device %s since it's already managed", device_path);
+                return true;
+        }
+
+        if (renderer_probe_is_pending (manager, device_path)) {
+                ply_trace ("ignoring device %s since it's already being probed", device_path);
+                return true;
+        }
+
+        if (!watch_for_renderer_probes (manager))
+                goto probe_in_foreground;
+
+        ply_trace ("probing %s (renderer type: %u) (terminal: %s) in the background",
+                   device_path, renderer_type, terminal ? ply_terminal_get_name (terminal) : "none");
+
+        probe = calloc (1, sizeof(ply_renderer_probe_t));
+        probe->manager = manager;
+        probe->device_path = strdup (device_path);
+        probe->renderer_type = renderer_type;
+        probe->terminal = terminal;
+        probe->renderer = ply_renderer_new (renderer_type, device_path, terminal);
+
+        result = pthread_create (&probe->thread, NULL,
+                                 (void *(*)(void *)) run_renderer_probe,
+                                 probe);
+
+        if (result != 0) {
+                errno = result;
+                ply_trace ("could not start thread to probe %s: %m", device_path);
+                ply_renderer_free (probe->renderer);
+                free_renderer_probe (probe);
+                goto probe_in_foreground;
+        }
+
+        ply_list_append_data (manager->renderer_probes, probe);
+        return true;
+
+probe_in_foreground:
+        if (!create_devices_for_terminal_and_renderer_type (manager,
+                                                            device_path,
+                                                            terminal,
+                                                            renderer_type))
+                return false;
+
+        mark_renderer_type_found (manager, renderer_type);
+        return true;
+}
+
+static ply_connector_probe_t *
+find_connector_probe (ply_device_manager_t *manager,
+                      ply_renderer_t       *renderer)
+{
+        ply_connector_probe_t *probe;
+        ply_list_node_t *node;
+
+        ply_list_foreach (manager->connector_probes, node) {
+                probe = ply_list_node_get_data (node);
+
+                if (probe->renderer == renderer)
+                        return probe;
+        }
+
+        return NULL;
+}
+
+/* Probes the connectors of a renderer that is already up on a thread of
+ * its own, and handles the resulting change event on the main loop when
+ * it's done.  Returns false if that can't be done in the background.
+ */
+static bool
+start_connector_probe (ply_device_manager_t *manager,
+                       ply_renderer_t       *renderer)
+{
+        ply_connector_probe_t *probe;
+        int result;
+
+        if (find_connector_probe (manager, renderer) != NULL)
+                return true;
+
+        if (!watch_for_renderer_probes (manager))
+                return false;
+
+        ply_trace ("probing outputs of %s in the background",
+                   ply_renderer_get_device_name (renderer));
+
+        probe = calloc (1, sizeof(ply_connector_probe_t));
+        probe->manager = manager;
+        probe->renderer = renderer;
+
+        result = pthread_create (&probe->thread, NULL,
+                                 (void *(*)(void *)) run_connector_probe,
+                                 probe);
+
+        if (result != 0) {
+                errno = result;
+                ply_trace ("could not start thread to probe outputs: %m");
+                free (probe);
+                return false;
+        }
+
+        ply_list_append_data (manager->connector_probes, probe);
+        return true;
+}
+
+/* The renderer is about to be freed, so wait for its probe to let go of
+ * it.  The probe stays listed until its done message gets read */
+static void
+cancel_connector_probe (ply_device_manager_t *manager,
+                        ply_renderer_t       *renderer)
+{
+        ply_connector_probe_t *probe;
+
+        probe = find_connector_probe (manager, renderer);
+        if (probe == NULL)
+                return;
+
+        pthread_join (probe->thread, NULL);
+        probe->renderer = NULL;
+}
+
 static bool
 create_devices_for_udev_device (ply_device_manager_t *manager,
                                 struct udev_device   *device)
@@ -431,24 +1016,10 @@ create_devices_for_udev_device (ply_device_manager_t *manager,
                 }
 
                 if (renderer_type != PLY_RENDERER_TYPE_NONE) {
-                        ply_terminal_t *terminal = NULL;
-
-                        if (!manager->local_console_managed &&
-                            manager->local_console_terminal != NULL &&
-                            ply_terminal_is_vt (manager->local_console_terminal)) {
-                                terminal = manager->local_console_terminal;
-                        }
-
-                        created = create_devices_for_terminal_and_renderer_type (manager,
-                                                                                 device_path,
-                                                                                 terminal,
-                                                                                 renderer_type);
-                        if (created) {
-                                if (renderer_type == PLY_RENDERER_TYPE_DRM)
-                                        manager->found_drm_device = 1;
-                                if (renderer_type == PLY_RENDERER_TYPE_FRAME_BUFFER)
-                                        manager->found_fb_device = 1;
-                        }
+                        created = start_renderer_probe (manager,
+                                                        device_path,
+                                                        get_unclaimed_local_console (manager),
+                                                        renderer_type);
                 }
         }
 
@@ -528,7 +1099,6 @@ on_drm_udev_add_or_change (ply_device_manager_t *manager,
                            struct udev_device   *device)
 {
         ply_renderer_t *renderer;
-        bool changed;
 
         renderer = ply_hashtable_lookup (manager->renderers, (void *) device_path);
         if (renderer == NULL) {
@@ -544,11 +1114,7 @@ on_drm_udev_add_or_change (ply_device_manager_t *manager,
         if (strcmp (action, "change"))
                 return;
 
-        changed = ply_renderer_handle_change_event (renderer);
-        if (changed) {
-                free_displays_for_renderer (manager, renderer);
-                create_pixel_displays_for_renderer (manager, renderer);
-        }
+        handle_change_event_for_renderer (manager, renderer);
 }
 
 static bool
@@ -891,6 +1457,10 @@ ply_device_manager_new (const char                *default_tty,
         manager->keyboards = ply_list_new ();
         manager->text_displays = ply_list_new ();
         manager->pixel_displays = ply_list_new ();
+        manager->renderer_probes = ply_list_new ();
+        manager->connector_probes = ply_list_new ();
+        manager->probe_sender_fd = -1;
+        manager->probe_receiver_fd = -1;
         manager->flags = flags;
 
 #ifdef HAVE_UDEV
@@ -918,6 +1488,15 @@ ply_device_manager_free (ply_device_manager_t *manager)
                                                detach_from_event_loop,
                                                manager);
 
+        if (manager->connector_probe_is_scheduled && manager->loop != NULL)
+                ply_event_loop_stop_watching_for_timeout (manager->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          on_connector_probe_timeout, manager);
+
+#ifdef HAVE_UDEV
+        free_renderer_probes (manager);
+#endif
+
         free_terminals (manager);
         ply_hashtable_free (manager->terminals);
         free ((void *) manager->keymap);
@@ -1080,7 +1659,6 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                                                ply_renderer_type_t   renderer_type)
 {
         ply_renderer_t *renderer = NULL;
-        ply_keyboard_t *keyboard = NULL;
 
         if (device_path != NULL)
                 renderer = ply_hashtable_lookup (manager->renderers, (void *) device_path);
@@ -1094,7 +1672,6 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                    device_path ? : "", renderer_type, terminal ? ply_terminal_get_name (terminal) : "none");
 
         if (renderer_type != PLY_RENDERER_TYPE_NONE) {
-                ply_renderer_t *old_renderer = NULL;
                 renderer = ply_renderer_new (renderer_type, device_path, terminal);
 
                 if (renderer != NULL && !ply_renderer_open (renderer)) {
@@ -1105,22 +1682,34 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                         if (renderer_type != PLY_RENDERER_TYPE_AUTO)
                                 return false;
                 }
+        }
 
-                if (renderer != NULL) {
-                        old_renderer = ply_hashtable_lookup (manager->renderers,
-                                                             (void *) ply_renderer_get_device_name (renderer));
+        return add_devices_for_terminal_and_renderer (manager, terminal, renderer);
+}
 
-                        if (old_renderer != NULL) {
-                                ply_trace ("ignoring device %s since it's already managed",
-                                           ply_renderer_get_device_name (renderer));
-                                ply_renderer_free (renderer);
+static bool
+add_devices_for_terminal_and_renderer (ply_device_manager_t *manager,
+                                       ply_terminal_t       *terminal,
+                                       ply_renderer_t       *renderer)
+{
+        ply_renderer_t *old_renderer = NULL;
+        ply_keyboard_t *keyboard = NULL;
 
-                                renderer = NULL;
-                                return true;
-                        }
+        if (renderer != NULL) {
+                ply_phase_tracer_mark (PLY_PHASE_RENDERER_OPENED);
 
-                        add_input_devices_to_renderer (manager, renderer);
+                old_renderer = ply_hashtable_lookup (manager->renderers,
+                                                     (void *) ply_renderer_get_device_name (renderer));
+
+                if (old_renderer != NULL) {
+                        ply_trace ("ignoring device %s since it's already managed",
+                                   ply_renderer_get_device_name (renderer));
+                        ply_renderer_free (renderer);
+
+                        return true;
                 }
+
+                add_input_devices_to_renderer (manager, renderer);
         }
 
         if (renderer != NULL) {
@@ -1132,6 +1721,7 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
 
                 ply_hashtable_insert (manager->renderers, strdup (ply_renderer_get_device_name (renderer)), renderer);
                 create_pixel_displays_for_renderer (manager, renderer);
+                schedule_connector_probe (manager);
 
                 if (manager->renderers_activated) {
                         ply_trace ("activating renderer");
@@ -1232,6 +1822,12 @@ create_devices_from_udev (ply_device_manager_t *manager)
         if (manager->found_drm_device || manager->found_fb_device)
                 return;
 
+        if (ply_list_get_length (manager->renderer_probes) > 0) {
+                ply_trace ("waiting for renderer probes before falling back to non-graphical devices");
+                manager->fallback_is_pending = true;
+                return;
+        }
+
         ply_trace ("Creating non-graphical devices, since there's no suitable graphics hardware");
         create_non_graphical_devices (manager);
 }
@@ -1433,6 +2029,8 @@ ply_device_manager_unpause (ply_device_manager_t *manager)
         ply_trace ("ply_device_manager_unpause() called, resuming watching for udev events");
         manager->paused = false;
 #ifdef HAVE_UDEV
+        finish_renderer_probes (manager);
+
         if (manager->device_timeout_elapsed) {
                 ply_trace ("ply_device_manager_unpause(): timeout elapsed while paused, looking for udev devices");
                 create_devices_from_udev (manager);
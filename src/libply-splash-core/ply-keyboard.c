@@ -37,6 +37,7 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-renderer.h"
 #include "ply-terminal.h"
 #include "ply-utils.h"
@@ -438,6 +439,9 @@ ply_keyboard_watch_for_input (ply_keyboard_t *keyboard)
                 break;
         }
 
+        if (keyboard->is_active)
+                ply_phase_tracer_mark (PLY_PHASE_FIRST_INPUT_READY);
+
         return keyboard->is_active;
 }
 
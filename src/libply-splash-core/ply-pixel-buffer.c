@@ -26,6 +26,7 @@
 #include "ply-list.h"
 #include "ply-pixel-buffer.h"
 #include "ply-logger.h"
+#include "ply-statistics.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -52,6 +53,8 @@ struct _ply_pixel_buffer
         int                         device_scale;
 
         ply_pixel_buffer_rotation_t device_rotation;
+
+        ply_pixel_buffer_t         *parent;        /* set for tiles */
 };
 
 static inline void ply_pixel_buffer_blend_value_at_pixel (ply_pixel_buffer_t *buffer,
@@ -297,6 +300,7 @@ static void ply_pixel_buffer_add_updated_area (ply_pixel_buffer_t *buffer,
         }
 
         ply_region_add_rectangle (buffer->updated_areas, &updated_area);
+        ply_statistics_add (PLY_STATISTIC_PIXELS_DRAWN, area->width * area->height);
 }
 
 static void
@@ -405,6 +409,54 @@ free_clip_areas (ply_pixel_buffer_t *buffer)
         buffer->clip_areas = NULL;
 }
 
+ply_pixel_buffer_t *
+ply_pixel_buffer_new_tile (ply_pixel_buffer_t *parent)
+{
+        ply_pixel_buffer_t *buffer;
+        ply_list_node_t *node;
+
+        buffer = calloc (1, sizeof(ply_pixel_buffer_t));
+
+        buffer->updated_areas = ply_region_new ();
+        buffer->bytes = parent->bytes;
+        buffer->area = parent->area;
+        buffer->logical_area = parent->logical_area;
+        buffer->device_scale = parent->device_scale;
+        buffer->device_rotation = parent->device_rotation;
+        buffer->is_opaque = parent->is_opaque;
+        buffer->parent = parent;
+
+        buffer->clip_areas = ply_list_new ();
+        ply_list_foreach (parent->clip_areas, node) {
+                ply_rectangle_t *clip_area = ply_list_node_get_data (node);
+                ply_rectangle_t *new_clip_area;
+
+                new_clip_area = malloc (sizeof(*new_clip_area));
+                *new_clip_area = *clip_area;
+                ply_list_append_data (buffer->clip_areas, new_clip_area);
+        }
+
+        return buffer;
+}
+
+static void
+ply_pixel_buffer_merge_tile (ply_pixel_buffer_t *buffer,
+                             ply_pixel_buffer_t *tile)
+{
+        ply_list_t *areas;
+        ply_list_node_t *node;
+
+        areas = ply_region_get_rectangle_list (tile->updated_areas);
+        ply_list_foreach (areas, node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+
+                ply_region_add_rectangle (buffer->updated_areas, area);
+        }
+
+        if (!tile->is_opaque)
+                buffer->is_opaque = false;
+}
+
 void
 ply_pixel_buffer_free (ply_pixel_buffer_t *buffer)
 {
@@ -412,7 +464,12 @@ ply_pixel_buffer_free (ply_pixel_buffer_t *buffer)
                 return;
 
         free_clip_areas (buffer);
-        free (buffer->bytes);
+
+        if (buffer->parent != NULL)
+                ply_pixel_buffer_merge_tile (buffer->parent, buffer);
+        else
+                free (buffer->bytes);
+
         ply_region_free (buffer->updated_areas);
         free (buffer);
 }
@@ -582,6 +639,43 @@ ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
         ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
 }
 
+/* Unlike the fill functions, this replaces the pixels rather than
+ * blending over them, leaving the area fully transparent
+ */
+void
+ply_pixel_buffer_clear_area (ply_pixel_buffer_t *buffer,
+                             ply_rectangle_t    *clear_area)
+{
+        unsigned long row, column;
+        ply_rectangle_t cropped_area;
+
+        assert (buffer != NULL);
+
+        if (clear_area == NULL)
+                clear_area = &buffer->logical_area;
+
+        ply_pixel_buffer_crop_area_to_clip_area (buffer, clear_area, &cropped_area);
+
+        if (cropped_area.width == 0 || cropped_area.height == 0)
+                return;
+
+        buffer->is_opaque = false;
+
+        for (row = cropped_area.y; row < cropped_area.y + cropped_area.height; row++) {
+                if (buffer->device_rotation == PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
+                        memset (&buffer->bytes[row * buffer->area.width + cropped_area.x],
+                                0, cropped_area.width * sizeof(uint32_t));
+                        continue;
+                }
+
+                for (column = cropped_area.x; column < cropped_area.x + cropped_area.width; column++) {
+                        ply_pixel_buffer_set_pixel (buffer, column, row, 0);
+                }
+        }
+
+        ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
+}
+
 void
 ply_pixel_buffer_fill_with_color (ply_pixel_buffer_t *buffer,
                                   ply_rectangle_t    *fill_area,
@@ -882,6 +976,7 @@ ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canv
                 ply_pixel_buffer_copy_area (canvas, source, x, y, &cropped_area);
 
                 ply_region_add_rectangle (canvas->updated_areas, &cropped_area);
+                ply_statistics_add (PLY_STATISTIC_PIXELS_DRAWN, cropped_area.width * cropped_area.height);
         } else {
                 fill_area.x = x_offset * source->device_scale;
                 fill_area.y = y_offset * source->device_scale;
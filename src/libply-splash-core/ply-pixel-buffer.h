@@ -52,6 +52,12 @@ ply_pixel_buffer_t *
 ply_pixel_buffer_new_with_device_rotation (unsigned long               width,
                                            unsigned long               height,
                                            ply_pixel_buffer_rotation_t device_rotation);
+/* A tile draws into the pixels of its parent, but has its own clip areas
+ * and updated areas, so several tiles of one buffer can be drawn from
+ * different threads.  Freeing a tile adds the areas it updated to the
+ * parent.
+ */
+ply_pixel_buffer_t *ply_pixel_buffer_new_tile (ply_pixel_buffer_t *parent);
 void ply_pixel_buffer_free (ply_pixel_buffer_t *buffer);
 void ply_pixel_buffer_get_size (ply_pixel_buffer_t *buffer,
                                 ply_rectangle_t    *size);
@@ -74,6 +80,9 @@ void ply_pixel_buffer_set_opaque (ply_pixel_buffer_t *buffer,
 
 ply_region_t *ply_pixel_buffer_get_updated_areas (ply_pixel_buffer_t *buffer);
 
+void ply_pixel_buffer_clear_area (ply_pixel_buffer_t *buffer,
+                                  ply_rectangle_t    *clear_area);
+
 void ply_pixel_buffer_fill_with_color (ply_pixel_buffer_t *buffer,
                                        ply_rectangle_t    *fill_area,
                                        double              red,
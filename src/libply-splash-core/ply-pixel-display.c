@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -38,9 +39,30 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-pixel-buffer.h"
+#include "ply-region.h"
 #include "ply-renderer.h"
+#include "ply-statistics.h"
 #include "ply-utils.h"
+#include "ply-worker-pool.h"
+
+/* How long draws are collected before a parallel frame is rendered */
+#ifndef PARALLEL_FRAME_DELAY
+#define PARALLEL_FRAME_DELAY 0.005
+#endif
+
+#ifndef MAX_RENDER_THREADS
+#define MAX_RENDER_THREADS 8
+#endif
+
+/* Areas smaller than this (in logical pixels) aren't worth splitting */
+#ifndef MIN_TILE_PIXELS
+#define MIN_TILE_PIXELS (256 * 256)
+#endif
+
+/* How many recent frame times are kept for the percentile */
+#define NUMBER_OF_FRAME_TIME_SAMPLES 256
 
 struct _ply_pixel_display
 {
@@ -57,8 +79,48 @@ struct _ply_pixel_display
         void                            *draw_handler_user_data;
 
         int                              pause_count;
+
+        ply_region_t                    *pending_areas;
+
+        /* Sprites drawn to while updates were paused */
+        ply_list_t                      *paused_sprites;
+
+        /* Frames are timed from the first draw to the end of the flush */
+        double                           frame_start_time;
+        unsigned long                    number_of_frames;
+        double                           total_frame_time;
+        float                            frame_time_samples[NUMBER_OF_FRAME_TIME_SAMPLES];
+
+        uint32_t                         draw_handler_is_thread_safe : 1;
+        uint32_t                         draw_handler_can_draw_tiles : 1;
+        uint32_t                         has_pending_areas : 1;
+        uint32_t                         last_flush_was_shown : 1;
 };
 
+typedef struct
+{
+        ply_pixel_display_t *display;
+        ply_pixel_buffer_t  *tile;     /* NULL to draw all pending areas */
+        ply_rectangle_t      area;
+} ply_pixel_display_render_job_t;
+
+/* With parallel rendering, draws to displays with thread safe draw
+ * handlers are collected and rendered together in a frame.  Each display
+ * is drawn on a worker thread, then all of them are flushed, so the heads
+ * present at the same time.  Large areas of displays whose draw handlers
+ * can draw tiles are split into horizontal tiles, which are drawn in
+ * parallel too.
+ */
+static bool parallel_rendering_is_enabled;
+static bool frame_is_scheduled;
+static ply_list_t *displays_with_pending_areas;
+static ply_worker_pool_t *render_pool;
+
+static bool render_scheduling_is_set;
+static int render_scheduling_policy;
+static int render_nice_level;
+static int render_cpu;
+
 ply_pixel_display_t *
 ply_pixel_display_new (ply_renderer_t      *renderer,
                        ply_renderer_head_t *head)
@@ -72,6 +134,8 @@ ply_pixel_display_new (ply_renderer_t      *renderer,
         display->loop = ply_event_loop_get_default ();
         display->renderer = renderer;
         display->head = head;
+        display->pending_areas = ply_region_new ();
+        display->paused_sprites = ply_list_new ();
 
         pixel_buffer = ply_renderer_get_buffer_for_head (renderer, head);
         ply_pixel_buffer_get_size (pixel_buffer, &size);
@@ -113,13 +177,93 @@ ply_pixel_display_get_device_scale (ply_pixel_display_t *display)
         return display->device_scale;
 }
 
+/* Flushes from worker threads only touch the display being flushed */
+static void
+ply_pixel_display_flush_head (ply_pixel_display_t *display,
+                              bool                 is_in_parallel)
+{
+        ply_pixel_buffer_t *pixel_buffer;
+        ply_list_t *areas;
+        ply_list_node_t *node;
+        unsigned long number_of_pixels = 0;
+        double start_time, frame_time;
+
+        start_time = display->frame_start_time;
+        if (start_time == 0.0)
+                start_time = ply_get_timestamp ();
+
+        pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
+                                                         display->head);
+        areas = ply_region_get_rectangle_list (ply_pixel_buffer_get_updated_areas (pixel_buffer));
+        ply_list_foreach (areas, node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+
+                number_of_pixels += area->width * area->height;
+        }
+        ply_statistics_add (PLY_STATISTIC_PIXELS_FLUSHED, number_of_pixels);
+
+        if (is_in_parallel)
+                display->last_flush_was_shown = ply_renderer_flush_head_in_parallel (display->renderer,
+                                                                                     display->head);
+        else
+                display->last_flush_was_shown = ply_renderer_flush_head (display->renderer,
+                                                                         display->head);
+
+        frame_time = ply_get_timestamp () - start_time;
+        display->frame_time_samples[display->number_of_frames % NUMBER_OF_FRAME_TIME_SAMPLES] = frame_time;
+        display->number_of_frames++;
+        display->total_frame_time += frame_time;
+        display->frame_start_time = 0.0;
+}
+
 static void
 ply_pixel_display_flush (ply_pixel_display_t *display)
 {
-        if (display->pause_count > 0)
+        if (display->pause_count > 0) {
+                display->frame_start_time = 0.0;
                 return;
+        }
+
+        ply_pixel_display_flush_head (display, false);
+
+        if (display->last_flush_was_shown)
+                ply_phase_tracer_mark (PLY_PHASE_FIRST_FRAME);
+}
+
+static int
+compare_frame_times (const void *a,
+                     const void *b)
+{
+        float time_a = *(const float *) a;
+        float time_b = *(const float *) b;
+
+        return (time_a > time_b) - (time_a < time_b);
+}
+
+void
+ply_pixel_display_get_frame_statistics (ply_pixel_display_t *display,
+                                        unsigned long       *number_of_frames,
+                                        double              *average_frame_time,
+                                        double              *p99_frame_time)
+{
+        float samples[NUMBER_OF_FRAME_TIME_SAMPLES];
+        int number_of_samples;
+
+        assert (display != NULL);
+
+        *number_of_frames = display->number_of_frames;
+        *average_frame_time = 0.0;
+        *p99_frame_time = 0.0;
+
+        if (display->number_of_frames == 0)
+                return;
+
+        *average_frame_time = display->total_frame_time / display->number_of_frames;
 
-        ply_renderer_flush_head (display->renderer, display->head);
+        number_of_samples = MIN (display->number_of_frames, NUMBER_OF_FRAME_TIME_SAMPLES);
+        memcpy (samples, display->frame_time_samples, number_of_samples * sizeof(float));
+        qsort (samples, number_of_samples, sizeof(float), compare_frame_times);
+        *p99_frame_time = samples[(number_of_samples * 99 - 1) / 100];
 }
 
 void
@@ -133,11 +277,261 @@ ply_pixel_display_pause_updates (ply_pixel_display_t *display)
 void
 ply_pixel_display_unpause_updates (ply_pixel_display_t *display)
 {
+        ply_list_node_t *node;
+
         assert (display != NULL);
 
         display->pause_count--;
 
         ply_pixel_display_flush (display);
+
+        if (display->pause_count > 0)
+                return;
+
+        node = ply_list_get_first_node (display->paused_sprites);
+        while (node != NULL) {
+                ply_renderer_sprite_t *sprite = ply_list_node_get_data (node);
+
+                ply_renderer_flush_sprite (display->renderer, sprite);
+                node = ply_list_get_next_node (display->paused_sprites, node);
+        }
+        ply_list_remove_all_nodes (display->paused_sprites);
+}
+
+static void
+ply_pixel_display_draw_area_now (ply_pixel_display_t *display,
+                                 ply_pixel_buffer_t  *pixel_buffer,
+                                 ply_rectangle_t     *area)
+{
+        if (display->draw_handler == NULL)
+                return;
+
+        ply_pixel_buffer_push_clip_area (pixel_buffer, area);
+        display->draw_handler (display->draw_handler_user_data,
+                               pixel_buffer,
+                               area->x, area->y, area->width, area->height,
+                               display);
+        ply_pixel_buffer_pop_clip_area (pixel_buffer);
+}
+
+static void
+ply_pixel_display_draw_pending_areas (ply_pixel_display_t *display)
+{
+        ply_pixel_buffer_t *pixel_buffer;
+        ply_list_t *areas;
+        ply_list_node_t *node;
+
+        pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
+                                                         display->head);
+
+        areas = ply_region_get_sorted_rectangle_list (display->pending_areas);
+        ply_list_foreach (areas, node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+
+                ply_pixel_display_draw_area_now (display, pixel_buffer, area);
+        }
+
+        ply_region_clear (display->pending_areas);
+}
+
+static void
+ply_pixel_display_run_render_job (ply_pixel_display_render_job_t *job)
+{
+        if (job->tile == NULL) {
+                ply_pixel_display_draw_pending_areas (job->display);
+                return;
+        }
+
+        ply_pixel_display_draw_area_now (job->display, job->tile, &job->area);
+}
+
+static void
+ply_pixel_display_flush_from_worker (ply_pixel_display_t *display)
+{
+        ply_pixel_display_flush_head (display, true);
+}
+
+static int
+get_number_of_tiles (ply_rectangle_t *area)
+{
+        unsigned long number_of_pixels;
+        int number_of_tiles;
+
+        number_of_pixels = area->width * area->height;
+        number_of_tiles = MIN (number_of_pixels / MIN_TILE_PIXELS,
+                               (unsigned long) ply_worker_pool_get_number_of_workers (render_pool) + 1);
+        number_of_tiles = MIN (number_of_tiles, (int) area->height);
+
+        return MAX (number_of_tiles, 1);
+}
+
+static void
+add_render_jobs_for_display (ply_pixel_display_t *display,
+                             ply_list_t          *jobs)
+{
+        ply_pixel_display_render_job_t *job;
+        ply_pixel_buffer_t *pixel_buffer;
+        ply_list_t *areas;
+        ply_list_node_t *node;
+
+        if (!display->draw_handler_can_draw_tiles) {
+                job = calloc (1, sizeof(ply_pixel_display_render_job_t));
+                job->display = display;
+                ply_list_append_data (jobs, job);
+                return;
+        }
+
+        pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
+                                                         display->head);
+
+        areas = ply_region_get_sorted_rectangle_list (display->pending_areas);
+        ply_list_foreach (areas, node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+                int number_of_tiles, i;
+
+                number_of_tiles = get_number_of_tiles (area);
+
+                for (i = 0; i < number_of_tiles; i++) {
+                        long top, bottom;
+
+                        top = area->y + i * (long) area->height / number_of_tiles;
+                        bottom = area->y + (i + 1) * (long) area->height / number_of_tiles;
+
+                        job = calloc (1, sizeof(ply_pixel_display_render_job_t));
+                        job->display = display;
+                        job->tile = ply_pixel_buffer_new_tile (pixel_buffer);
+                        job->area.x = area->x;
+                        job->area.y = top;
+                        job->area.width = area->width;
+                        job->area.height = bottom - top;
+                        ply_list_append_data (jobs, job);
+                }
+        }
+
+        ply_region_clear (display->pending_areas);
+}
+
+static void
+render_parallel_frame (void)
+{
+        ply_pixel_display_t **displays, **parallel_flushes;
+        ply_pixel_display_render_job_t **render_jobs;
+        ply_list_t *jobs;
+        ply_list_node_t *node;
+        int number_of_displays, number_of_jobs, number_of_parallel_flushes, i;
+
+        number_of_displays = ply_list_get_length (displays_with_pending_areas);
+        if (number_of_displays == 0)
+                return;
+
+        displays = calloc (number_of_displays, sizeof(ply_pixel_display_t *));
+        parallel_flushes = calloc (number_of_displays, sizeof(ply_pixel_display_t *));
+
+        i = 0;
+        ply_list_foreach (displays_with_pending_areas, node) {
+                displays[i] = ply_list_node_get_data (node);
+                displays[i]->has_pending_areas = false;
+                displays[i]->frame_start_time = ply_get_timestamp ();
+                i++;
+        }
+        ply_list_remove_all_nodes (displays_with_pending_areas);
+
+        if (render_pool == NULL) {
+                long number_of_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+                /* The main thread renders too */
+                render_pool = ply_worker_pool_new (CLAMP (number_of_cpus, 1, MAX_RENDER_THREADS) - 1);
+
+                if (render_scheduling_is_set)
+                        ply_worker_pool_set_scheduling (render_pool,
+                                                        render_scheduling_policy,
+                                                        render_nice_level,
+                                                        render_cpu);
+        }
+
+        jobs = ply_list_new ();
+        for (i = 0; i < number_of_displays; i++)
+                add_render_jobs_for_display (displays[i], jobs);
+
+        number_of_jobs = ply_list_get_length (jobs);
+        render_jobs = calloc (number_of_jobs, sizeof(ply_pixel_display_render_job_t *));
+
+        i = 0;
+        ply_list_foreach (jobs, node) {
+                render_jobs[i++] = ply_list_node_get_data (node);
+        }
+
+        ply_worker_pool_run_jobs (render_pool,
+                                  (ply_worker_pool_job_handler_t)
+                                  ply_pixel_display_run_render_job,
+                                  (void **) render_jobs, number_of_jobs);
+
+        /* Freeing the tiles hands what they drew back to the head buffers */
+        for (i = 0; i < number_of_jobs; i++) {
+                ply_pixel_buffer_free (render_jobs[i]->tile);
+                free (render_jobs[i]);
+        }
+        free (render_jobs);
+        ply_list_free (jobs);
+
+        /* Every display is drawn, now present them together */
+        number_of_parallel_flushes = 0;
+        for (i = 0; i < number_of_displays; i++) {
+                if (displays[i]->pause_count > 0)
+                        continue;
+
+                if (ply_renderer_can_flush_heads_in_parallel (displays[i]->renderer))
+                        parallel_flushes[number_of_parallel_flushes++] = displays[i];
+                else
+                        ply_pixel_display_flush (displays[i]);
+        }
+
+        ply_worker_pool_run_jobs (render_pool,
+                                  (ply_worker_pool_job_handler_t)
+                                  ply_pixel_display_flush_from_worker,
+                                  (void **) parallel_flushes, number_of_parallel_flushes);
+
+        /* Phases are marked from this thread, once the flushes are done */
+        for (i = 0; i < number_of_parallel_flushes; i++) {
+                if (parallel_flushes[i]->last_flush_was_shown) {
+                        ply_phase_tracer_mark (PLY_PHASE_FIRST_FRAME);
+                        break;
+                }
+        }
+
+        free (parallel_flushes);
+        free (displays);
+}
+
+static void
+on_parallel_frame_timeout (void             *user_data,
+                           ply_event_loop_t *loop)
+{
+        frame_is_scheduled = false;
+        render_parallel_frame ();
+}
+
+static void
+ply_pixel_display_queue_area (ply_pixel_display_t *display,
+                              ply_rectangle_t     *area)
+{
+        ply_region_add_rectangle (display->pending_areas, area);
+
+        if (!display->has_pending_areas) {
+                if (displays_with_pending_areas == NULL)
+                        displays_with_pending_areas = ply_list_new ();
+
+                ply_list_append_data (displays_with_pending_areas, display);
+                display->has_pending_areas = true;
+        }
+
+        if (!frame_is_scheduled) {
+                ply_event_loop_watch_for_timeout (display->loop,
+                                                  PARALLEL_FRAME_DELAY,
+                                                  on_parallel_frame_timeout,
+                                                  NULL);
+                frame_is_scheduled = true;
+        }
 }
 
 void
@@ -148,23 +542,27 @@ ply_pixel_display_draw_area (ply_pixel_display_t *display,
                              int                  height)
 {
         ply_pixel_buffer_t *pixel_buffer;
+        ply_rectangle_t area;
+
+        area.x = x;
+        area.y = y;
+        area.width = width;
+        area.height = height;
+
+        if (parallel_rendering_is_enabled &&
+            (display->draw_handler_is_thread_safe ||
+             display->draw_handler_can_draw_tiles)) {
+                ply_pixel_display_queue_area (display, &area);
+                return;
+        }
 
         pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
                                                          display->head);
 
-        if (display->draw_handler != NULL) {
-                ply_rectangle_t clip_area;
+        if (display->frame_start_time == 0.0)
+                display->frame_start_time = ply_get_timestamp ();
 
-                clip_area.x = x;
-                clip_area.y = y;
-                clip_area.width = width;
-                clip_area.height = height;
-                ply_pixel_buffer_push_clip_area (pixel_buffer, &clip_area);
-                display->draw_handler (display->draw_handler_user_data,
-                                       pixel_buffer,
-                                       x, y, width, height, display);
-                ply_pixel_buffer_pop_clip_area (pixel_buffer);
-        }
+        ply_pixel_display_draw_area_now (display, pixel_buffer, &area);
 
         ply_pixel_display_flush (display);
 }
@@ -175,9 +573,73 @@ ply_pixel_display_free (ply_pixel_display_t *display)
         if (display == NULL)
                 return;
 
+        if (display->has_pending_areas)
+                ply_list_remove_data (displays_with_pending_areas, display);
+
+        ply_region_free (display->pending_areas);
+        ply_list_free (display->paused_sprites);
         free (display);
 }
 
+ply_renderer_sprite_t *
+ply_pixel_display_create_sprite (ply_pixel_display_t *display,
+                                 long                 x,
+                                 long                 y,
+                                 unsigned long        width,
+                                 unsigned long        height)
+{
+        ply_renderer_sprite_t *sprite;
+
+        assert (display != NULL);
+
+        if (display->renderer == NULL || display->head == NULL)
+                return NULL;
+
+        sprite = ply_renderer_create_sprite (display->renderer, display->head,
+                                             x, y, width, height);
+        if (sprite != NULL)
+                ply_trace ("showing %lux%lu sprite at %ld,%ld", width, height, x, y);
+
+        return sprite;
+}
+
+void
+ply_pixel_display_destroy_sprite (ply_pixel_display_t   *display,
+                                  ply_renderer_sprite_t *sprite)
+{
+        if (sprite == NULL)
+                return;
+
+        assert (display != NULL);
+
+        ply_list_remove_data (display->paused_sprites, sprite);
+        ply_renderer_destroy_sprite (display->renderer, sprite);
+}
+
+void
+ply_pixel_display_draw_sprite (ply_pixel_display_t   *display,
+                               ply_renderer_sprite_t *sprite,
+                               ply_pixel_buffer_t    *frame)
+{
+        ply_pixel_buffer_t *buffer;
+
+        assert (display != NULL);
+        assert (sprite != NULL);
+
+        buffer = ply_renderer_get_buffer_for_sprite (display->renderer, sprite);
+
+        ply_pixel_buffer_clear_area (buffer, NULL);
+        ply_pixel_buffer_fill_with_buffer (buffer, frame, 0, 0);
+
+        if (display->pause_count > 0) {
+                if (ply_list_find_node (display->paused_sprites, sprite) == NULL)
+                        ply_list_append_data (display->paused_sprites, sprite);
+                return;
+        }
+
+        ply_renderer_flush_sprite (display->renderer, sprite);
+}
+
 void
 ply_pixel_display_set_draw_handler (ply_pixel_display_t             *display,
                                     ply_pixel_display_draw_handler_t draw_handler,
@@ -187,5 +649,51 @@ ply_pixel_display_set_draw_handler (ply_pixel_display_t             *display,
 
         display->draw_handler = draw_handler;
         display->draw_handler_user_data = user_data;
+        display->draw_handler_is_thread_safe = false;
+        display->draw_handler_can_draw_tiles = false;
+}
+
+void
+ply_pixel_display_set_draw_handler_is_thread_safe (ply_pixel_display_t *display,
+                                                   bool                 is_thread_safe)
+{
+        assert (display != NULL);
+
+        display->draw_handler_is_thread_safe = is_thread_safe;
+}
+
+void
+ply_pixel_display_set_draw_handler_can_draw_tiles (ply_pixel_display_t *display,
+                                                   bool                 can_draw_tiles)
+{
+        assert (display != NULL);
+
+        display->draw_handler_can_draw_tiles = can_draw_tiles;
+}
+
+void
+ply_pixel_display_set_parallel_rendering (bool is_enabled)
+{
+        parallel_rendering_is_enabled = is_enabled;
+        ply_trace ("Parallel rendering is %s", is_enabled ? "enabled" : "disabled");
+}
+
+bool
+ply_pixel_display_get_parallel_rendering (void)
+{
+        return parallel_rendering_is_enabled;
 }
 
+void
+ply_pixel_display_set_render_scheduling (int policy,
+                                         int nice_level,
+                                         int cpu)
+{
+        render_scheduling_is_set = true;
+        render_scheduling_policy = policy;
+        render_nice_level = nice_level;
+        render_cpu = cpu;
+
+        if (render_pool != NULL)
+                ply_worker_pool_set_scheduling (render_pool, policy, nice_level, cpu);
+}
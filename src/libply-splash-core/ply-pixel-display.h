@@ -53,10 +53,40 @@ unsigned long ply_pixel_display_get_width (ply_pixel_display_t *display);
 unsigned long ply_pixel_display_get_height (ply_pixel_display_t *display);
 int ply_pixel_display_get_device_scale (ply_pixel_display_t *display);
 
+/* Frame times are in seconds, the percentile is over recent frames */
+void ply_pixel_display_get_frame_statistics (ply_pixel_display_t *display,
+                                             unsigned long       *number_of_frames,
+                                             double              *average_frame_time,
+                                             double              *p99_frame_time);
+
 void ply_pixel_display_set_draw_handler (ply_pixel_display_t             *display,
                                          ply_pixel_display_draw_handler_t draw_handler,
                                          void                            *user_data);
 
+/* With parallel rendering enabled, thread safe draw handlers are called
+ * from worker threads, at the same time as the handlers of other displays.
+ * They may only read data shared between displays, like theme images,
+ * and write to the pixel buffer they're given and state that belongs to
+ * the display.  They must not call into the event loop.  Setting a new draw
+ * handler marks it as not thread safe again.
+ */
+void ply_pixel_display_set_draw_handler_is_thread_safe (ply_pixel_display_t *display,
+                                                        bool                 is_thread_safe);
+/* Draw handlers that can draw tiles are also called at the same time as
+ * themselves, for disjoint areas of the display.  Each call gets its own
+ * pixel buffer and must only draw inside the area it was given.
+ */
+void ply_pixel_display_set_draw_handler_can_draw_tiles (ply_pixel_display_t *display,
+                                                        bool                 can_draw_tiles);
+void ply_pixel_display_set_parallel_rendering (bool is_enabled);
+bool ply_pixel_display_get_parallel_rendering (void);
+/* Scheduling for the parallel rendering workers, see
+ * ply_worker_pool_set_scheduling.  The main thread is left alone.
+ */
+void ply_pixel_display_set_render_scheduling (int policy,
+                                              int nice_level,
+                                              int cpu);
+
 void ply_pixel_display_draw_area (ply_pixel_display_t *display,
                                   int                  x,
                                   int                  y,
@@ -66,6 +96,22 @@ void ply_pixel_display_draw_area (ply_pixel_display_t *display,
 void ply_pixel_display_pause_updates (ply_pixel_display_t *display);
 void ply_pixel_display_unpause_updates (ply_pixel_display_t *display);
 
+/* When the renderer has a spare hardware plane, things that only change
+ * themselves, like throbbers, can be shown on it as a sprite, and the
+ * display beneath never needs to be redrawn.  Returns NULL if there is no
+ * plane to spare.  Drawn sprites are held back while updates are paused.
+ */
+ply_renderer_sprite_t *ply_pixel_display_create_sprite (ply_pixel_display_t *display,
+                                                        long                 x,
+                                                        long                 y,
+                                                        unsigned long        width,
+                                                        unsigned long        height);
+void ply_pixel_display_destroy_sprite (ply_pixel_display_t   *display,
+                                       ply_renderer_sprite_t *sprite);
+void ply_pixel_display_draw_sprite (ply_pixel_display_t   *display,
+                                    ply_renderer_sprite_t *sprite,
+                                    ply_pixel_buffer_t    *frame);
+
 #endif
 
 #endif /* PLY_PIXEL_DISPLAY_H */
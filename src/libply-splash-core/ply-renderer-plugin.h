@@ -49,7 +49,9 @@ typedef struct
         void (*unmap_from_device)(ply_renderer_backend_t *backend);
         void (*activate)(ply_renderer_backend_t *backend);
         void (*deactivate)(ply_renderer_backend_t *backend);
-        void (*flush_head)(ply_renderer_backend_t *backend,
+        /* Returns false if the head couldn't be shown, e.g. because the
+         * backend isn't active */
+        bool (*flush_head)(ply_renderer_backend_t *backend,
                            ply_renderer_head_t    *head);
 
         ply_list_t * (*get_heads)(ply_renderer_backend_t *backend);
@@ -82,6 +84,32 @@ typedef struct
                                  ply_input_device_t     *input_device);
         void (*remove_input_device)(ply_renderer_backend_t *backend,
                                     ply_input_device_t     *input_device);
+
+        ply_renderer_sprite_t * (*create_sprite)(ply_renderer_backend_t *backend,
+                                                 ply_renderer_head_t    *head,
+                                                 long                    x,
+                                                 long                    y,
+                                                 unsigned long           width,
+                                                 unsigned long           height);
+        void (*destroy_sprite)(ply_renderer_backend_t *backend,
+                               ply_renderer_sprite_t  *sprite);
+        ply_pixel_buffer_t * (*get_buffer_for_sprite)(ply_renderer_backend_t *backend,
+                                                      ply_renderer_sprite_t  *sprite);
+        void (*flush_sprite)(ply_renderer_backend_t *backend,
+                             ply_renderer_sprite_t  *sprite);
+
+        /* Whether flush_head may be called for different heads from
+         * different threads at the same time */
+        bool (*can_flush_heads_in_parallel)(ply_renderer_backend_t *backend);
+
+        /* Opens and queries the device without touching the terminal or
+         * the event loop, so it may be called off the main thread. When
+         * it succeeds, open_device and query_device only do what is left */
+        bool (*probe_device)(ply_renderer_backend_t *backend);
+
+        /* Does the slow part of handle_change_event ahead of time. May be
+         * called off the main thread while the renderer is in use */
+        void (*probe_connectors)(ply_renderer_backend_t *backend);
 } ply_renderer_plugin_interface_t;
 
 #endif /* PLY_RENDERER_PLUGIN_H */
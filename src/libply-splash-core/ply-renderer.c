@@ -56,12 +56,26 @@ struct _ply_renderer
         uint32_t                               input_source_is_open : 1;
         uint32_t                               is_mapped : 1;
         uint32_t                               is_active : 1;
+        uint32_t                               is_probed : 1;
 };
 
 typedef const ply_renderer_plugin_interface_t *
 (*get_backend_interface_function_t) (void);
 
+static const struct
+{
+        ply_renderer_type_t type;
+        const char         *path;
+} known_plugins[] =
+{
+        { PLY_RENDERER_TYPE_X11,          PLYMOUTH_PLUGIN_PATH "renderers/x11.so"          },
+        { PLY_RENDERER_TYPE_DRM,          PLYMOUTH_PLUGIN_PATH "renderers/drm.so"          },
+        { PLY_RENDERER_TYPE_FRAME_BUFFER, PLYMOUTH_PLUGIN_PATH "renderers/frame-buffer.so" },
+        { PLY_RENDERER_TYPE_NONE,         NULL                                             }
+};
+
 static void ply_renderer_unload_plugin (ply_renderer_t *renderer);
+static void ply_renderer_discard_probed_backend (ply_renderer_t *renderer);
 
 ply_renderer_t *
 ply_renderer_new (ply_renderer_type_t renderer_type,
@@ -90,6 +104,7 @@ ply_renderer_free (ply_renderer_t *renderer)
 
         if (renderer->plugin_interface != NULL) {
                 ply_trace ("Unloading renderer backend plugin");
+                ply_renderer_discard_probed_backend (renderer);
                 ply_renderer_unload_plugin (renderer);
         }
 
@@ -103,6 +118,12 @@ ply_renderer_get_device_name (ply_renderer_t *renderer)
         return renderer->device_name;
 }
 
+ply_renderer_type_t
+ply_renderer_get_type (ply_renderer_t *renderer)
+{
+        return renderer->type;
+}
+
 static bool
 ply_renderer_load_plugin (ply_renderer_t *renderer,
                           const char     *module_path)
@@ -175,6 +196,22 @@ ply_renderer_unload_plugin (ply_renderer_t *renderer)
         renderer->module_handle = NULL;
 }
 
+/* Releases whatever a probe opened, when the renderer never got opened */
+static void
+ply_renderer_discard_probed_backend (ply_renderer_t *renderer)
+{
+        if (!renderer->is_probed)
+                return;
+
+        if (renderer->plugin_interface->probe_device != NULL)
+                renderer->plugin_interface->close_device (renderer->backend);
+        else
+                renderer->plugin_interface->destroy_backend (renderer->backend);
+
+        renderer->backend = NULL;
+        renderer->is_probed = false;
+}
+
 static bool
 ply_renderer_open_device (ply_renderer_t *renderer)
 {
@@ -235,12 +272,14 @@ ply_renderer_open_plugin (ply_renderer_t *renderer,
 {
         ply_trace ("trying to open renderer plugin %s", plugin_path);
 
-        if (!ply_renderer_load_plugin (renderer, plugin_path))
+        if (renderer->plugin_interface == NULL &&
+            !ply_renderer_load_plugin (renderer, plugin_path))
                 return false;
 
         if (!ply_renderer_open_device (renderer)) {
                 ply_trace ("could not open rendering device for plugin %s",
                            plugin_path);
+                ply_renderer_discard_probed_backend (renderer);
                 ply_renderer_unload_plugin (renderer);
                 return false;
         }
@@ -250,31 +289,78 @@ ply_renderer_open_plugin (ply_renderer_t *renderer,
                            plugin_path);
                 ply_renderer_close_device (renderer);
                 ply_renderer_unload_plugin (renderer);
+                renderer->is_probed = false;
                 return false;
         }
 
+        renderer->is_probed = false;
         ply_trace ("opened renderer plugin %s", plugin_path);
         return true;
 }
 
+static const char *
+get_plugin_path_for_type (ply_renderer_type_t type)
+{
+        int i;
+
+        for (i = 0; known_plugins[i].type != PLY_RENDERER_TYPE_NONE; i++) {
+                if (known_plugins[i].type == type)
+                        return known_plugins[i].path;
+        }
+
+        return NULL;
+}
+
+bool
+ply_renderer_probe (ply_renderer_t *renderer)
+{
+        const char *plugin_path;
+
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface == NULL);
+
+        plugin_path = get_plugin_path_for_type (renderer->type);
+
+        if (plugin_path == NULL)
+                return false;
+
+        ply_trace ("probing renderer plugin %s", plugin_path);
+
+        if (!ply_renderer_load_plugin (renderer, plugin_path))
+                return false;
+
+        renderer->is_probed = true;
+
+        if (renderer->plugin_interface->probe_device == NULL)
+                return true;
+
+        if (!renderer->plugin_interface->probe_device (renderer->backend)) {
+                ply_trace ("could not probe rendering device for plugin %s",
+                           plugin_path);
+                renderer->plugin_interface->destroy_backend (renderer->backend);
+                renderer->backend = NULL;
+                renderer->is_probed = false;
+                ply_renderer_unload_plugin (renderer);
+                return false;
+        }
+
+        return true;
+}
+
 bool
 ply_renderer_open (ply_renderer_t *renderer)
 {
         int i;
 
-        struct
-        {
-                ply_renderer_type_t type;
-                const char         *path;
-        } known_plugins[] =
-        {
-                { PLY_RENDERER_TYPE_X11,          PLYMOUTH_PLUGIN_PATH "renderers/x11.so"          },
-                { PLY_RENDERER_TYPE_DRM,          PLYMOUTH_PLUGIN_PATH "renderers/drm.so"          },
-                { PLY_RENDERER_TYPE_FRAME_BUFFER, PLYMOUTH_PLUGIN_PATH "renderers/frame-buffer.so" },
-                { PLY_RENDERER_TYPE_NONE,         NULL                                             }
-        };
-
         renderer->is_active = false;
+
+        /* Already loaded by ply_renderer_probe */
+        if (renderer->plugin_interface != NULL) {
+                renderer->is_active = ply_renderer_open_plugin (renderer,
+                                                                get_plugin_path_for_type (renderer->type));
+                return renderer->is_active;
+        }
+
         for (i = 0; known_plugins[i].type != PLY_RENDERER_TYPE_NONE; i++) {
                 if (renderer->type == known_plugins[i].type ||
                     renderer->type == PLY_RENDERER_TYPE_AUTO) {
@@ -307,6 +393,13 @@ ply_renderer_handle_change_event (ply_renderer_t *renderer)
         return false;
 }
 
+void
+ply_renderer_probe_connectors (ply_renderer_t *renderer)
+{
+        if (renderer->plugin_interface->probe_connectors)
+                renderer->plugin_interface->probe_connectors (renderer->backend);
+}
+
 void
 ply_renderer_activate (ply_renderer_t *renderer)
 {
@@ -354,7 +447,7 @@ ply_renderer_get_buffer_for_head (ply_renderer_t      *renderer,
                                                                 head);
 }
 
-void
+bool
 ply_renderer_flush_head (ply_renderer_t      *renderer,
                          ply_renderer_head_t *head)
 {
@@ -363,9 +456,95 @@ ply_renderer_flush_head (ply_renderer_t      *renderer,
         assert (head != NULL);
 
         if (!ply_renderer_map_to_device (renderer))
+                return false;
+
+        return renderer->plugin_interface->flush_head (renderer->backend, head);
+}
+
+bool
+ply_renderer_flush_head_in_parallel (ply_renderer_t      *renderer,
+                                     ply_renderer_head_t *head)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+        assert (renderer->is_mapped);
+        assert (head != NULL);
+
+        return renderer->plugin_interface->flush_head (renderer->backend, head);
+}
+
+bool
+ply_renderer_can_flush_heads_in_parallel (ply_renderer_t *renderer)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+
+        /* Mapping isn't thread safe, so the first flush happens serially */
+        if (!renderer->is_mapped)
+                return false;
+
+        if (!renderer->plugin_interface->can_flush_heads_in_parallel)
+                return false;
+
+        return renderer->plugin_interface->can_flush_heads_in_parallel (renderer->backend);
+}
+
+ply_renderer_sprite_t *
+ply_renderer_create_sprite (ply_renderer_t      *renderer,
+                            ply_renderer_head_t *head,
+                            long                 x,
+                            long                 y,
+                            unsigned long        width,
+                            unsigned long        height)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+        assert (head != NULL);
+
+        if (!renderer->plugin_interface->create_sprite)
+                return NULL;
+
+        if (!ply_renderer_map_to_device (renderer))
+                return NULL;
+
+        return renderer->plugin_interface->create_sprite (renderer->backend, head,
+                                                          x, y, width, height);
+}
+
+void
+ply_renderer_destroy_sprite (ply_renderer_t        *renderer,
+                             ply_renderer_sprite_t *sprite)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+
+        if (sprite == NULL)
                 return;
 
-        renderer->plugin_interface->flush_head (renderer->backend, head);
+        renderer->plugin_interface->destroy_sprite (renderer->backend, sprite);
+}
+
+ply_pixel_buffer_t *
+ply_renderer_get_buffer_for_sprite (ply_renderer_t        *renderer,
+                                    ply_renderer_sprite_t *sprite)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+        assert (sprite != NULL);
+
+        return renderer->plugin_interface->get_buffer_for_sprite (renderer->backend,
+                                                                  sprite);
+}
+
+void
+ply_renderer_flush_sprite (ply_renderer_t        *renderer,
+                           ply_renderer_sprite_t *sprite)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+        assert (sprite != NULL);
+
+        renderer->plugin_interface->flush_sprite (renderer->backend, sprite);
 }
 
 void
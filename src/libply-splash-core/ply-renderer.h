@@ -35,6 +35,7 @@
 typedef struct _ply_renderer ply_renderer_t;
 typedef struct _ply_renderer_head ply_renderer_head_t;
 typedef struct _ply_renderer_input_source ply_renderer_input_source_t;
+typedef struct _ply_renderer_sprite ply_renderer_sprite_t;
 
 typedef enum
 {
@@ -54,20 +55,57 @@ ply_renderer_t *ply_renderer_new (ply_renderer_type_t renderer_type,
                                   const char         *device_name,
                                   ply_terminal_t     *terminal);
 void ply_renderer_free (ply_renderer_t *renderer);
+/* Loads the plugin and does the part of opening the device that is safe
+ * to do from another thread. ply_renderer_open finishes the job. Only for
+ * renderers of a specific type.
+ */
+bool ply_renderer_probe (ply_renderer_t *renderer);
 bool ply_renderer_open (ply_renderer_t *renderer);
 void ply_renderer_close (ply_renderer_t *renderer);
 /* Returns true when the heads have changed as a result of the change event */
 bool ply_renderer_handle_change_event (ply_renderer_t *renderer);
+/* Gets a following ply_renderer_handle_change_event the slow parts of
+ * output probing out of the way. Safe to call from another thread while
+ * the renderer is in use, but not while it's being opened or closed.
+ */
+void ply_renderer_probe_connectors (ply_renderer_t *renderer);
 void ply_renderer_activate (ply_renderer_t *renderer);
 void ply_renderer_deactivate (ply_renderer_t *renderer);
 bool ply_renderer_is_active (ply_renderer_t *renderer);
 const char *ply_renderer_get_device_name (ply_renderer_t *renderer);
+ply_renderer_type_t ply_renderer_get_type (ply_renderer_t *renderer);
 ply_list_t *ply_renderer_get_heads (ply_renderer_t *renderer);
 ply_pixel_buffer_t *ply_renderer_get_buffer_for_head (ply_renderer_t      *renderer,
                                                       ply_renderer_head_t *head);
 
-void ply_renderer_flush_head (ply_renderer_t      *renderer,
+/* Both return false when nothing made it to the screen */
+bool ply_renderer_flush_head (ply_renderer_t      *renderer,
                               ply_renderer_head_t *head);
+bool ply_renderer_can_flush_heads_in_parallel (ply_renderer_t *renderer);
+/* For worker threads, once ply_renderer_can_flush_heads_in_parallel says
+ * so. Unlike ply_renderer_flush_head it doesn't map the device, which
+ * only the main thread may do.
+ */
+bool ply_renderer_flush_head_in_parallel (ply_renderer_t      *renderer,
+                                          ply_renderer_head_t *head);
+
+/* Sprites are small buffers shown over a head by a hardware plane,
+ * so updating them doesn't require redrawing the head beneath them.
+ * Positions and sizes are in logical pixels.  Renderers without a
+ * spare plane return NULL from ply_renderer_create_sprite.
+ */
+ply_renderer_sprite_t *ply_renderer_create_sprite (ply_renderer_t      *renderer,
+                                                   ply_renderer_head_t *head,
+                                                   long                 x,
+                                                   long                 y,
+                                                   unsigned long        width,
+                                                   unsigned long        height);
+void ply_renderer_destroy_sprite (ply_renderer_t        *renderer,
+                                  ply_renderer_sprite_t *sprite);
+ply_pixel_buffer_t *ply_renderer_get_buffer_for_sprite (ply_renderer_t        *renderer,
+                                                        ply_renderer_sprite_t *sprite);
+void ply_renderer_flush_sprite (ply_renderer_t        *renderer,
+                                ply_renderer_sprite_t *sprite);
 
 void ply_renderer_add_input_device (ply_renderer_t     *renderer,
                                     ply_input_device_t *input_device);
@@ -39,6 +39,7 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-terminal.h"
 #include "ply-utils.h"
 
@@ -70,6 +71,10 @@
 #define COLOR_SEQUENCE_FORMAT "\033[%dm"
 #endif
 
+#ifndef COLORS_SEQUENCE_FORMAT
+#define COLORS_SEQUENCE_FORMAT "\033[%d;%dm"
+#endif
+
 #ifndef PAUSE_SEQUENCE
 #define PAUSE_SEQUENCE "\023"
 #endif
@@ -90,6 +95,18 @@
 #define TEXT_PALETTE_SIZE 48
 #endif
 
+/* A character cell of the screen.  character_size is 0 when what's
+ * in the cell isn't known, for instance after output that couldn't be
+ * followed.
+ */
+typedef struct
+{
+        char    character[4];
+        uint8_t character_size;
+        uint8_t foreground_color;
+        uint8_t background_color;
+} ply_text_display_cell_t;
+
 struct _ply_text_display
 {
         ply_event_loop_t               *loop;
@@ -101,8 +118,38 @@ struct _ply_text_display
 
         ply_text_display_draw_handler_t draw_handler;
         void                           *draw_handler_user_data;
+
+        /* What is believed to be on screen, and, while a frame is open,
+         * what the frame has drawn so far.  Closing the frame only sends
+         * the cells that differ.
+         */
+        ply_text_display_cell_t        *cells;
+        ply_text_display_cell_t        *frame_cells;
+        int                             number_of_grid_columns;
+        int                             number_of_grid_rows;
+        int                             frame_depth;
+        ply_terminal_color_t            frame_clear_color;
+
+        /* Where the next character goes.  Outside of frames this is
+         * where the terminal's cursor is.
+         */
+        int                             cursor_column;
+        int                             cursor_row;
+
+        /* What was last sent to the terminal */
+        int                             terminal_cursor_column;
+        int                             terminal_cursor_row;
+        ply_terminal_color_t            terminal_foreground_color;
+        ply_terminal_color_t            terminal_background_color;
+
+        uint32_t                        cursor_is_known : 1;
+        uint32_t                        terminal_colors_are_known : 1;
+        uint32_t                        frame_clears_screen : 1;
+        uint32_t                        some_cells_are_known : 1;
 };
 
+static void ply_text_display_flush_frame (ply_text_display_t *display);
+
 ply_text_display_t *
 ply_text_display_new (ply_terminal_t *terminal)
 {
@@ -128,6 +175,329 @@ ply_text_display_get_number_of_rows (ply_text_display_t *display)
         return ply_terminal_get_number_of_rows (display->terminal);
 }
 
+static void
+ply_text_display_forget_screen (ply_text_display_t *display)
+{
+        int number_of_cells;
+
+        number_of_cells = display->number_of_grid_columns * display->number_of_grid_rows;
+
+        if (display->some_cells_are_known)
+                memset (display->cells, 0, number_of_cells * sizeof(ply_text_display_cell_t));
+
+        display->some_cells_are_known = false;
+        display->cursor_is_known = false;
+        display->terminal_colors_are_known = false;
+}
+
+static void
+ply_text_display_update_grid_size (ply_text_display_t *display)
+{
+        int number_of_columns, number_of_rows;
+
+        number_of_columns = ply_text_display_get_number_of_columns (display);
+        number_of_rows = ply_text_display_get_number_of_rows (display);
+
+        if (number_of_columns == display->number_of_grid_columns &&
+            number_of_rows == display->number_of_grid_rows &&
+            display->cells != NULL)
+                return;
+
+        free (display->cells);
+        free (display->frame_cells);
+
+        display->number_of_grid_columns = MAX (number_of_columns, 1);
+        display->number_of_grid_rows = MAX (number_of_rows, 1);
+        display->cells = calloc (display->number_of_grid_columns * display->number_of_grid_rows,
+                                 sizeof(ply_text_display_cell_t));
+        display->frame_cells = calloc (display->number_of_grid_columns * display->number_of_grid_rows,
+                                       sizeof(ply_text_display_cell_t));
+
+        display->cursor_is_known = false;
+        display->some_cells_are_known = false;
+}
+
+static ply_text_display_cell_t *
+ply_text_display_get_drawing_cells (ply_text_display_t *display)
+{
+        if (display->frame_depth > 0)
+                return display->frame_cells;
+
+        return display->cells;
+}
+
+static void
+ply_text_display_fill_cells (ply_text_display_t      *display,
+                             ply_text_display_cell_t *cells,
+                             int                      column,
+                             int                      row,
+                             int                      number_of_cells)
+{
+        ply_text_display_cell_t blank = { " ", 1 };
+        int i;
+
+        blank.foreground_color = display->foreground_color;
+        blank.background_color = display->background_color;
+
+        if (cells == display->cells)
+                display->some_cells_are_known = true;
+
+        cells += row * display->number_of_grid_columns + column;
+        for (i = 0; i < number_of_cells; i++) {
+                cells[i] = blank;
+        }
+}
+
+/* Tells if the string only has characters that the grid can follow:
+ * printable ones that fit on the screen from the cursor, and carriage
+ * returns.
+ */
+static bool
+ply_text_display_can_follow_string (ply_text_display_t *display,
+                                    const char         *string)
+{
+        int column, row;
+
+        if (!display->cursor_is_known)
+                return false;
+
+        column = display->cursor_column;
+        row = display->cursor_row;
+
+        while (*string != '\0') {
+                int character_size;
+
+                if (*string == '\r') {
+                        column = 0;
+                        string++;
+                        continue;
+                }
+
+                if ((unsigned char) *string < ' ' || *string == '\177')
+                        return false;
+
+                character_size = ply_utf8_character_get_size (string, strlen (string));
+                if (character_size <= 0 || character_size > 4)
+                        return false;
+
+                if (column >= display->number_of_grid_columns) {
+                        column = 0;
+                        row++;
+                }
+
+                if (row >= display->number_of_grid_rows)
+                        return false;
+
+                column++;
+                string += character_size;
+        }
+
+        return true;
+}
+
+static void
+ply_text_display_follow_string (ply_text_display_t      *display,
+                                ply_text_display_cell_t *cells,
+                                const char              *string)
+{
+        if (cells == display->cells)
+                display->some_cells_are_known = true;
+
+        while (*string != '\0') {
+                ply_text_display_cell_t *cell;
+                int character_size;
+
+                if (*string == '\r') {
+                        display->cursor_column = 0;
+                        string++;
+                        continue;
+                }
+
+                character_size = ply_utf8_character_get_size (string, strlen (string));
+
+                if (display->cursor_column >= display->number_of_grid_columns) {
+                        display->cursor_column = 0;
+                        display->cursor_row++;
+                }
+
+                cell = &cells[display->cursor_row * display->number_of_grid_columns + display->cursor_column];
+                memcpy (cell->character, string, character_size);
+                cell->character_size = character_size;
+                cell->foreground_color = display->foreground_color;
+                cell->background_color = display->background_color;
+
+                display->cursor_column++;
+                string += character_size;
+        }
+}
+
+/* Sends output the grid can't follow, after anything drawn so far */
+static void
+ply_text_display_write_unfollowed (ply_text_display_t *display,
+                                   const char         *string)
+{
+        if (display->frame_depth > 0)
+                ply_text_display_flush_frame (display);
+
+        ply_terminal_write (display->terminal, "%s", string);
+        ply_text_display_forget_screen (display);
+
+        if (display->frame_depth > 0)
+                memset (display->frame_cells, 0,
+                        display->number_of_grid_columns * display->number_of_grid_rows * sizeof(ply_text_display_cell_t));
+}
+
+static void
+ply_text_display_append_colors (ply_text_display_t *display,
+                                ply_buffer_t       *output,
+                                int                 foreground_color,
+                                int                 background_color)
+{
+        bool foreground_changes, background_changes;
+
+        foreground_changes = !display->terminal_colors_are_known ||
+                             display->terminal_foreground_color != (ply_terminal_color_t) foreground_color;
+        background_changes = !display->terminal_colors_are_known ||
+                             display->terminal_background_color != (ply_terminal_color_t) background_color;
+
+        if (foreground_changes && background_changes)
+                ply_buffer_append (output, COLORS_SEQUENCE_FORMAT,
+                                   FOREGROUND_COLOR_BASE + foreground_color,
+                                   BACKGROUND_COLOR_BASE + background_color);
+        else if (foreground_changes)
+                ply_buffer_append (output, COLOR_SEQUENCE_FORMAT,
+                                   FOREGROUND_COLOR_BASE + foreground_color);
+        else if (background_changes)
+                ply_buffer_append (output, COLOR_SEQUENCE_FORMAT,
+                                   BACKGROUND_COLOR_BASE + background_color);
+
+        display->terminal_foreground_color = foreground_color;
+        display->terminal_background_color = background_color;
+        display->terminal_colors_are_known = true;
+}
+
+static void
+ply_text_display_append_cursor_move (ply_text_display_t *display,
+                                     ply_buffer_t       *output,
+                                     int                 column,
+                                     int                 row)
+{
+        if (display->terminal_cursor_column == column &&
+            display->terminal_cursor_row == row)
+                return;
+
+        ply_buffer_append (output, MOVE_CURSOR_SEQUENCE, row + 1, column + 1);
+        display->terminal_cursor_column = column;
+        display->terminal_cursor_row = row;
+}
+
+/* Sends the cells the frame changed, then puts the cursor and colors
+ * where the frame left them
+ */
+static void
+ply_text_display_flush_frame (ply_text_display_t *display)
+{
+        ply_buffer_t *output;
+        int number_of_cells, i;
+
+        output = ply_buffer_new ();
+        number_of_cells = display->number_of_grid_columns * display->number_of_grid_rows;
+
+        /* A frame that clears the screen and redraws it only needs the
+         * clear if parts of the screen aren't known
+         */
+        if (display->frame_clears_screen) {
+                display->frame_clears_screen = false;
+                for (i = 0; i < number_of_cells; i++) {
+                        if (display->cells[i].character_size == 0) {
+                                display->frame_clears_screen = true;
+                                break;
+                        }
+                }
+        }
+
+        if (display->frame_clears_screen) {
+                ply_text_display_append_colors (display, output,
+                                                display->foreground_color,
+                                                display->frame_clear_color);
+                ply_buffer_append (output, CLEAR_SCREEN_SEQUENCE);
+                display->terminal_cursor_column = -1;
+                ply_text_display_fill_cells (display, display->cells, 0, 0, number_of_cells);
+                for (i = 0; i < number_of_cells; i++) {
+                        display->cells[i].background_color = display->frame_clear_color;
+                        display->cells[i].foreground_color = display->foreground_color;
+                }
+                display->frame_clears_screen = false;
+        }
+
+        for (i = 0; i < number_of_cells; i++) {
+                ply_text_display_cell_t *frame_cell = &display->frame_cells[i];
+                ply_text_display_cell_t *cell = &display->cells[i];
+
+                if (frame_cell->character_size == 0)
+                        continue;
+
+                if (cell->character_size == frame_cell->character_size &&
+                    memcmp (cell->character, frame_cell->character, cell->character_size) == 0 &&
+                    cell->foreground_color == frame_cell->foreground_color &&
+                    cell->background_color == frame_cell->background_color)
+                        continue;
+
+                ply_text_display_append_cursor_move (display, output,
+                                                     i % display->number_of_grid_columns,
+                                                     i / display->number_of_grid_columns);
+                ply_text_display_append_colors (display, output,
+                                                frame_cell->foreground_color,
+                                                frame_cell->background_color);
+                ply_buffer_append_bytes (output, frame_cell->character, frame_cell->character_size);
+                display->terminal_cursor_column++;
+
+                *cell = *frame_cell;
+                display->some_cells_are_known = true;
+        }
+
+        if (display->cursor_is_known)
+                ply_text_display_append_cursor_move (display, output,
+                                                     MIN (display->cursor_column, display->number_of_grid_columns - 1),
+                                                     display->cursor_row);
+        ply_text_display_append_colors (display, output,
+                                        display->foreground_color,
+                                        display->background_color);
+
+        if (ply_buffer_get_size (output) > 0)
+                ply_terminal_write (display->terminal, "%s", ply_buffer_get_bytes (output));
+        ply_buffer_free (output);
+
+        memcpy (display->frame_cells, display->cells, number_of_cells * sizeof(ply_text_display_cell_t));
+}
+
+void
+ply_text_display_begin_frame (ply_text_display_t *display)
+{
+        assert (display != NULL);
+
+        display->frame_depth++;
+
+        if (display->frame_depth > 1)
+                return;
+
+        ply_text_display_update_grid_size (display);
+        memcpy (display->frame_cells, display->cells,
+                display->number_of_grid_columns * display->number_of_grid_rows * sizeof(ply_text_display_cell_t));
+}
+
+void
+ply_text_display_end_frame (ply_text_display_t *display)
+{
+        assert (display != NULL);
+        assert (display->frame_depth > 0);
+
+        if (display->frame_depth == 1)
+                ply_text_display_flush_frame (display);
+
+        display->frame_depth--;
+}
+
 void
 ply_text_display_set_cursor_position (ply_text_display_t *display,
                                       int                 column,
@@ -142,9 +512,22 @@ ply_text_display_set_cursor_position (ply_text_display_t *display,
         column = CLAMP (column, 0, number_of_columns - 1);
         row = CLAMP (row, 0, number_of_rows - 1);
 
+        /* The move sequence is 1-based, so 0 and 1 land in the same place */
+        display->cursor_column = MAX (column, 1) - 1;
+        display->cursor_row = MAX (row, 1) - 1;
+        display->cursor_is_known = true;
+
+        if (display->frame_depth > 0)
+                return;
+
+        ply_text_display_update_grid_size (display);
+
         ply_terminal_write (display->terminal,
                             MOVE_CURSOR_SEQUENCE,
                             row, column);
+
+        display->terminal_cursor_column = display->cursor_column;
+        display->terminal_cursor_row = display->cursor_row;
 }
 
 void
@@ -153,8 +536,19 @@ ply_text_display_clear_screen (ply_text_display_t *display)
         if (ply_is_tracing_to_terminal ())
                 return;
 
-        ply_terminal_write (display->terminal,
-                            CLEAR_SCREEN_SEQUENCE);
+        if (display->frame_depth > 0) {
+                ply_text_display_fill_cells (display, display->frame_cells, 0, 0,
+                                             display->number_of_grid_columns * display->number_of_grid_rows);
+                display->frame_clears_screen = true;
+                display->frame_clear_color = display->background_color;
+        } else {
+                ply_terminal_write (display->terminal,
+                                    CLEAR_SCREEN_SEQUENCE);
+
+                ply_text_display_update_grid_size (display);
+                ply_text_display_fill_cells (display, display->cells, 0, 0,
+                                             display->number_of_grid_columns * display->number_of_grid_rows);
+        }
 
         ply_text_display_set_cursor_position (display, 0, 0);
 }
@@ -162,37 +556,79 @@ ply_text_display_clear_screen (ply_text_display_t *display)
 void
 ply_text_display_clear_line (ply_text_display_t *display)
 {
+        /* The sequence ends with a newline, which scrolls on the last row */
+        if (!display->cursor_is_known ||
+            display->cursor_row + 1 >= display->number_of_grid_rows) {
+                ply_text_display_write_unfollowed (display, CLEAR_LINE_SEQUENCE);
+                return;
+        }
+
+        ply_text_display_fill_cells (display, ply_text_display_get_drawing_cells (display),
+                                     0, display->cursor_row,
+                                     display->number_of_grid_columns);
+        display->cursor_column = 0;
+        display->cursor_row++;
+
+        if (display->frame_depth > 0)
+                return;
+
         ply_terminal_write (display->terminal,
                             CLEAR_LINE_SEQUENCE);
+        display->terminal_cursor_column = display->cursor_column;
+        display->terminal_cursor_row = display->cursor_row;
 }
 
 void
 ply_text_display_remove_character (ply_text_display_t *display)
 {
+        if (!display->cursor_is_known || display->cursor_column == 0) {
+                ply_text_display_write_unfollowed (display, BACKSPACE);
+                return;
+        }
+
+        display->cursor_column = MIN (display->cursor_column, display->number_of_grid_columns) - 1;
+        ply_text_display_fill_cells (display, ply_text_display_get_drawing_cells (display),
+                                     display->cursor_column, display->cursor_row,
+                                     display->number_of_grid_columns - display->cursor_column);
+
+        if (display->frame_depth > 0)
+                return;
+
         ply_terminal_write (display->terminal,
                             BACKSPACE);
+        display->terminal_cursor_column = display->cursor_column;
 }
 
 void
 ply_text_display_set_background_color (ply_text_display_t  *display,
                                        ply_terminal_color_t color)
 {
+        display->background_color = color;
+
+        if (display->frame_depth > 0)
+                return;
+
         ply_terminal_write (display->terminal,
                             COLOR_SEQUENCE_FORMAT,
                             BACKGROUND_COLOR_BASE + color);
 
-        display->background_color = color;
+        display->terminal_background_color = color;
 }
 
 void
 ply_text_display_set_foreground_color (ply_text_display_t  *display,
                                        ply_terminal_color_t color)
 {
+        display->foreground_color = color;
+
+        if (display->frame_depth > 0)
+                return;
+
         ply_terminal_write (display->terminal,
                             COLOR_SEQUENCE_FORMAT,
                             FOREGROUND_COLOR_BASE + color);
 
-        display->foreground_color = color;
+        display->terminal_foreground_color = color;
 }
 
 ply_terminal_color_t
@@ -214,15 +650,21 @@ ply_text_display_draw_area (ply_text_display_t *display,
                             int                 width,
                             int                 height)
 {
-        if (display->draw_handler != NULL)
-                display->draw_handler (display->draw_handler_user_data,
-                                       display->terminal,
-                                       x, y, width, height);
+        if (display->draw_handler == NULL)
+                return;
+
+        display->draw_handler (display->draw_handler_user_data,
+                               display->terminal,
+                               x, y, width, height);
+        ply_phase_tracer_mark (PLY_PHASE_FIRST_TEXT_FRAME);
 }
 
 void
 ply_text_display_hide_cursor (ply_text_display_t *display)
 {
+        if (display->frame_depth > 0)
+                ply_text_display_flush_frame (display);
+
         ply_terminal_write (display->terminal,
                             HIDE_CURSOR_SEQUENCE);
 }
@@ -247,13 +689,33 @@ ply_text_display_write (ply_text_display_t *display,
         vasprintf (&string, format, args);
         va_end (args);
 
-        write (fd, string, strlen (string));
+        ply_text_display_update_grid_size (display);
+
+        if (!ply_text_display_can_follow_string (display, string)) {
+                ply_text_display_write_unfollowed (display, string);
+                free (string);
+                return;
+        }
+
+        ply_text_display_follow_string (display,
+                                        ply_text_display_get_drawing_cells (display),
+                                        string);
+
+        if (display->frame_depth == 0) {
+                write (fd, string, strlen (string));
+                display->terminal_cursor_column = display->cursor_column;
+                display->terminal_cursor_row = display->cursor_row;
+        }
+
         free (string);
 }
 
 void
 ply_text_display_show_cursor (ply_text_display_t *display)
 {
+        if (display->frame_depth > 0)
+                ply_text_display_flush_frame (display);
+
         ply_terminal_write (display->terminal,
                             SHOW_CURSOR_SEQUENCE);
 }
@@ -284,6 +746,8 @@ ply_text_display_free (ply_text_display_t *display)
                                                        display);
         }
 
+        free (display->cells);
+        free (display->frame_cells);
         free (display);
 }
 
@@ -301,6 +765,9 @@ ply_text_display_set_draw_handler (ply_text_display_t             *display,
 void
 ply_text_display_pause_updates (ply_text_display_t *display)
 {
+        if (display->frame_depth > 0)
+                ply_text_display_flush_frame (display);
+
         ply_terminal_write (display->terminal,
                             PAUSE_SEQUENCE);
 }
@@ -308,6 +775,9 @@ ply_text_display_pause_updates (ply_text_display_t *display)
 void
 ply_text_display_unpause_updates (ply_text_display_t *display)
 {
+        if (display->frame_depth > 0)
+                ply_text_display_flush_frame (display);
+
         ply_terminal_write (display->terminal,
                             UNPAUSE_SEQUENCE);
 }
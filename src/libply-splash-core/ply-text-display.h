@@ -58,6 +58,8 @@ __attribute__((__format__ (__printf__, 2, 3)))
 void ply_text_display_write (ply_text_display_t *display,
                              const char         *format,
                              ...);
+void ply_text_display_begin_frame (ply_text_display_t *display);
+void ply_text_display_end_frame (ply_text_display_t *display);
 void ply_text_display_hide_cursor (ply_text_display_t *display);
 void ply_text_display_show_cursor (ply_text_display_t *display);
 void ply_text_display_clear_screen (ply_text_display_t *display);
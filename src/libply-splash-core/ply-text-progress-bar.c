@@ -182,6 +182,8 @@ ply_text_progress_bar_draw (ply_text_progress_bar_t *progress_bar)
 
         width = progress_bar->number_of_columns - 2 - strlen (os_string);
 
+        ply_text_display_begin_frame (progress_bar->display);
+
         ply_text_display_set_cursor_position (progress_bar->display,
                                               progress_bar->column,
                                               progress_bar->row);
@@ -232,6 +234,8 @@ ply_text_progress_bar_draw (ply_text_progress_bar_t *progress_bar)
                 ply_text_display_set_foreground_color (progress_bar->display,
                                                        PLY_TERMINAL_COLOR_DEFAULT);
         }
+
+        ply_text_display_end_frame (progress_bar->display);
 }
 
 void
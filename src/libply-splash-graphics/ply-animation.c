@@ -46,6 +46,7 @@
 #include "ply-logger.h"
 #include "ply-image.h"
 #include "ply-pixel-buffer.h"
+#include "ply-renderer.h"
 #include "ply-utils.h"
 
 #include <linux/kd.h>
@@ -61,15 +62,19 @@ struct _ply_animation
         char                *image_dir;
         char                *frames_prefix;
 
-        ply_pixel_display_t *display;
-        ply_trigger_t       *stop_trigger;
-
-        int                  frame_number;
-        long                 x, y;
-        long                 width, height;
-        double               start_time, previous_time, now;
-        uint32_t             is_stopped : 1;
-        uint32_t             stop_requested : 1;
+        ply_pixel_display_t   *display;
+        ply_renderer_sprite_t *sprite;
+        ply_trigger_t         *stop_trigger;
+
+        int                    frame_number;
+        /* What draw_area shows, which a deferred draw may ask for after
+         * frame_number has moved on */
+        int                    displayed_frame_number;
+        long                   x, y;
+        long                   width, height;
+        double                 start_time, previous_time, now;
+        uint32_t               is_stopped : 1;
+        uint32_t               stop_requested : 1;
 };
 
 static void ply_animation_stop_now (ply_animation_t *animation);
@@ -156,11 +161,16 @@ animate_at_time (ply_animation_t *animation,
 
         frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (animation->frames);
         ply_pixel_buffer_get_size (frames[animation->frame_number], &frame_area);
+        animation->displayed_frame_number = animation->frame_number;
 
-        ply_pixel_display_draw_area (animation->display,
-                                     animation->x, animation->y,
-                                     frame_area.width,
-                                     frame_area.height);
+        if (animation->sprite != NULL)
+                ply_pixel_display_draw_sprite (animation->display, animation->sprite,
+                                               frames[animation->frame_number]);
+        else
+                ply_pixel_display_draw_area (animation->display,
+                                             animation->x, animation->y,
+                                             frame_area.width,
+                                             frame_area.height);
 
         animation->frame_number++;
 
@@ -325,6 +335,10 @@ ply_animation_start (ply_animation_t     *animation,
 
         animation->start_time = ply_get_timestamp ();
 
+        animation->sprite = ply_pixel_display_create_sprite (display, x, y,
+                                                             animation->width,
+                                                             animation->height);
+
         ply_event_loop_watch_for_timeout (animation->loop,
                                           1.0 / FRAMES_PER_SECOND,
                                           (ply_event_loop_timeout_handler_t)
@@ -340,6 +354,9 @@ ply_animation_stop_now (ply_animation_t *animation)
 
         ply_trace ("stopping animation now");
 
+        ply_pixel_display_destroy_sprite (animation->display, animation->sprite);
+        animation->sprite = NULL;
+
         if (animation->loop != NULL) {
                 ply_event_loop_stop_watching_for_timeout (animation->loop,
                                                           (ply_event_loop_timeout_handler_t)
@@ -385,11 +402,11 @@ ply_animation_draw_area (ply_animation_t    *animation,
         int number_of_frames;
         int frame_index;
 
-        if (animation->is_stopped)
+        if (animation->is_stopped || animation->sprite != NULL)
                 return;
 
         number_of_frames = ply_array_get_size (animation->frames);
-        frame_index = MIN (animation->frame_number, number_of_frames - 1);
+        frame_index = MIN (animation->displayed_frame_number, number_of_frames - 1);
 
         frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (animation->frames);
         ply_pixel_buffer_fill_with_buffer (buffer,
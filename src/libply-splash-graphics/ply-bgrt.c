@@ -0,0 +1,169 @@
+/* ply-bgrt.c - Firmware boot logo from the ACPI BGRT table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-bgrt.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ply-logger.h"
+
+#define BGRT_STATUS_ORIENTATION_OFFSET_0    (0 << 1)
+#define BGRT_STATUS_ORIENTATION_OFFSET_90   (1 << 1)
+#define BGRT_STATUS_ORIENTATION_OFFSET_180  (2 << 1)
+#define BGRT_STATUS_ORIENTATION_OFFSET_270  (3 << 1)
+#define BGRT_STATUS_ORIENTATION_OFFSET_MASK (3 << 1)
+
+static ply_image_t *bgrt_image;
+static int bgrt_width;
+static int bgrt_height;
+static int bgrt_x_offset;
+static int bgrt_y_offset;
+static ply_pixel_buffer_rotation_t bgrt_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+
+static bool bgrt_image_was_read;
+static bool bgrt_placement_was_read;
+static bool bgrt_has_placement;
+
+static bool
+read_sysfs_info (int                         *x_offset,
+                 int                         *y_offset,
+                 ply_pixel_buffer_rotation_t *rotation)
+{
+        bool ret = false;
+        char buf[64];
+        int status;
+        FILE *f;
+
+        f = fopen ("/sys/firmware/acpi/bgrt/status", "r");
+        if (!f)
+                return false;
+
+        if (!fgets (buf, sizeof(buf), f))
+                goto out;
+
+        if (sscanf (buf, "%d", &status) != 1)
+                goto out;
+
+        fclose (f);
+
+        switch (status & BGRT_STATUS_ORIENTATION_OFFSET_MASK) {
+        case BGRT_STATUS_ORIENTATION_OFFSET_0:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+                break;
+        case BGRT_STATUS_ORIENTATION_OFFSET_90:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE;
+                break;
+        case BGRT_STATUS_ORIENTATION_OFFSET_180:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN;
+                break;
+        case BGRT_STATUS_ORIENTATION_OFFSET_270:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE;
+                break;
+        }
+
+        f = fopen ("/sys/firmware/acpi/bgrt/xoffset", "r");
+        if (!f)
+                return false;
+
+        if (!fgets (buf, sizeof(buf), f))
+                goto out;
+
+        if (sscanf (buf, "%d", x_offset) != 1)
+                goto out;
+
+        fclose (f);
+
+        f = fopen ("/sys/firmware/acpi/bgrt/yoffset", "r");
+        if (!f)
+                return false;
+
+        if (!fgets (buf, sizeof(buf), f))
+                goto out;
+
+        if (sscanf (buf, "%d", y_offset) != 1)
+                goto out;
+
+        ret = true;
+out:
+        fclose (f);
+        return ret;
+}
+
+ply_image_t *
+ply_bgrt_get_image (void)
+{
+        if (bgrt_image_was_read)
+                return bgrt_image;
+
+        bgrt_image_was_read = true;
+
+        ply_trace ("loading bgrt image");
+        bgrt_image = ply_image_new ("/sys/firmware/acpi/bgrt/image");
+
+        if (!ply_image_load (bgrt_image)) {
+                ply_trace ("could not load bgrt image");
+                ply_image_free (bgrt_image);
+                bgrt_image = NULL;
+                return NULL;
+        }
+
+        /* Callers set the device rotation and scale of the shared buffer,
+         * which changes what ply_image_get_width/height report, so keep
+         * the size as loaded */
+        bgrt_width = ply_image_get_width (bgrt_image);
+        bgrt_height = ply_image_get_height (bgrt_image);
+
+        return bgrt_image;
+}
+
+bool
+ply_bgrt_get_size (int *width,
+                   int *height)
+{
+        if (ply_bgrt_get_image () == NULL)
+                return false;
+
+        *width = bgrt_width;
+        *height = bgrt_height;
+
+        return true;
+}
+
+bool
+ply_bgrt_get_placement (int                         *x_offset,
+                        int                         *y_offset,
+                        ply_pixel_buffer_rotation_t *rotation)
+{
+        if (!bgrt_placement_was_read) {
+                bgrt_placement_was_read = true;
+                bgrt_has_placement = read_sysfs_info (&bgrt_x_offset,
+                                                      &bgrt_y_offset,
+                                                      &bgrt_rotation);
+        }
+
+        if (!bgrt_has_placement)
+                return false;
+
+        *x_offset = bgrt_x_offset;
+        *y_offset = bgrt_y_offset;
+        *rotation = bgrt_rotation;
+
+        return true;
+}
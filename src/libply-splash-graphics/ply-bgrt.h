@@ -0,0 +1,41 @@
+/* ply-bgrt.h - Firmware boot logo from the ACPI BGRT table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_BGRT_H
+#define PLY_BGRT_H
+
+#include <stdbool.h>
+
+#include "ply-image.h"
+#include "ply-pixel-buffer.h"
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+/* The logo and its placement are read from sysfs the first time they're
+ * asked for and kept for the life of the process. The image is shared,
+ * so it must not be freed.  ply_bgrt_get_size returns the size of the
+ * logo as stored in firmware, whatever device rotation and scale have
+ * since been set on the image's buffer.
+ */
+ply_image_t *ply_bgrt_get_image (void);
+bool ply_bgrt_get_size (int *width,
+                        int *height);
+bool ply_bgrt_get_placement (int                         *x_offset,
+                             int                         *y_offset,
+                             ply_pixel_buffer_rotation_t *rotation);
+#endif
+
+#endif /* PLY_BGRT_H */
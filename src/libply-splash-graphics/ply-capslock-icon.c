@@ -28,6 +28,7 @@
 
 #include "ply-capslock-icon.h"
 #include "ply-event-loop.h"
+#include "ply-frame-governor.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
 #include "ply-logger.h"
@@ -42,14 +43,15 @@
 
 struct _ply_capslock_icon
 {
-        char                *image_name;
-        ply_pixel_buffer_t  *buffer;
-        ply_event_loop_t    *loop;
-        ply_pixel_display_t *display;
-        long                 x, y;
-        unsigned long        width, height;
-        bool                 is_hidden;
-        bool                 is_on;
+        char                 *image_name;
+        ply_pixel_buffer_t   *buffer;
+        ply_event_loop_t     *loop;
+        ply_pixel_display_t  *display;
+        ply_frame_governor_t *poll_governor;
+        long                  x, y;
+        unsigned long         width, height;
+        bool                  is_hidden;
+        bool                  is_on;
 };
 
 static void ply_capslock_stop_polling (ply_capslock_icon_t *capslock_icon);
@@ -65,6 +67,8 @@ ply_capslock_icon_new (const char *image_dir)
 
         asprintf (&capslock_icon->image_name, "%s/capslock.png", image_dir);
         capslock_icon->is_hidden = true;
+        capslock_icon->poll_governor = ply_frame_governor_new ("capslock polling",
+                                                               FRAMES_PER_SECOND);
 
         return capslock_icon;
 }
@@ -81,6 +85,7 @@ ply_capslock_icon_free (ply_capslock_icon_t *capslock_icon)
         if (capslock_icon->buffer != NULL)
                 ply_pixel_buffer_free (capslock_icon->buffer);
 
+        ply_frame_governor_free (capslock_icon->poll_governor);
         free (capslock_icon->image_name);
         free (capslock_icon);
 }
@@ -113,13 +118,14 @@ on_timeout (void             *user_data,
         ply_capslock_icon_t *capslock_icon = user_data;
         bool old_is_on = capslock_icon->is_on;
 
+        ply_frame_governor_begin_frame (capslock_icon->poll_governor);
         ply_capslock_icon_update_state (capslock_icon);
 
         if (capslock_icon->is_on != old_is_on)
                 ply_capslock_icon_draw (capslock_icon);
 
         ply_event_loop_watch_for_timeout (capslock_icon->loop,
-                                          1.0 / FRAMES_PER_SECOND,
+                                          ply_frame_governor_end_frame (capslock_icon->poll_governor),
                                           on_timeout, capslock_icon);
 }
 
@@ -175,8 +181,10 @@ ply_capslock_icon_show (ply_capslock_icon_t *capslock_icon,
         capslock_icon->x = x;
         capslock_icon->y = y;
 
+        ply_capslock_icon_update_state (capslock_icon);
         ply_capslock_icon_draw (capslock_icon);
 
+        ply_frame_governor_reset (capslock_icon->poll_governor);
         ply_event_loop_watch_for_timeout (capslock_icon->loop,
                                           1.0 / FRAMES_PER_SECOND,
                                           on_timeout, capslock_icon);
@@ -207,12 +215,9 @@ ply_capslock_icon_draw_area (ply_capslock_icon_t *capslock_icon,
                              unsigned long        width,
                              unsigned long        height)
 {
-        if (capslock_icon->is_hidden)
-                return;
-
-        ply_capslock_icon_update_state (capslock_icon);
-
-        if (!capslock_icon->is_on)
+        /* The state is polled on the main thread, since this may be
+         * called from a render worker */
+        if (capslock_icon->is_hidden || !capslock_icon->is_on)
                 return;
 
         ply_pixel_buffer_fill_with_buffer (buffer,
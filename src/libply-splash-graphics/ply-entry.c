@@ -156,6 +156,23 @@ ply_entry_draw (ply_entry_t *entry)
                                      entry->area.height);
 }
 
+/* Draw handlers can run on several tiles at once, so the label is only
+ * changed here, on the main thread, and draw_area just draws it
+ */
+static void
+ply_entry_update_label (ply_entry_t *entry)
+{
+        if (entry->is_hidden || entry->is_password)
+                return;
+
+        ply_label_set_text (entry->label, entry->text);
+        ply_label_show (entry->label,
+                        NULL,
+                        entry->area.x,
+                        entry->area.y + entry->area.height / 2
+                        - ply_label_get_height (entry->label) / 2);
+}
+
 void
 ply_entry_draw_area (ply_entry_t        *entry,
                      ply_pixel_buffer_t *pixel_buffer,
@@ -213,12 +230,6 @@ ply_entry_draw_area (ply_entry_t        *entry,
                                                            bullet_area.y);
                 }
         } else {
-                ply_label_set_text (entry->label, entry->text);
-                ply_label_show (entry->label,
-                                NULL,
-                                entry->area.x,
-                                entry->area.y + entry->area.height / 2
-                                - ply_label_get_height (entry->label) / 2);
                 ply_label_draw_area (entry->label, pixel_buffer,
                                      entry->area.x, entry->area.y,
                                      entry->area.width, entry->area.height);
@@ -269,6 +280,7 @@ ply_entry_set_text (ply_entry_t *entry,
                 entry->is_password = false;
                 free (entry->text);
                 entry->text = strdup (text);
+                ply_entry_update_label (entry);
                 ply_entry_draw (entry);
         }
 }
@@ -302,6 +314,7 @@ ply_entry_show (ply_entry_t         *entry,
 
         entry->is_hidden = false;
 
+        ply_entry_update_label (entry);
         ply_entry_draw (entry);
 }
 
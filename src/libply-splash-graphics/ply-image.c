@@ -47,6 +47,7 @@
 
 #include <linux/fb.h>
 
+#include "ply-statistics.h"
 #include "ply-utils.h"
 
 struct _ply_image
@@ -306,6 +307,11 @@ ply_image_load (ply_image_t *image)
 
 out:
         fclose (fp);
+
+        if (ret)
+                ply_statistics_add (PLY_STATISTIC_DECODED_IMAGE_BYTES,
+                                    ply_image_get_width (image) * ply_image_get_height (image) * 4);
+
         return ret;
 }
 
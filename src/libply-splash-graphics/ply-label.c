@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +54,11 @@ struct _ply_label
         float                               green;
         float                               blue;
         float                               alpha;
+
+        /* Label plugins keep per-label font state, so tiles of one display
+         * can't draw the same label at the same time
+         */
+        pthread_mutex_t                     draw_mutex;
 };
 
 typedef const ply_label_plugin_interface_t *
@@ -72,6 +78,7 @@ ply_label_new (void)
         label->alpha = 1;
         label->alignment = PLY_LABEL_ALIGN_LEFT;
         label->width = -1;
+        pthread_mutex_init (&label->draw_mutex, NULL);
         return label;
 }
 
@@ -86,6 +93,7 @@ ply_label_free (ply_label_t *label)
                 ply_label_unload_plugin (label);
         }
 
+        pthread_mutex_destroy (&label->draw_mutex);
         free (label);
 }
 
@@ -201,9 +209,11 @@ ply_label_draw_area (ply_label_t        *label,
         if (label->plugin_interface == NULL)
                 return;
 
+        pthread_mutex_lock (&label->draw_mutex);
         label->plugin_interface->draw_control (label->control,
                                                buffer,
                                                x, y, width, height);
+        pthread_mutex_unlock (&label->draw_mutex);
 }
 
 void
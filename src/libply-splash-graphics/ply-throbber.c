@@ -42,8 +42,10 @@
 
 #include "ply-throbber.h"
 #include "ply-event-loop.h"
+#include "ply-frame-governor.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
+#include "ply-renderer.h"
 #include "ply-array.h"
 #include "ply-logger.h"
 #include "ply-image.h"
@@ -66,9 +68,11 @@ struct _ply_throbber
         char                *image_dir;
         char                *frames_prefix;
 
-        ply_pixel_display_t *display;
-        ply_rectangle_t      frame_area;
-        ply_trigger_t       *stop_trigger;
+        ply_pixel_display_t   *display;
+        ply_renderer_sprite_t *sprite;
+        ply_rectangle_t        frame_area;
+        ply_trigger_t         *stop_trigger;
+        ply_frame_governor_t  *frame_governor;
 
         long                 x, y;
         long                 width, height;
@@ -76,6 +80,7 @@ struct _ply_throbber
 
         int                  frame_number;
         uint32_t             is_stopped : 1;
+        uint32_t             is_showing_last_frame : 1;
 };
 
 static void ply_throbber_stop_now (ply_throbber_t *throbber,
@@ -103,6 +108,7 @@ ply_throbber_new (const char *image_dir,
         throbber->frame_area.x = 0;
         throbber->frame_area.y = 0;
         throbber->frame_number = 0;
+        throbber->frame_governor = ply_frame_governor_new ("throbber", FRAMES_PER_SECOND);
 
         return throbber;
 }
@@ -131,6 +137,7 @@ ply_throbber_free (ply_throbber_t *throbber)
 
         ply_throbber_remove_frames (throbber);
         ply_array_free (throbber->frames);
+        ply_frame_governor_free (throbber->frame_governor);
 
         free (throbber->frames_prefix);
         free (throbber->image_dir);
@@ -172,6 +179,13 @@ animate_at_time (ply_throbber_t *throbber,
         ply_pixel_buffer_get_size (frames[throbber->frame_number], &throbber->frame_area);
         throbber->frame_area.x = throbber->x;
         throbber->frame_area.y = throbber->y;
+
+        if (throbber->sprite != NULL) {
+                ply_pixel_display_draw_sprite (throbber->display, throbber->sprite,
+                                               frames[throbber->frame_number]);
+                return should_continue;
+        }
+
         ply_pixel_display_draw_area (throbber->display,
                                      throbber->x, throbber->y,
                                      throbber->frame_area.width,
@@ -186,17 +200,30 @@ on_timeout (ply_throbber_t *throbber)
         double sleep_time;
         bool should_continue;
 
+        ply_frame_governor_begin_frame (throbber->frame_governor);
         throbber->now = ply_get_timestamp ();
 
         should_continue = animate_at_time (throbber,
                                            throbber->now - throbber->start_time);
 
-        sleep_time = 1.0 / FRAMES_PER_SECOND;
-        sleep_time = MAX (sleep_time - (ply_get_timestamp () - throbber->now),
-                          0.005);
+        sleep_time = ply_frame_governor_end_frame (throbber->frame_governor);
 
         if (!should_continue) {
                 throbber->is_stopped = true;
+
+                /* The last frame stays up until the throbber is stopped
+                 * for good, so it has to be drawn beneath the sprite
+                 * before the sprite goes away */
+                throbber->is_showing_last_frame = true;
+                if (throbber->sprite != NULL) {
+                        ply_pixel_display_draw_area (throbber->display,
+                                                     throbber->x, throbber->y,
+                                                     throbber->frame_area.width,
+                                                     throbber->frame_area.height);
+                        ply_pixel_display_destroy_sprite (throbber->display, throbber->sprite);
+                        throbber->sprite = NULL;
+                }
+
                 if (throbber->stop_trigger != NULL) {
                         ply_trigger_pull (throbber->stop_trigger, NULL);
                         throbber->stop_trigger = NULL;
@@ -310,12 +337,18 @@ ply_throbber_start (ply_throbber_t      *throbber,
         throbber->loop = loop;
         throbber->display = display;
         throbber->is_stopped = false;
+        throbber->is_showing_last_frame = false;
 
         throbber->x = x;
         throbber->y = y;
 
         throbber->start_time = ply_get_timestamp ();
 
+        throbber->sprite = ply_pixel_display_create_sprite (display, x, y,
+                                                            throbber->width,
+                                                            throbber->height);
+        ply_frame_governor_reset (throbber->frame_governor);
+
         ply_event_loop_watch_for_timeout (throbber->loop,
                                           1.0 / FRAMES_PER_SECOND,
                                           (ply_event_loop_timeout_handler_t)
@@ -329,6 +362,10 @@ ply_throbber_stop_now (ply_throbber_t *throbber,
                        bool            redraw)
 {
         throbber->is_stopped = true;
+        throbber->is_showing_last_frame = false;
+
+        ply_pixel_display_destroy_sprite (throbber->display, throbber->sprite);
+        throbber->sprite = NULL;
 
         if (redraw) {
                 ply_pixel_display_draw_area (throbber->display,
@@ -384,7 +421,8 @@ ply_throbber_draw_area (ply_throbber_t     *throbber,
 {
         ply_pixel_buffer_t *const *frames;
 
-        if (throbber->is_stopped)
+        if (!throbber->is_showing_last_frame &&
+            (throbber->is_stopped || throbber->sprite != NULL))
                 return;
 
         frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (throbber->frames);
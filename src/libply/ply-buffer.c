@@ -51,6 +51,7 @@ struct _ply_buffer
         char  *data;
         size_t size;
         size_t capacity;
+        size_t max_size;
 };
 
 static bool
@@ -187,6 +188,21 @@ ply_buffer_append_bytes (ply_buffer_t *buffer,
         if (length == 0)
                 return;
 
+        if (buffer->max_size > 0) {
+                if (length > buffer->max_size) {
+                        bytes += length - buffer->max_size;
+                        length = buffer->max_size;
+                }
+
+                /* Drop a quarter at a time, so a full buffer isn't moved
+                 * on every append
+                 */
+                if (buffer->size + length > buffer->max_size)
+                        ply_buffer_remove_bytes (buffer,
+                                                 MAX (buffer->size + length - buffer->max_size,
+                                                      buffer->max_size / 4));
+        }
+
         if (length > PLY_BUFFER_MAX_BUFFER_CAPACITY) {
                 bytes += length - (PLY_BUFFER_MAX_BUFFER_CAPACITY - 1);
                 length = (PLY_BUFFER_MAX_BUFFER_CAPACITY - 1);
@@ -247,6 +263,18 @@ ply_buffer_steal_bytes (ply_buffer_t *buffer)
         return bytes;
 }
 
+void
+ply_buffer_set_max_size (ply_buffer_t *buffer,
+                         size_t        max_size)
+{
+        assert (buffer != NULL);
+
+        buffer->max_size = MIN (max_size, PLY_BUFFER_MAX_BUFFER_CAPACITY - 1);
+
+        if (buffer->max_size > 0 && buffer->size > buffer->max_size)
+                ply_buffer_remove_bytes (buffer, buffer->size - buffer->max_size);
+}
+
 size_t
 ply_buffer_get_size (ply_buffer_t *buffer)
 {
@@ -50,6 +50,8 @@ void ply_buffer_remove_bytes_at_end (ply_buffer_t *buffer,
                                      size_t        number_of_bytes);
 const char *ply_buffer_get_bytes (ply_buffer_t *buffer);
 char *ply_buffer_steal_bytes (ply_buffer_t *buffer);
+void ply_buffer_set_max_size (ply_buffer_t *buffer,
+                              size_t        max_size);
 size_t ply_buffer_get_size (ply_buffer_t *buffer);
 void ply_buffer_clear (ply_buffer_t *buffer);
 #endif
@@ -23,6 +23,7 @@
 #include "ply-event-loop.h"
 
 #include <assert.h>
+#include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -37,8 +38,11 @@
 #include <sys/termios.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
+#include "ply-hashtable.h"
 #include "ply-logger.h"
 #include "ply-list.h"
+#include "ply-statistics.h"
 #include "ply-utils.h"
 
 #ifndef PLY_EVENT_LOOP_NUM_EVENT_HANDLERS
@@ -49,6 +53,17 @@
 #define PLY_EVENT_LOOP_NO_TIMED_WAKEUP 0.0
 #endif
 
+/* Bucket n counts handler runs that took between 2^n and 2^(n+1)
+ * microseconds, the last bucket takes everything slower
+ */
+#ifndef PLY_EVENT_LOOP_NUM_PROFILE_BUCKETS
+#define PLY_EVENT_LOOP_NUM_PROFILE_BUCKETS 24
+#endif
+
+#ifndef PLY_EVENT_LOOP_SLOW_HANDLER_THRESHOLD
+#define PLY_EVENT_LOOP_SLOW_HANDLER_THRESHOLD 0.050
+#endif
+
 typedef struct
 {
         int         fd;
@@ -104,6 +119,15 @@ typedef struct
         void                            *user_data;
 } ply_event_loop_timeout_watch_t;
 
+typedef struct
+{
+        void    *handler;
+        uint32_t buckets[PLY_EVENT_LOOP_NUM_PROFILE_BUCKETS];
+        uint32_t number_of_runs;
+        double   total_time;
+        double   worst_time;
+} ply_event_loop_handler_profile_t;
+
 struct _ply_event_loop
 {
         int                      epoll_fd;
@@ -116,6 +140,8 @@ struct _ply_event_loop
 
         ply_signal_dispatcher_t *signal_dispatcher;
 
+        ply_hashtable_t         *handler_profiles;
+
         uint32_t                 should_exit : 1;
         uint32_t                 is_running : 1;
 };
@@ -574,6 +600,7 @@ ply_event_loop_free (ply_event_loop_t *loop)
 
         assert (!loop->is_running);
 
+        ply_event_loop_set_handler_profiling (loop, false);
         ply_signal_dispatcher_free (loop->signal_dispatcher);
         ply_event_loop_free_exit_closures (loop);
 
@@ -930,6 +957,14 @@ ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
         ply_list_append_data (loop->timeout_watches, timeout_watch);
 }
 
+int
+ply_event_loop_get_number_of_pending_timeouts (ply_event_loop_t *loop)
+{
+        assert (loop != NULL);
+
+        return ply_list_get_length (loop->timeout_watches);
+}
+
 void
 ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                           ply_event_loop_timeout_handler_t timeout_handler,
@@ -972,6 +1007,194 @@ ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                 ply_trace ("no matching timeout found for removal");
 }
 
+static void
+free_handler_profile (void *key,
+                      void *data,
+                      void *user_data)
+{
+        free (data);
+}
+
+void
+ply_event_loop_set_handler_profiling (ply_event_loop_t *loop,
+                                      bool              enabled)
+{
+        assert (loop != NULL);
+
+        if (enabled) {
+                if (loop->handler_profiles == NULL)
+                        loop->handler_profiles = ply_hashtable_new (ply_hashtable_direct_hash,
+                                                                    ply_hashtable_direct_compare);
+                return;
+        }
+
+        if (loop->handler_profiles == NULL)
+                return;
+
+        ply_hashtable_foreach (loop->handler_profiles, free_handler_profile, NULL);
+        ply_hashtable_free (loop->handler_profiles);
+        loop->handler_profiles = NULL;
+}
+
+/* Most handlers are static functions, so when there is no exported
+ * symbol fall back to object+offset, which addr2line can resolve
+ */
+static char *
+ply_event_loop_get_handler_name (void *handler)
+{
+        Dl_info info;
+        const char *object_name;
+        char *name;
+
+        if (dladdr (handler, &info) == 0) {
+                asprintf (&name, "%p", handler);
+                return name;
+        }
+
+        if (info.dli_sname != NULL && info.dli_saddr == handler)
+                return strdup (info.dli_sname);
+
+        object_name = info.dli_fname != NULL ? strrchr (info.dli_fname, '/') : NULL;
+        object_name = object_name != NULL ? object_name + 1 : info.dli_fname;
+
+        asprintf (&name, "%s+0x%lx",
+                  object_name != NULL ? object_name : "?",
+                  (unsigned long) ((char *) handler - (char *) info.dli_fbase));
+        return name;
+}
+
+static double
+ply_event_loop_start_handler_profile (ply_event_loop_t *loop)
+{
+        if (loop->handler_profiles == NULL)
+                return 0.0;
+
+        return ply_get_timestamp ();
+}
+
+static void
+ply_event_loop_finish_handler_profile (ply_event_loop_t *loop,
+                                       void             *handler,
+                                       double            start_time)
+{
+        ply_event_loop_handler_profile_t *profile;
+        double duration, microseconds;
+        int bucket;
+
+        /* the handler may have turned profiling on or off */
+        if (loop->handler_profiles == NULL || start_time <= 0.0)
+                return;
+
+        duration = ply_get_timestamp () - start_time;
+
+        profile = ply_hashtable_lookup (loop->handler_profiles, handler);
+        if (profile == NULL) {
+                profile = calloc (1, sizeof(ply_event_loop_handler_profile_t));
+                profile->handler = handler;
+                ply_hashtable_insert (loop->handler_profiles, handler, profile);
+        }
+
+        microseconds = duration * 1000000.0;
+        for (bucket = 0; bucket < PLY_EVENT_LOOP_NUM_PROFILE_BUCKETS - 1; bucket++) {
+                if (microseconds < 2.0)
+                        break;
+                microseconds /= 2.0;
+        }
+
+        profile->buckets[bucket]++;
+        profile->number_of_runs++;
+        profile->total_time += duration;
+        profile->worst_time = MAX (profile->worst_time, duration);
+
+        if (duration >= PLY_EVENT_LOOP_SLOW_HANDLER_THRESHOLD) {
+                char *name;
+
+                name = ply_event_loop_get_handler_name (handler);
+                ply_trace ("%s blocked the event loop for %.1fms", name, duration * 1000.0);
+                free (name);
+        }
+}
+
+static void
+add_handler_profile_to_list (void *key,
+                             void *data,
+                             void *user_data)
+{
+        ply_list_append_data ((ply_list_t *) user_data, data);
+}
+
+static int
+compare_handler_profiles (void *element_a,
+                          void *element_b)
+{
+        ply_event_loop_handler_profile_t *profile_a = element_a;
+        ply_event_loop_handler_profile_t *profile_b = element_b;
+
+        if (profile_a->worst_time > profile_b->worst_time)
+                return -1;
+        if (profile_a->worst_time < profile_b->worst_time)
+                return 1;
+        return 0;
+}
+
+char *
+ply_event_loop_get_handler_profile_report (ply_event_loop_t *loop,
+                                           int               max_handlers)
+{
+        ply_list_t *profiles;
+        ply_list_node_t *node;
+        ply_buffer_t *buffer;
+        char *report;
+        int i;
+
+        assert (loop != NULL);
+
+        if (loop->handler_profiles == NULL)
+                return NULL;
+
+        profiles = ply_list_new ();
+        ply_hashtable_foreach (loop->handler_profiles, add_handler_profile_to_list, profiles);
+        ply_list_sort (profiles, compare_handler_profiles);
+
+        buffer = ply_buffer_new ();
+
+        i = 0;
+        node = ply_list_get_first_node (profiles);
+        while (node != NULL && (max_handlers <= 0 || i < max_handlers)) {
+                ply_event_loop_handler_profile_t *profile;
+                char *name;
+                int bucket;
+
+                profile = ply_list_node_get_data (node);
+                name = ply_event_loop_get_handler_name (profile->handler);
+
+                ply_buffer_append (buffer, "%s runs %u total %.3fms worst %.3fms usecs",
+                                   name, profile->number_of_runs,
+                                   profile->total_time * 1000.0,
+                                   profile->worst_time * 1000.0);
+                free (name);
+
+                for (bucket = 0; bucket < PLY_EVENT_LOOP_NUM_PROFILE_BUCKETS; bucket++) {
+                        if (profile->buckets[bucket] == 0)
+                                continue;
+
+                        ply_buffer_append (buffer, " %lu:%u",
+                                           bucket == 0 ? 0 : 1UL << bucket,
+                                           profile->buckets[bucket]);
+                }
+                ply_buffer_append (buffer, "\n");
+
+                i++;
+                node = ply_list_get_next_node (profiles, node);
+        }
+        ply_list_free (profiles);
+
+        report = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return report;
+}
+
 static ply_event_loop_fd_status_t
 ply_event_loop_get_fd_status_from_poll_mask (uint32_t mask)
 {
@@ -1037,8 +1260,17 @@ ply_event_loop_handle_met_status_for_source (ply_event_loop_t          *loop,
                 next_node = ply_list_get_next_node (source->destinations, node);
 
                 if (((destination->status & status) != 0)
-                    && (destination->status_met_handler != NULL))
-                        destination->status_met_handler (destination->user_data, source->fd);
+                    && (destination->status_met_handler != NULL)) {
+                        ply_event_handler_t handler;
+                        double start_time;
+
+                        /* the handler may stop watching and free the destination */
+                        handler = destination->status_met_handler;
+
+                        start_time = ply_event_loop_start_handler_profile (loop);
+                        handler (destination->user_data, source->fd);
+                        ply_event_loop_finish_handler_profile (loop, (void *) handler, start_time);
+                }
 
                 node = next_node;
         }
@@ -1062,8 +1294,17 @@ ply_event_loop_handle_disconnect_for_source (ply_event_loop_t   *loop,
                 destination = (ply_event_destination_t *) ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (source->destinations, node);
 
-                if (destination->disconnected_handler != NULL)
-                        destination->disconnected_handler (destination->user_data, source->fd);
+                if (destination->disconnected_handler != NULL) {
+                        ply_event_handler_t handler;
+                        double start_time;
+
+                        /* the handler may stop watching and free the destination */
+                        handler = destination->disconnected_handler;
+
+                        start_time = ply_event_loop_start_handler_profile (loop);
+                        handler (destination->user_data, source->fd);
+                        ply_event_loop_finish_handler_profile (loop, (void *) handler, start_time);
+                }
 
                 node = next_node;
         }
@@ -1186,11 +1427,15 @@ ply_event_loop_handle_timeouts (ply_event_loop_t *loop)
                 next_node = ply_list_get_next_node (loop->timeout_watches, node);
 
                 if (watch->timeout <= now) {
+                        double start_time;
+
                         assert (watch->handler != NULL);
 
                         ply_list_remove_node (loop->timeout_watches, node);
 
+                        start_time = ply_event_loop_start_handler_profile (loop);
                         watch->handler (watch->user_data, loop);
+                        ply_event_loop_finish_handler_profile (loop, (void *) watch->handler, start_time);
                         free (watch);
 
                         /* start over in case the handler invalidated the list
@@ -1231,6 +1476,7 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
                 number_of_received_events = epoll_wait (loop->epoll_fd, events,
                                                         PLY_EVENT_LOOP_NUM_EVENT_HANDLERS,
                                                         timeout);
+                ply_statistics_add (PLY_STATISTIC_EVENT_LOOP_WAKEUPS, 1);
                 if (number_of_received_events < 0) {
                         if (errno != EINTR && errno != EAGAIN) {
                                 ply_event_loop_exit (loop, 255);
@@ -79,6 +79,12 @@ void ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
 void ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                                ply_event_loop_timeout_handler_t timeout_handler,
                                                void                            *user_data);
+int ply_event_loop_get_number_of_pending_timeouts (ply_event_loop_t *loop);
+
+void ply_event_loop_set_handler_profiling (ply_event_loop_t *loop,
+                                           bool              enabled);
+char *ply_event_loop_get_handler_profile_report (ply_event_loop_t *loop,
+                                                 int               max_handlers);
 
 int ply_event_loop_run (ply_event_loop_t *loop);
 void ply_event_loop_exit (ply_event_loop_t *loop,
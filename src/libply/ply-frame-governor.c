@@ -0,0 +1,224 @@
+/* ply-frame-governor.c - Picks animation tick rates that fit the CPU budget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-frame-governor.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+/* Never tick slower than this, however busy the machine is */
+#ifndef PLY_FRAME_GOVERNOR_MAX_INTERVAL
+#define PLY_FRAME_GOVERNOR_MAX_INTERVAL 0.2
+#endif
+
+#ifndef PLY_FRAME_GOVERNOR_MIN_DELAY
+#define PLY_FRAME_GOVERNOR_MIN_DELAY 0.005
+#endif
+
+/* Fractions of the tick interval. Work is the time spent in the tick,
+ * lateness is how long after its deadline the tick got to run, which
+ * grows when other processes are keeping the CPU busy.
+ */
+#define BUSY_WORK_LOAD   0.25
+#define BUSY_LATENESS    0.5
+#define CALM_WORK_LOAD   0.1
+#define CALM_LATENESS    0.1
+
+/* Number of calm ticks in a row before speeding back up */
+#define CALM_TICKS_BEFORE_SPEEDUP 30
+
+/* How much longer the shortest interval is in the background */
+#define BACKGROUND_INTERVAL_SCALE 2.0
+
+struct _ply_frame_governor
+{
+        char  *name;
+
+        double minimum_interval;
+        double interval;
+
+        double due_time;
+        double frame_start_time;
+
+        double work_load;
+        double lateness;
+
+        int    number_of_calm_ticks;
+};
+
+static bool governors_are_in_background;
+
+ply_frame_governor_t *
+ply_frame_governor_new (const char *name,
+                        double      frames_per_second)
+{
+        ply_frame_governor_t *governor;
+
+        governor = calloc (1, sizeof(ply_frame_governor_t));
+        governor->name = strdup (name);
+        ply_frame_governor_set_frames_per_second (governor, frames_per_second);
+
+        return governor;
+}
+
+void
+ply_frame_governor_free (ply_frame_governor_t *governor)
+{
+        if (governor == NULL)
+                return;
+
+        free (governor->name);
+        free (governor);
+}
+
+void
+ply_frame_governor_set_frames_per_second (ply_frame_governor_t *governor,
+                                          double                frames_per_second)
+{
+        assert (governor != NULL);
+        assert (frames_per_second > 0.0);
+
+        governor->minimum_interval = MIN (1.0 / frames_per_second,
+                                          PLY_FRAME_GOVERNOR_MAX_INTERVAL);
+        governor->interval = governor->minimum_interval;
+        governor->work_load = 0.0;
+        governor->lateness = 0.0;
+        governor->number_of_calm_ticks = 0;
+}
+
+void
+ply_frame_governor_set_background (bool is_in_background)
+{
+        governors_are_in_background = is_in_background;
+}
+
+static double
+ply_frame_governor_get_minimum_interval (ply_frame_governor_t *governor)
+{
+        if (!governors_are_in_background)
+                return governor->minimum_interval;
+
+        return MIN (governor->minimum_interval * BACKGROUND_INTERVAL_SCALE,
+                    PLY_FRAME_GOVERNOR_MAX_INTERVAL);
+}
+
+double
+ply_frame_governor_get_frames_per_second (ply_frame_governor_t *governor)
+{
+        assert (governor != NULL);
+
+        return 1.0 / governor->interval;
+}
+
+void
+ply_frame_governor_reset (ply_frame_governor_t *governor)
+{
+        assert (governor != NULL);
+
+        governor->due_time = 0.0;
+        governor->frame_start_time = 0.0;
+        governor->number_of_calm_ticks = 0;
+}
+
+void
+ply_frame_governor_begin_frame (ply_frame_governor_t *governor)
+{
+        double now;
+
+        assert (governor != NULL);
+
+        now = ply_get_timestamp ();
+
+        if (governor->due_time > 0.0) {
+                double lateness;
+
+                lateness = MAX (now - governor->due_time, 0.0) / governor->interval;
+                governor->lateness = 0.9 * governor->lateness + 0.1 * lateness;
+        }
+
+        governor->frame_start_time = now;
+}
+
+static void
+ply_frame_governor_change_interval (ply_frame_governor_t *governor,
+                                    double                interval)
+{
+        double scale;
+
+        scale = governor->interval / interval;
+        governor->interval = interval;
+
+        /* keep the averages relative to the new interval */
+        governor->work_load *= scale;
+        governor->lateness *= scale;
+        governor->number_of_calm_ticks = 0;
+
+        ply_trace ("%s now ticking at %.1f frames per second",
+                   governor->name, 1.0 / interval);
+}
+
+/* Returns how long to wait before the next tick */
+double
+ply_frame_governor_end_frame (ply_frame_governor_t *governor)
+{
+        double now, work_time, delay, minimum_interval;
+
+        assert (governor != NULL);
+
+        now = ply_get_timestamp ();
+
+        if (governor->frame_start_time <= 0.0)
+                governor->frame_start_time = now;
+
+        work_time = now - governor->frame_start_time;
+        governor->work_load = 0.9 * governor->work_load +
+                              0.1 * (work_time / governor->interval);
+
+        minimum_interval = ply_frame_governor_get_minimum_interval (governor);
+
+        if (governor->interval < minimum_interval) {
+                ply_frame_governor_change_interval (governor, minimum_interval);
+        } else if (governor->work_load > BUSY_WORK_LOAD ||
+                   governor->lateness > BUSY_LATENESS) {
+                if (governor->interval < PLY_FRAME_GOVERNOR_MAX_INTERVAL)
+                        ply_frame_governor_change_interval (governor,
+                                                            MIN (governor->interval * 2,
+                                                                 PLY_FRAME_GOVERNOR_MAX_INTERVAL));
+        } else if (governor->work_load < CALM_WORK_LOAD &&
+                   governor->lateness < CALM_LATENESS) {
+                governor->number_of_calm_ticks++;
+
+                if (governor->number_of_calm_ticks >= CALM_TICKS_BEFORE_SPEEDUP &&
+                    governor->interval > minimum_interval)
+                        ply_frame_governor_change_interval (governor,
+                                                            MAX (governor->interval / 2,
+                                                                 minimum_interval));
+        } else {
+                governor->number_of_calm_ticks = 0;
+        }
+
+        delay = MAX (governor->interval - work_time, PLY_FRAME_GOVERNOR_MIN_DELAY);
+        governor->due_time = now + delay;
+        governor->frame_start_time = 0.0;
+
+        return delay;
+}
@@ -0,0 +1,42 @@
+/* ply-frame-governor.h - Picks animation tick rates that fit the CPU budget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_FRAME_GOVERNOR_H
+#define PLY_FRAME_GOVERNOR_H
+
+#include <stdbool.h>
+
+typedef struct _ply_frame_governor ply_frame_governor_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_frame_governor_t *ply_frame_governor_new (const char *name,
+                                              double      frames_per_second);
+void ply_frame_governor_free (ply_frame_governor_t *governor);
+void ply_frame_governor_set_frames_per_second (ply_frame_governor_t *governor,
+                                               double                frames_per_second);
+double ply_frame_governor_get_frames_per_second (ply_frame_governor_t *governor);
+void ply_frame_governor_begin_frame (ply_frame_governor_t *governor);
+double ply_frame_governor_end_frame (ply_frame_governor_t *governor);
+void ply_frame_governor_reset (ply_frame_governor_t *governor);
+
+/* Background governors tick at most half as often as they were asked to,
+ * so animations leave more of the event loop and CPU to everything else.
+ */
+void ply_frame_governor_set_background (bool is_in_background);
+#endif
+
+#endif /* PLY_FRAME_GOVERNOR_H */
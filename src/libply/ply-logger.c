@@ -26,6 +26,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,11 +37,13 @@
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "ply-utils.h"
 #include "ply-list.h"
+#include "ply-statistics.h"
 
 #ifndef PLY_LOGGER_OPEN_FLAGS
 #define PLY_LOGGER_OPEN_FLAGS (O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC)
@@ -48,8 +53,22 @@
 #define PLY_LOGGER_MAX_INJECTION_SIZE 4096
 #endif
 
-#ifndef PLY_LOGGER_MAX_BUFFER_CAPACITY
-#define PLY_LOGGER_MAX_BUFFER_CAPACITY (8 * 4096)
+/* Must be a power of two */
+#ifndef PLY_LOGGER_BUFFER_CAPACITY
+#define PLY_LOGGER_BUFFER_CAPACITY (8 * 4096)
+#endif
+
+#ifndef PLY_LOGGER_BACKGROUND_FLUSH_THRESHOLD
+#define PLY_LOGGER_BACKGROUND_FLUSH_THRESHOLD (PLY_LOGGER_BUFFER_CAPACITY / 4)
+#endif
+
+#ifndef PLY_LOGGER_BACKGROUND_FLUSH_INTERVAL_IN_MILLISECONDS
+#define PLY_LOGGER_BACKGROUND_FLUSH_INTERVAL_IN_MILLISECONDS 250
+#endif
+
+/* How long to wait for a full non-blocking fd before giving up */
+#ifndef PLY_LOGGER_WRITE_TIMEOUT_IN_MILLISECONDS
+#define PLY_LOGGER_WRITE_TIMEOUT_IN_MILLISECONDS 100
 #endif
 
 typedef struct
@@ -64,17 +83,36 @@ struct _ply_logger
         bool                      output_fd_is_terminal;
         char                     *filename;
 
+        /* A ring buffer.  head and tail only ever grow, and are masked
+         * with the capacity to find positions in the buffer.
+         */
         char                     *buffer;
-        size_t                    buffer_size;
-        size_t                    buffer_capacity;
+        size_t                    buffer_head;
+        size_t                    buffer_tail;
+        size_t                    number_of_dropped_bytes;
+
+        pthread_mutex_t           buffer_mutex;
+        pthread_cond_t            writer_wakeup;
+        pthread_cond_t            writer_finished;
+        pthread_t                 writer_thread;
 
         ply_logger_flush_policy_t flush_policy;
         ply_list_t               *filters;
 
         uint32_t                  is_enabled : 1;
         uint32_t                  tracing_is_enabled : 1;
+        uint32_t                  writer_is_running : 1;
+        uint32_t                  writer_is_writing : 1;
+        uint32_t                  writer_should_exit : 1;
 };
 
+/* Renderer plugins may trace from the worker threads of a parallel
+ * frame, so injections are serialized.  It's recursive because
+ * injecting can report its own failures.
+ */
+static pthread_mutex_t injection_mutex;
+static pthread_once_t injection_mutex_once = PTHREAD_ONCE_INIT;
+
 static bool ply_text_is_loggable (const char *string,
                                   ssize_t     length);
 static void ply_logger_write_exception (ply_logger_t *logger,
@@ -87,8 +125,22 @@ static bool ply_logger_write (ply_logger_t *logger,
 static bool ply_logger_buffer (ply_logger_t *logger,
                                const char   *string,
                                size_t        length);
+static bool ply_logger_append_to_buffer (ply_logger_t *logger,
+                                         const char   *string,
+                                         size_t        length);
 static bool ply_logger_flush_buffer (ply_logger_t *logger);
 
+static void
+ply_logger_init_injection_mutex (void)
+{
+        pthread_mutexattr_t attributes;
+
+        pthread_mutexattr_init (&attributes);
+        pthread_mutexattr_settype (&attributes, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init (&injection_mutex, &attributes);
+        pthread_mutexattr_destroy (&attributes);
+}
+
 static bool
 ply_text_is_loggable (const char *string,
                       ssize_t     length)
@@ -144,84 +196,298 @@ ply_logger_write (ply_logger_t *logger,
                 return false;
         }
 
+        ply_statistics_add (PLY_STATISTIC_BYTES_LOGGED, length);
+
         return true;
 }
 
 static bool
-ply_logger_flush_buffer (ply_logger_t *logger)
+ply_logger_wait_for_fd_to_take_data (int fd)
 {
-        assert (logger != NULL);
+        struct pollfd poll_fd = { .fd = fd, .events = POLLOUT };
+        int result;
 
-        if (logger->buffer_size == 0)
-                return true;
+        do {
+                result = poll (&poll_fd, 1, PLY_LOGGER_WRITE_TIMEOUT_IN_MILLISECONDS);
+        } while (result < 0 && errno == EINTR);
 
-        if (!ply_logger_write (logger, logger->buffer, logger->buffer_size, true))
-                return false;
+        if (result == 0)
+                errno = EAGAIN;
+
+        return result > 0 && (poll_fd.revents & POLLOUT);
+}
+
+/* Advances start past what was written, so on failure the rest can stay
+ * in the buffer
+ */
+static bool
+ply_logger_write_buffer_range (ply_logger_t *logger,
+                               int           fd,
+                               size_t       *start,
+                               size_t        end)
+{
+        while (*start < end) {
+                struct iovec iov[2];
+                size_t offset, size;
+                int number_of_vectors = 1;
+                ssize_t bytes_written;
+
+                offset = *start & (PLY_LOGGER_BUFFER_CAPACITY - 1);
+                size = end - *start;
+
+                iov[0].iov_base = logger->buffer + offset;
+                iov[0].iov_len = MIN (size, PLY_LOGGER_BUFFER_CAPACITY - offset);
+
+                if (iov[0].iov_len < size) {
+                        iov[1].iov_base = logger->buffer;
+                        iov[1].iov_len = size - iov[0].iov_len;
+                        number_of_vectors = 2;
+                }
+
+                bytes_written = writev (fd, iov, number_of_vectors);
 
-        memset (logger->buffer, '\0', logger->buffer_size);
-        logger->buffer_size = 0;
+                if (bytes_written < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        if (errno == EAGAIN && ply_logger_wait_for_fd_to_take_data (fd))
+                                continue;
+
+                        return false;
+                }
+
+                ply_statistics_add (PLY_STATISTIC_BYTES_LOGGED, bytes_written);
+                *start += bytes_written;
+        }
 
         return true;
 }
 
+/* Called with the buffer mutex held */
+static void
+ply_logger_wait_for_writer (ply_logger_t *logger)
+{
+        while (logger->writer_is_writing) {
+                pthread_cond_wait (&logger->writer_finished, &logger->buffer_mutex);
+        }
+}
+
+/* Called with the buffer mutex held */
+static void
+ply_logger_note_dropped_bytes (ply_logger_t *logger)
+{
+        char message[80];
+        size_t number_of_dropped_bytes;
+
+        number_of_dropped_bytes = logger->number_of_dropped_bytes;
+        logger->number_of_dropped_bytes = 0;
+
+        snprintf (message, sizeof(message),
+                  "[%zu bytes of log output dropped]\n", number_of_dropped_bytes);
+        ply_logger_append_to_buffer (logger, message, strlen (message));
+}
+
 static bool
-ply_logger_increase_buffer_size (ply_logger_t *logger)
+ply_logger_flush_buffer (ply_logger_t *logger)
 {
+        bool was_written;
+
         assert (logger != NULL);
 
-        if ((logger->buffer_capacity * 2) > PLY_LOGGER_MAX_BUFFER_CAPACITY)
-                return false;
+        pthread_mutex_lock (&logger->buffer_mutex);
+        ply_logger_wait_for_writer (logger);
 
-        logger->buffer_capacity *= 2;
+        if (logger->number_of_dropped_bytes > 0)
+                ply_logger_note_dropped_bytes (logger);
 
-        logger->buffer = realloc (logger->buffer, logger->buffer_capacity);
-        return true;
+        if (logger->buffer_head == logger->buffer_tail) {
+                pthread_mutex_unlock (&logger->buffer_mutex);
+                return true;
+        }
+
+        was_written = ply_logger_write_buffer_range (logger, logger->output_fd,
+                                                     &logger->buffer_tail,
+                                                     logger->buffer_head);
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
+        if (!was_written)
+                ply_logger_write_exception (logger, strerror (errno));
+
+        return was_written;
 }
 
+static void *
+ply_logger_run_writer (ply_logger_t *logger)
+{
+        pthread_mutex_lock (&logger->buffer_mutex);
+        while (!logger->writer_should_exit) {
+                size_t start, written_end, end;
+                int fd;
+
+                /* With nowhere to write, the buffer just keeps the newest
+                 * output until an fd gets set
+                 */
+                if (logger->output_fd < 0 || logger->buffer_head == logger->buffer_tail) {
+                        pthread_cond_wait (&logger->writer_wakeup, &logger->buffer_mutex);
+                        continue;
+                }
+
+                if (logger->buffer_head - logger->buffer_tail < PLY_LOGGER_BACKGROUND_FLUSH_THRESHOLD) {
+                        struct timespec timeout;
+
+                        clock_gettime (CLOCK_MONOTONIC, &timeout);
+                        timeout.tv_nsec += PLY_LOGGER_BACKGROUND_FLUSH_INTERVAL_IN_MILLISECONDS * 1000000L;
+                        timeout.tv_sec += timeout.tv_nsec / 1000000000L;
+                        timeout.tv_nsec %= 1000000000L;
+
+                        pthread_cond_timedwait (&logger->writer_wakeup, &logger->buffer_mutex, &timeout);
+
+                        if (logger->writer_should_exit)
+                                break;
+                }
+
+                if (logger->number_of_dropped_bytes > 0)
+                        ply_logger_note_dropped_bytes (logger);
+
+                fd = logger->output_fd;
+                start = logger->buffer_tail;
+                end = logger->buffer_head;
+
+                if (fd < 0 || start == end)
+                        continue;
+
+                /* Injections keep going while the batch is written, they just
+                 * can't overwrite it
+                 */
+                logger->writer_is_writing = true;
+                pthread_mutex_unlock (&logger->buffer_mutex);
+
+                written_end = start;
+                ply_logger_write_buffer_range (logger, fd, &written_end, end);
+
+                pthread_mutex_lock (&logger->buffer_mutex);
+                logger->writer_is_writing = false;
+                if (logger->buffer_tail == start)
+                        logger->buffer_tail = written_end;
+                pthread_cond_broadcast (&logger->writer_finished);
+        }
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
+        return NULL;
+}
+
+/* Called with the buffer mutex held */
 static void
-ply_logger_decapitate_buffer (ply_logger_t *logger,
-                              size_t        bytes_in_head)
+ply_logger_start_writer (ply_logger_t *logger)
 {
-        assert (logger != NULL);
+        sigset_t all_signals, old_signals;
 
-        bytes_in_head = MIN (logger->buffer_size, bytes_in_head);
+        /* Signals are handled by the event loop on the main thread */
+        sigfillset (&all_signals);
+        pthread_sigmask (SIG_SETMASK, &all_signals, &old_signals);
 
-        if (bytes_in_head == logger->buffer_size) {
-                logger->buffer_size = 0;
+        if (pthread_create (&logger->writer_thread, NULL,
+                            (void *(*)(void *)) ply_logger_run_writer, logger) == 0) {
+                logger->writer_is_running = true;
         } else {
-                memmove (logger->buffer, logger->buffer + bytes_in_head,
-                         logger->buffer_size - bytes_in_head);
-                logger->buffer_size -= bytes_in_head;
+                /* Fall back to writing when asked */
+                logger->flush_policy = PLY_LOGGER_FLUSH_POLICY_WHEN_ASKED;
         }
+
+        pthread_sigmask (SIG_SETMASK, &old_signals, NULL);
 }
 
+static void
+ply_logger_stop_writer (ply_logger_t *logger)
+{
+        if (!logger->writer_is_running)
+                return;
+
+        pthread_mutex_lock (&logger->buffer_mutex);
+        logger->writer_should_exit = true;
+        pthread_cond_signal (&logger->writer_wakeup);
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
+        pthread_join (logger->writer_thread, NULL);
+        logger->writer_is_running = false;
+        logger->writer_should_exit = false;
+}
+
+/* Called with the buffer mutex held */
 static bool
-ply_logger_buffer (ply_logger_t *logger,
-                   const char   *string,
-                   size_t        length)
+ply_logger_append_to_buffer (ply_logger_t *logger,
+                             const char   *string,
+                             size_t        length)
 {
-        assert (logger != NULL);
+        size_t space_available, offset, size_to_end;
+        bool was_empty;
 
-        if ((logger->buffer_size + length) >= logger->buffer_capacity) {
-                if (!ply_logger_increase_buffer_size (logger)) {
-                        ply_logger_decapitate_buffer (logger, length);
+        /* Only the end of an oversized chunk can fit */
+        if (length > PLY_LOGGER_BUFFER_CAPACITY) {
+                string += length - PLY_LOGGER_BUFFER_CAPACITY;
+                length = PLY_LOGGER_BUFFER_CAPACITY;
+        }
+
+        space_available = PLY_LOGGER_BUFFER_CAPACITY - (logger->buffer_head - logger->buffer_tail);
 
-                        if ((logger->buffer_size + length) >= logger->buffer_capacity)
-                                if (!ply_logger_increase_buffer_size (logger))
-                                        return false;
+        if (space_available < length) {
+                if (logger->writer_is_writing) {
+                        /* The oldest bytes are being written out, so the new
+                         * ones have to go
+                         */
+                        logger->number_of_dropped_bytes += length;
+                        return false;
                 }
+
+                logger->buffer_tail += length - space_available;
         }
 
-        assert (logger->buffer_size + length < logger->buffer_capacity);
+        was_empty = logger->buffer_head == logger->buffer_tail;
+        offset = logger->buffer_head & (PLY_LOGGER_BUFFER_CAPACITY - 1);
+        size_to_end = MIN (length, PLY_LOGGER_BUFFER_CAPACITY - offset);
 
-        memcpy (logger->buffer + logger->buffer_size,
-                string, length);
+        memcpy (logger->buffer + offset, string, size_to_end);
+        memcpy (logger->buffer, string + size_to_end, length - size_to_end);
+        logger->buffer_head += length;
 
-        logger->buffer_size += length;
+        if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND) {
+                if (!logger->writer_is_running)
+                        ply_logger_start_writer (logger);
+                else if (was_empty ||
+                         logger->buffer_head - logger->buffer_tail >= PLY_LOGGER_BACKGROUND_FLUSH_THRESHOLD)
+                        pthread_cond_signal (&logger->writer_wakeup);
+        }
 
         return true;
 }
 
+static bool
+ply_logger_buffer (ply_logger_t *logger,
+                   const char   *string,
+                   size_t        length)
+{
+        bool was_buffered;
+
+        assert (logger != NULL);
+
+        pthread_mutex_lock (&logger->buffer_mutex);
+        was_buffered = ply_logger_append_to_buffer (logger, string, length);
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
+        return was_buffered;
+}
+
+static void
+ply_logger_init_writer_wakeup (pthread_cond_t *condition)
+{
+        pthread_condattr_t attributes;
+
+        pthread_condattr_init (&attributes);
+        pthread_condattr_setclock (&attributes, CLOCK_MONOTONIC);
+        pthread_cond_init (condition, &attributes);
+        pthread_condattr_destroy (&attributes);
+}
+
 ply_logger_t *
 ply_logger_new (void)
 {
@@ -235,9 +501,13 @@ ply_logger_new (void)
         logger->is_enabled = true;
         logger->tracing_is_enabled = false;
 
-        logger->buffer_capacity = 4096;
-        logger->buffer = calloc (1, logger->buffer_capacity);
-        logger->buffer_size = 0;
+        logger->buffer = calloc (1, PLY_LOGGER_BUFFER_CAPACITY);
+        logger->buffer_head = 0;
+        logger->buffer_tail = 0;
+
+        pthread_mutex_init (&logger->buffer_mutex, NULL);
+        pthread_cond_init (&logger->writer_finished, NULL);
+        ply_logger_init_writer_wakeup (&logger->writer_wakeup);
 
         logger->filters = ply_list_new ();
 
@@ -298,14 +568,21 @@ ply_logger_free (ply_logger_t *logger)
         if (logger == NULL)
                 return;
 
+        ply_logger_stop_writer (logger);
+
         if (logger->output_fd >= 0) {
-                if (ply_logger_is_logging (logger))
-                        ply_logger_flush (logger);
+                if (ply_logger_is_logging (logger) ||
+                    logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND)
+                        ply_logger_flush_buffer (logger);
                 close (logger->output_fd);
         }
 
         ply_logger_free_filters (logger);
 
+        pthread_cond_destroy (&logger->writer_wakeup);
+        pthread_cond_destroy (&logger->writer_finished);
+        pthread_mutex_destroy (&logger->buffer_mutex);
+
         free (logger->filename);
         free (logger->buffer);
         free (logger);
@@ -349,13 +626,28 @@ ply_logger_open_file (ply_logger_t *logger,
 void
 ply_logger_close_file (ply_logger_t *logger)
 {
+        int fd;
+
         assert (logger != NULL);
 
         if (logger->output_fd < 0)
                 return;
 
-        close (logger->output_fd);
-        ply_logger_set_output_fd (logger, -1);
+        /* Whatever the writer hasn't gotten to yet still belongs in the file */
+        if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND)
+                ply_logger_flush_buffer (logger);
+
+        /* The writer mustn't get the fd once it's closed, or after its
+         * number was reused
+         */
+        pthread_mutex_lock (&logger->buffer_mutex);
+        ply_logger_wait_for_writer (logger);
+        fd = logger->output_fd;
+        logger->output_fd = -1;
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
+        logger->output_fd_is_terminal = false;
+        close (fd);
 }
 
 void
@@ -364,7 +656,13 @@ ply_logger_set_output_fd (ply_logger_t *logger,
 {
         assert (logger != NULL);
 
+        pthread_mutex_lock (&logger->buffer_mutex);
+        ply_logger_wait_for_writer (logger);
         logger->output_fd = fd;
+        if (logger->writer_is_running)
+                pthread_cond_signal (&logger->writer_wakeup);
+        pthread_mutex_unlock (&logger->buffer_mutex);
+
         logger->output_fd_is_terminal = isatty (fd);
 }
 
@@ -387,6 +685,14 @@ ply_logger_flush (ply_logger_t *logger)
         if (logger->output_fd < 0)
                 return false;
 
+        if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND) {
+                pthread_mutex_lock (&logger->buffer_mutex);
+                if (logger->writer_is_running)
+                        pthread_cond_signal (&logger->writer_wakeup);
+                pthread_mutex_unlock (&logger->buffer_mutex);
+                return true;
+        }
+
         if (!ply_logger_flush_buffer (logger))
                 return false;
 
@@ -405,6 +711,10 @@ ply_logger_set_flush_policy (ply_logger_t             *logger,
 {
         assert (logger != NULL);
 
+        if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND &&
+            policy != PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND)
+                ply_logger_stop_writer (logger);
+
         logger->flush_policy = policy;
 }
 
@@ -505,6 +815,9 @@ ply_logger_inject_bytes (ply_logger_t *logger,
         assert (bytes != NULL);
         assert (number_of_bytes != 0);
 
+        pthread_once (&injection_mutex_once, ply_logger_init_injection_mutex);
+        pthread_mutex_lock (&injection_mutex);
+
         filtered_bytes = NULL;
         filtered_size = 0;
         node = ply_list_get_first_node (logger->filters);
@@ -546,10 +859,13 @@ ply_logger_inject_bytes (ply_logger_t *logger,
         }
 
         assert ((logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_WHEN_ASKED)
-                || (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME));
+                || (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME)
+                || (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND));
 
         if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME)
                 ply_logger_flush (logger);
+
+        pthread_mutex_unlock (&injection_mutex);
 }
 
 void
@@ -34,7 +34,8 @@ typedef struct _ply_logger ply_logger_t;
 typedef enum
 {
         PLY_LOGGER_FLUSH_POLICY_WHEN_ASKED = 0,
-        PLY_LOGGER_FLUSH_POLICY_EVERY_TIME
+        PLY_LOGGER_FLUSH_POLICY_EVERY_TIME,
+        PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND /* batched writes from a writer thread */
 } ply_logger_flush_policy_t;
 
 typedef void (*ply_logger_filter_handler_t) (void         *user_data,
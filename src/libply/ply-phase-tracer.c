@@ -0,0 +1,101 @@
+/* ply-phase-tracer.c - Records when startup milestones are reached
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-phase-tracer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "ply-buffer.h"
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+static const char *phase_names[PLY_NUMBER_OF_PHASES] =
+{
+        [PLY_PHASE_DAEMON_STARTED]    = "daemon-started",
+        [PLY_PHASE_SETTINGS_LOADED]   = "settings-loaded",
+        [PLY_PHASE_DEVICES_WATCHED]   = "devices-watched",
+        [PLY_PHASE_RENDERER_OPENED]   = "renderer-opened",
+        [PLY_PHASE_SPLASH_LOADED]     = "splash-loaded",
+        [PLY_PHASE_SPLASH_SHOWN]      = "splash-shown",
+        [PLY_PHASE_FIRST_FRAME]       = "first-frame",
+        [PLY_PHASE_FIRST_TEXT_FRAME]  = "first-text-frame",
+        [PLY_PHASE_FIRST_INPUT_READY] = "first-input-ready",
+};
+
+/* Monotonic timestamps, 0.0 for phases that weren't reached yet */
+static double phase_timestamps[PLY_NUMBER_OF_PHASES];
+
+void
+ply_phase_tracer_mark (ply_phase_t phase)
+{
+        assert (phase < PLY_NUMBER_OF_PHASES);
+
+        if (phase_timestamps[phase] != 0.0)
+                return;
+
+        phase_timestamps[phase] = ply_get_timestamp ();
+
+        ply_trace ("reached startup phase %s after %.3fs",
+                   phase_names[phase], ply_phase_tracer_get_time (phase));
+}
+
+double
+ply_phase_tracer_get_time (ply_phase_t phase)
+{
+        assert (phase < PLY_NUMBER_OF_PHASES);
+
+        if (phase_timestamps[phase] == 0.0 ||
+            phase_timestamps[PLY_PHASE_DAEMON_STARTED] == 0.0)
+                return -1.0;
+
+        return phase_timestamps[phase] - phase_timestamps[PLY_PHASE_DAEMON_STARTED];
+}
+
+const char *
+ply_phase_tracer_get_phase_name (ply_phase_t phase)
+{
+        assert (phase < PLY_NUMBER_OF_PHASES);
+
+        return phase_names[phase];
+}
+
+char *
+ply_phase_tracer_get_report (void)
+{
+        ply_buffer_t *buffer;
+        char *report;
+        int i;
+
+        buffer = ply_buffer_new ();
+
+        for (i = 0; i < PLY_NUMBER_OF_PHASES; i++) {
+                double time;
+
+                time = ply_phase_tracer_get_time (i);
+                if (time < 0.0)
+                        continue;
+
+                ply_buffer_append (buffer, "%s %.6f\n", phase_names[i], time);
+        }
+
+        report = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return report;
+}
@@ -0,0 +1,51 @@
+/* ply-phase-tracer.h - Records when startup milestones are reached
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_PHASE_TRACER_H
+#define PLY_PHASE_TRACER_H
+
+typedef enum
+{
+        PLY_PHASE_DAEMON_STARTED = 0,
+        PLY_PHASE_SETTINGS_LOADED,
+        PLY_PHASE_DEVICES_WATCHED,
+        PLY_PHASE_RENDERER_OPENED,
+        PLY_PHASE_SPLASH_LOADED,
+        PLY_PHASE_SPLASH_SHOWN,
+        PLY_PHASE_FIRST_FRAME,      /* first successful flush to a pixel head */
+        PLY_PHASE_FIRST_TEXT_FRAME, /* first draw to a text display */
+        PLY_PHASE_FIRST_INPUT_READY,
+        PLY_NUMBER_OF_PHASES
+} ply_phase_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+/* Only the first time a phase is marked counts.  Marks are meant to be
+ * made from the main thread.
+ */
+void ply_phase_tracer_mark (ply_phase_t phase);
+
+/* Seconds from PLY_PHASE_DAEMON_STARTED to the phase, or a negative
+ * number if either wasn't reached
+ */
+double ply_phase_tracer_get_time (ply_phase_t phase);
+const char *ply_phase_tracer_get_phase_name (ply_phase_t phase);
+
+/* One "name seconds" line per reached phase */
+char *ply_phase_tracer_get_report (void);
+#endif
+
+#endif /* PLY_PHASE_TRACER_H */
@@ -28,15 +28,19 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 
+#include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-progress.h"
@@ -50,6 +54,39 @@
 #define DEFAULT_BOOT_DURATION 60.0
 #endif
 
+/* The cache is a header, a table of hash buckets, the messages sorted by
+ * time, and their NUL terminated strings.  Buckets hold the index of the
+ * first message in their chain, and chains only ever point forward, so a
+ * damaged file can't make a lookup loop.  Older caches are plain text
+ * lines of "percentage:message".
+ */
+#define PLY_PROGRESS_CACHE_MAGIC 0x50594c50
+#define PLY_PROGRESS_CACHE_VERSION 1
+#define PLY_PROGRESS_CACHE_NO_ENTRY UINT32_MAX
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t version;
+        uint32_t number_of_entries;
+        uint32_t number_of_buckets;
+} ply_progress_cache_header_t;
+
+typedef struct
+{
+        double   time;
+        uint32_t hash;
+        uint32_t string_offset;
+        uint32_t next_entry;
+        uint32_t padding;
+} ply_progress_cache_entry_t;
+
+typedef struct
+{
+        double      time;
+        const char *string;
+        uint32_t    index;
+} ply_progress_cache_message_t;
 
 struct _ply_progress
 {
@@ -61,8 +98,13 @@ struct _ply_progress
         double      dead_time;
         double      next_message_percentage;
         ply_list_t *current_message_list;
-        ply_list_t *previous_message_list;
+        ply_hashtable_t *current_messages;
+
+        const ply_progress_cache_header_t *previous_messages;
+        size_t      previous_messages_size;
+
         uint32_t    paused : 1;
+        uint32_t    previous_messages_are_mapped : 1;
 };
 
 typedef struct
@@ -86,11 +128,28 @@ ply_progress_new (void)
         progress->dead_time = 0.0;
         progress->next_message_percentage = 0.25;
         progress->current_message_list = ply_list_new ();
-        progress->previous_message_list = ply_list_new ();
+        progress->current_messages = ply_hashtable_new (ply_hashtable_string_hash,
+                                                        ply_hashtable_string_compare);
         progress->paused = false;
         return progress;
 }
 
+static void
+ply_progress_unload_cache (ply_progress_t *progress)
+{
+        if (progress->previous_messages == NULL)
+                return;
+
+        if (progress->previous_messages_are_mapped)
+                munmap ((void *) progress->previous_messages, progress->previous_messages_size);
+        else
+                free ((void *) progress->previous_messages);
+
+        progress->previous_messages = NULL;
+        progress->previous_messages_size = 0;
+        progress->previous_messages_are_mapped = false;
+}
+
 void
 ply_progress_free (ply_progress_t *progress)
 {
@@ -108,130 +167,432 @@ ply_progress_free (ply_progress_t *progress)
                 node = next_node;
         }
         ply_list_free (progress->current_message_list);
+        ply_hashtable_free (progress->current_messages);
 
-        node = ply_list_get_first_node (progress->previous_message_list);
+        ply_progress_unload_cache (progress);
+        free (progress);
+        return;
+}
 
-        while (node) {
-                ply_list_node_t *next_node;
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (progress->previous_message_list, node);
 
-                free (message->string);
-                free (message);
-                node = next_node;
+static uint32_t
+ply_progress_cache_hash (const char *string)
+{
+        uint32_t hash = 2166136261u;
+
+        for (; *string != '\0'; string++) {
+                hash ^= (uint8_t) *string;
+                hash *= 16777619u;
         }
-        ply_list_free (progress->previous_message_list);
-        free (progress);
-        return;
+
+        return hash;
 }
 
+static const uint32_t *
+ply_progress_cache_get_buckets (const ply_progress_cache_header_t *cache)
+{
+        return (const uint32_t *) (cache + 1);
+}
 
-static ply_progress_message_t *
-ply_progress_message_search (ply_list_t *message_list,
-                             const char *string)
+static const ply_progress_cache_entry_t *
+ply_progress_cache_get_entries (const ply_progress_cache_header_t *cache)
 {
-        ply_list_node_t *node;
+        return (const ply_progress_cache_entry_t *) (ply_progress_cache_get_buckets (cache) + cache->number_of_buckets);
+}
 
-        node = ply_list_get_first_node (message_list);
+static const char *
+ply_progress_cache_get_strings (const ply_progress_cache_header_t *cache)
+{
+        return (const char *) (ply_progress_cache_get_entries (cache) + cache->number_of_entries);
+}
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (strcmp (string, message->string) == 0)
-                        return message;
-                node = ply_list_get_next_node (message_list, node);
+static int
+ply_progress_cache_message_compare (const void *a,
+                                    const void *b)
+{
+        const ply_progress_cache_message_t *message_a = a;
+        const ply_progress_cache_message_t *message_b = b;
+
+        if (message_a->time < message_b->time)
+                return -1;
+        if (message_a->time > message_b->time)
+                return 1;
+
+        /* Keep the original order of messages with the same time */
+        if (message_a->index < message_b->index)
+                return -1;
+        if (message_a->index > message_b->index)
+                return 1;
+        return 0;
+}
+
+/* Builds a cache image from messages sorted by time */
+static ply_progress_cache_header_t *
+ply_progress_cache_build (const ply_progress_cache_message_t *messages,
+                          uint32_t                            number_of_messages,
+                          size_t                             *size)
+{
+        ply_progress_cache_header_t *cache;
+        ply_progress_cache_entry_t *entries;
+        uint32_t *buckets;
+        char *strings;
+        size_t strings_size = 0;
+        uint32_t number_of_buckets = 2;
+        uint32_t i;
+
+        for (i = 0; i < number_of_messages; i++) {
+                strings_size += strlen (messages[i].string) + 1;
+        }
+
+        if (strings_size > UINT32_MAX)
+                return NULL;
+
+        while (number_of_buckets < number_of_messages && number_of_buckets < (1U << 24)) {
+                number_of_buckets *= 2;
+        }
+
+        *size = sizeof(ply_progress_cache_header_t) +
+                number_of_buckets * sizeof(uint32_t) +
+                number_of_messages * sizeof(ply_progress_cache_entry_t) +
+                strings_size;
+
+        cache = calloc (1, *size);
+        if (cache == NULL)
+                return NULL;
+
+        cache->magic = PLY_PROGRESS_CACHE_MAGIC;
+        cache->version = PLY_PROGRESS_CACHE_VERSION;
+        cache->number_of_entries = number_of_messages;
+        cache->number_of_buckets = number_of_buckets;
+
+        buckets = (uint32_t *) ply_progress_cache_get_buckets (cache);
+        entries = (ply_progress_cache_entry_t *) ply_progress_cache_get_entries (cache);
+        strings = (char *) ply_progress_cache_get_strings (cache);
+
+        for (i = 0; i < number_of_buckets; i++) {
+                buckets[i] = PLY_PROGRESS_CACHE_NO_ENTRY;
+        }
+
+        strings_size = 0;
+        for (i = 0; i < number_of_messages; i++) {
+                size_t length = strlen (messages[i].string) + 1;
+
+                entries[i].time = messages[i].time;
+                entries[i].hash = ply_progress_cache_hash (messages[i].string);
+                entries[i].string_offset = strings_size;
+                memcpy (strings + strings_size, messages[i].string, length);
+                strings_size += length;
+        }
+
+        /* Chain from the back, so every chain is in time order */
+        i = number_of_messages;
+        while (i-- > 0) {
+                uint32_t bucket = entries[i].hash & (number_of_buckets - 1);
+
+                entries[i].next_entry = buckets[bucket];
+                buckets[bucket] = i;
+        }
+
+        return cache;
+}
+
+static bool
+ply_progress_cache_validate (const ply_progress_cache_header_t *cache,
+                             size_t                             size)
+{
+        const uint32_t *buckets;
+        const ply_progress_cache_entry_t *entries;
+        size_t tables_size, strings_size;
+        uint32_t i;
+
+        if (size < sizeof(ply_progress_cache_header_t))
+                return false;
+
+        if (cache->magic != PLY_PROGRESS_CACHE_MAGIC ||
+            cache->version != PLY_PROGRESS_CACHE_VERSION)
+                return false;
+
+        if (cache->number_of_buckets == 0 ||
+            (cache->number_of_buckets & (cache->number_of_buckets - 1)) != 0 ||
+            cache->number_of_buckets > (1U << 24) ||
+            cache->number_of_entries > (UINT32_MAX / sizeof(ply_progress_cache_entry_t)))
+                return false;
+
+        tables_size = sizeof(ply_progress_cache_header_t) +
+                      (size_t) cache->number_of_buckets * sizeof(uint32_t) +
+                      (size_t) cache->number_of_entries * sizeof(ply_progress_cache_entry_t);
+
+        if (size < tables_size)
+                return false;
+
+        /* The entries hold doubles */
+        if ((sizeof(ply_progress_cache_header_t) + cache->number_of_buckets * sizeof(uint32_t)) %
+            __alignof__ (ply_progress_cache_entry_t) != 0)
+                return false;
+
+        strings_size = size - tables_size;
+
+        if (cache->number_of_entries > 0 &&
+            (strings_size == 0 || ply_progress_cache_get_strings (cache)[strings_size - 1] != '\0'))
+                return false;
+
+        buckets = ply_progress_cache_get_buckets (cache);
+        entries = ply_progress_cache_get_entries (cache);
+
+        for (i = 0; i < cache->number_of_buckets; i++) {
+                if (buckets[i] != PLY_PROGRESS_CACHE_NO_ENTRY &&
+                    buckets[i] >= cache->number_of_entries)
+                        return false;
         }
+
+        for (i = 0; i < cache->number_of_entries; i++) {
+                if (entries[i].string_offset >= strings_size)
+                        return false;
+
+                if (entries[i].next_entry != PLY_PROGRESS_CACHE_NO_ENTRY &&
+                    (entries[i].next_entry <= i || entries[i].next_entry >= cache->number_of_entries))
+                        return false;
+        }
+
+        return true;
+}
+
+static const ply_progress_cache_entry_t *
+ply_progress_cache_lookup (const ply_progress_cache_header_t *cache,
+                           const char                        *string)
+{
+        const ply_progress_cache_entry_t *entries;
+        const char *strings;
+        uint32_t hash, index;
+
+        entries = ply_progress_cache_get_entries (cache);
+        strings = ply_progress_cache_get_strings (cache);
+
+        hash = ply_progress_cache_hash (string);
+        index = ply_progress_cache_get_buckets (cache)[hash & (cache->number_of_buckets - 1)];
+
+        while (index != PLY_PROGRESS_CACHE_NO_ENTRY) {
+                if (entries[index].hash == hash &&
+                    strcmp (strings + entries[index].string_offset, string) == 0)
+                        return &entries[index];
+
+                index = entries[index].next_entry;
+        }
+
         return NULL;
 }
 
+static const ply_progress_cache_entry_t *
+ply_progress_cache_get_next (const ply_progress_cache_header_t *cache,
+                             const ply_progress_cache_entry_t  *entry)
+{
+        const ply_progress_cache_entry_t *entries;
+        const ply_progress_cache_entry_t *end;
+
+        entries = ply_progress_cache_get_entries (cache);
+        end = entries + cache->number_of_entries;
 
-static ply_progress_message_t *
-ply_progress_message_search_next (ply_list_t *message_list,
-                                  double      time)
+        for (entry++; entry < end; entry++) {
+                if (entry->time > entry[-1].time)
+                        return entry;
+        }
+
+        return NULL;
+}
+
+static bool
+ply_progress_load_binary_cache (ply_progress_t *progress,
+                                int             fd,
+                                size_t          size)
 {
-        ply_list_node_t *node;
+        ply_progress_cache_header_t header;
+        void *cache;
+
+        if (size < sizeof(header) ||
+            pread (fd, &header, sizeof(header), 0) != sizeof(header) ||
+            header.magic != PLY_PROGRESS_CACHE_MAGIC)
+                return false;
+
+        cache = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (cache == MAP_FAILED) {
+                ply_trace ("could not map progress cache: %m");
+                return false;
+        }
 
-        node = ply_list_get_first_node (message_list);
-        ply_progress_message_t *best = NULL;
+        if (!ply_progress_cache_validate (cache, size)) {
+                ply_trace ("progress cache is damaged, ignoring it");
+                munmap (cache, size);
+                return false;
+        }
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (message->time > time && (!best || message->time < best->time))
-                        best = message;
-                node = ply_list_get_next_node (message_list, node);
+        ply_progress_unload_cache (progress);
+        progress->previous_messages = cache;
+        progress->previous_messages_size = size;
+        progress->previous_messages_are_mapped = true;
+
+        return true;
+}
+
+static void
+ply_progress_load_text_cache (ply_progress_t *progress,
+                              int             fd,
+                              size_t          size)
+{
+        ply_progress_cache_message_t *messages = NULL;
+        ply_progress_cache_header_t *cache;
+        uint32_t number_of_messages = 0, max_messages = 0;
+        char *contents, *line, *end_of_line;
+
+        if (size == 0)
+                return;
+
+        contents = malloc (size + 1);
+        if (contents == NULL)
+                return;
+
+        if (lseek (fd, 0, SEEK_SET) < 0 || !ply_read (fd, contents, size)) {
+                free (contents);
+                return;
+        }
+        contents[size] = '\0';
+
+        for (line = contents; line < contents + size; line = end_of_line + 1) {
+                double time;
+                char *colon;
+
+                end_of_line = memchr (line, '\n', contents + size - line);
+                if (end_of_line == NULL)
+                        end_of_line = contents + size;
+                *end_of_line = '\0';
+
+                time = strtod (line, &colon);
+                if (colon == line || *colon != ':')
+                        break;
+
+                if (number_of_messages == max_messages) {
+                        ply_progress_cache_message_t *new_messages;
+
+                        max_messages = max_messages > 0 ? max_messages * 2 : 64;
+                        new_messages = realloc (messages, max_messages * sizeof(ply_progress_cache_message_t));
+                        if (new_messages == NULL) {
+                                free (messages);
+                                free (contents);
+                                return;
+                        }
+                        messages = new_messages;
+                }
+
+                messages[number_of_messages].time = time;
+                messages[number_of_messages].string = colon + 1;
+                messages[number_of_messages].index = number_of_messages;
+                number_of_messages++;
         }
-        return best;
+
+        qsort (messages, number_of_messages, sizeof(ply_progress_cache_message_t),
+               ply_progress_cache_message_compare);
+
+        cache = ply_progress_cache_build (messages, number_of_messages, &size);
+
+        free (messages);
+        free (contents);
+
+        if (cache == NULL)
+                return;
+
+        ply_progress_unload_cache (progress);
+        progress->previous_messages = cache;
+        progress->previous_messages_size = size;
+        progress->previous_messages_are_mapped = false;
 }
 
 void
 ply_progress_load_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        struct stat file_info;
+        int fd;
 
-        fp = fopen (filename, "r");
-        if (fp == NULL)
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
                 return;
 
-        while (1) {
-                int items_matched;
-                double time;
-                int string_size = 81;
-                char *string;
-                char colon;
-                int i = 0;
-
-                items_matched = fscanf (fp, "%lf", &time);
-                if (items_matched < 1) break;
-                items_matched = fscanf (fp, "%c", &colon);
-                if (items_matched < 1 || colon != ':') break;
-
-                string = malloc (sizeof(char) * string_size);
-                while (1) {
-                        if (i >= string_size) {
-                                string_size *= 2;
-                                string = realloc (string, sizeof(char) * string_size);
-                        }
-                        items_matched = fscanf (fp, "%c", &string[i]);
-                        if (items_matched < 1 || string[i] == '\n') {
-                                string[i] = '\0';
-                                break;
-                        }
-                        i++;
-                }
-                ply_progress_message_t *message = malloc (sizeof(ply_progress_message_t));
-                message->time = time;
-                message->string = string;
-                ply_list_append_data (progress->previous_message_list, message);
+        if (fstat (fd, &file_info) < 0 || !S_ISREG (file_info.st_mode)) {
+                close (fd);
+                return;
         }
-        fclose (fp);
+
+        if (!ply_progress_load_binary_cache (progress, fd, file_info.st_size))
+                ply_progress_load_text_cache (progress, fd, file_info.st_size);
+
+        close (fd);
 }
 
 void
 ply_progress_save_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        ply_progress_cache_message_t *messages;
+        ply_progress_cache_header_t *cache;
         ply_list_node_t *node;
+        uint32_t number_of_messages = 0;
         double cur_time = ply_progress_get_time (progress);
+        char *temporary_filename;
+        size_t size;
+        int fd;
 
         ply_trace ("saving progress cache to %s", filename);
 
-        fp = fopen (filename, "w");
-        if (fp == NULL) {
+        messages = calloc (ply_list_get_length (progress->current_message_list) + 1,
+                           sizeof(ply_progress_cache_message_t));
+        if (messages == NULL) {
                 ply_trace ("failed to save cache: %m");
                 return;
         }
 
-        node = ply_list_get_first_node (progress->current_message_list);
-
-        while (node) {
+        ply_list_foreach (progress->current_message_list, node) {
                 ply_progress_message_t *message = ply_list_node_get_data (node);
-                double percentage = message->time / cur_time;
-                if (!message->disabled)
-                        fprintf (fp, "%.3lf:%s\n", percentage, message->string);
-                node = ply_list_get_next_node (progress->current_message_list, node);
+
+                if (message->disabled)
+                        continue;
+
+                messages[number_of_messages].time = message->time / cur_time;
+                messages[number_of_messages].string = message->string;
+                messages[number_of_messages].index = number_of_messages;
+                number_of_messages++;
+        }
+
+        /* The messages are already in the order they arrived */
+        cache = ply_progress_cache_build (messages, number_of_messages, &size);
+        free (messages);
+
+        if (cache == NULL) {
+                ply_trace ("failed to save cache: could not build it");
+                return;
+        }
+
+        /* Write a new file and rename it over the old one, so a daemon
+         * that has the old one mapped keeps seeing consistent contents
+         */
+        asprintf (&temporary_filename, "%s.new", filename);
+        fd = open (temporary_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+                ply_trace ("failed to save cache: %m");
+        } else if (!ply_write (fd, cache, size)) {
+                ply_trace ("failed to save cache: %m");
+                close (fd);
+                unlink (temporary_filename);
+        } else {
+                close (fd);
+
+                if (rename (temporary_filename, filename) < 0) {
+                        ply_trace ("failed to save cache: %m");
+                        unlink (temporary_filename);
+                }
         }
-        fclose (fp);
+
+        free (temporary_filename);
+        free (cache);
 }
 
 
@@ -301,22 +662,28 @@ void
 ply_progress_status_update (ply_progress_t *progress,
                             const char     *status)
 {
-        ply_progress_message_t *message, *message_next;
+        ply_progress_message_t *message;
+        const ply_progress_cache_entry_t *previous_message, *previous_message_next;
 
-        message = ply_progress_message_search (progress->current_message_list, status);
+        message = ply_hashtable_lookup (progress->current_messages, (void *) status);
         if (message) {
                 message->disabled = true;
         }                                               /* Remove duplicates as they confuse things*/
         else {
-                message = ply_progress_message_search (progress->previous_message_list, status);
-                if (message) {
-                        message_next = ply_progress_message_search_next (progress->previous_message_list, message->time);
-                        if (message_next)
-                                progress->next_message_percentage = message_next->time;
+                if (progress->previous_messages != NULL) {
+                        previous_message = ply_progress_cache_lookup (progress->previous_messages, status);
+                } else {
+                        previous_message = NULL;
+                }
+
+                if (previous_message) {
+                        previous_message_next = ply_progress_cache_get_next (progress->previous_messages, previous_message);
+                        if (previous_message_next)
+                                progress->next_message_percentage = previous_message_next->time;
                         else
                                 progress->next_message_percentage = 1;
 
-                        progress->scalar += message->time / (ply_progress_get_time (progress) - progress->dead_time);
+                        progress->scalar += previous_message->time / (ply_progress_get_time (progress) - progress->dead_time);
                         progress->scalar /= 2;
                 }
                 message = malloc (sizeof(ply_progress_message_t));
@@ -324,6 +691,7 @@ ply_progress_status_update (ply_progress_t *progress,
                 message->string = strdup (status);
                 message->disabled = false;
                 ply_list_append_data (progress->current_message_list, message);
+                ply_hashtable_insert (progress->current_messages, message->string, message);
         }
 }
 
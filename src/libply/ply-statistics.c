@@ -0,0 +1,58 @@
+/* ply-statistics.c - Process wide counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-statistics.h"
+
+#include <assert.h>
+
+static const char *statistic_names[PLY_NUMBER_OF_STATISTICS] =
+{
+        [PLY_STATISTIC_PROTOCOL_REQUESTS]   = "protocol-requests",
+        [PLY_STATISTIC_EVENT_LOOP_WAKEUPS]  = "event-loop-wakeups",
+        [PLY_STATISTIC_BYTES_LOGGED]        = "bytes-logged",
+        [PLY_STATISTIC_PIXELS_DRAWN]        = "pixels-drawn",
+        [PLY_STATISTIC_PIXELS_FLUSHED]      = "pixels-flushed",
+        [PLY_STATISTIC_DECODED_IMAGE_BYTES] = "decoded-image-bytes",
+};
+
+static uint64_t statistics[PLY_NUMBER_OF_STATISTICS];
+
+void
+ply_statistics_add (ply_statistic_t statistic,
+                    uint64_t        amount)
+{
+        assert (statistic < PLY_NUMBER_OF_STATISTICS);
+
+        __atomic_fetch_add (&statistics[statistic], amount, __ATOMIC_RELAXED);
+}
+
+uint64_t
+ply_statistics_get (ply_statistic_t statistic)
+{
+        assert (statistic < PLY_NUMBER_OF_STATISTICS);
+
+        return __atomic_load_n (&statistics[statistic], __ATOMIC_RELAXED);
+}
+
+const char *
+ply_statistics_get_name (ply_statistic_t statistic)
+{
+        assert (statistic < PLY_NUMBER_OF_STATISTICS);
+
+        return statistic_names[statistic];
+}
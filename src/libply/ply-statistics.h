@@ -0,0 +1,42 @@
+/* ply-statistics.h - Process wide counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_STATISTICS_H
+#define PLY_STATISTICS_H
+
+#include <stdint.h>
+
+typedef enum
+{
+        PLY_STATISTIC_PROTOCOL_REQUESTS = 0,
+        PLY_STATISTIC_EVENT_LOOP_WAKEUPS,
+        PLY_STATISTIC_BYTES_LOGGED,
+        PLY_STATISTIC_PIXELS_DRAWN,
+        PLY_STATISTIC_PIXELS_FLUSHED,
+        PLY_STATISTIC_DECODED_IMAGE_BYTES,
+        PLY_NUMBER_OF_STATISTICS
+} ply_statistic_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+/* Safe to call from any thread */
+void ply_statistics_add (ply_statistic_t statistic,
+                         uint64_t        amount);
+uint64_t ply_statistics_get (ply_statistic_t statistic);
+const char *ply_statistics_get_name (ply_statistic_t statistic);
+#endif
+
+#endif /* PLY_STATISTICS_H */
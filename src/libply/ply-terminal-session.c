@@ -39,11 +39,29 @@
 
 #include "ply-event-loop.h"
 #include "ply-logger.h"
+#include "ply-statistics.h"
 #include "ply-utils.h"
 
+#ifndef PLY_TERMINAL_SESSION_SPLICE_SIZE
+#define PLY_TERMINAL_SESSION_SPLICE_SIZE (16 * 4096)
+#endif
+
 struct _ply_terminal_session
 {
         int                                   pseudoterminal_master_fd;
+
+        /* When splicing, console output moves from the pseudoterminal
+         * into capture_pipe, is tee'd into output_pipe for the output
+         * handler, and goes from capture_pipe straight to splice_fd
+         * (the log file) without being copied into userspace.  splice_fd
+         * has its own file offset, so the logger must not write to the
+         * file while splicing; anything that needs the logger stops
+         * splicing first.
+         */
+        int                                   capture_pipe[2];
+        int                                   output_pipe[2];
+        int                                   splice_fd;
+
         ply_logger_t                         *logger;
         ply_event_loop_t                     *loop;
         char                                **argv;
@@ -57,10 +75,12 @@ struct _ply_terminal_session
         uint32_t                              is_running : 1;
         uint32_t                              console_is_redirected : 1;
         uint32_t                              created_terminal_device : 1;
+        uint32_t                              is_splicing : 1;
 };
 
 static void ply_terminal_session_start_logging (ply_terminal_session_t *session);
 static void ply_terminal_session_stop_logging (ply_terminal_session_t *session);
+static void ply_terminal_session_stop_splicing (ply_terminal_session_t *session);
 
 ply_terminal_session_t *
 ply_terminal_session_new (const char *const *argv)
@@ -71,8 +91,16 @@ ply_terminal_session_new (const char *const *argv)
 
         session = calloc (1, sizeof(ply_terminal_session_t));
         session->pseudoterminal_master_fd = -1;
+        session->capture_pipe[0] = session->capture_pipe[1] = -1;
+        session->output_pipe[0] = session->output_pipe[1] = -1;
+        session->splice_fd = -1;
         session->argv = argv == NULL ? NULL : ply_copy_string_array (argv);
         session->logger = ply_logger_new ();
+        /* Console output can come in fast, so write it out in batches
+         * rather than once per read
+         */
+        ply_logger_set_flush_policy (session->logger,
+                                     PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND);
         session->is_running = false;
         session->console_is_redirected = false;
 
@@ -86,6 +114,7 @@ ply_terminal_session_free (ply_terminal_session_t *session)
                 return;
 
         ply_terminal_session_stop_logging (session);
+        ply_terminal_session_stop_splicing (session);
         ply_logger_free (session->logger);
 
         ply_free_string_array (session->argv);
@@ -300,6 +329,176 @@ ply_terminal_session_log_bytes (ply_terminal_session_t *session,
                                          bytes, number_of_bytes, session);
 }
 
+static void
+close_pipe (int pipe_fds[2])
+{
+        if (pipe_fds[0] >= 0)
+                close (pipe_fds[0]);
+        if (pipe_fds[1] >= 0)
+                close (pipe_fds[1]);
+        pipe_fds[0] = pipe_fds[1] = -1;
+}
+
+/* Hands bytes left in the capture pipe back to the logger, and goes back
+ * to reading the pseudoterminal.  If the output handler hasn't seen those
+ * bytes yet, they go to it as well, and whatever part of them did get
+ * tee'd is dropped.
+ */
+static void
+ply_terminal_session_finish_splicing (ply_terminal_session_t *session,
+                                      bool                    output_was_handled)
+{
+        uint8_t buffer[4096];
+        ssize_t bytes_read;
+
+        if (!session->is_splicing)
+                return;
+
+        ply_trace ("no longer splicing console output to log");
+
+        /* The logger writes through its own descriptor from here on */
+        close (session->splice_fd);
+        session->splice_fd = -1;
+        session->is_splicing = false;
+
+        while (read (session->output_pipe[0], buffer, sizeof(buffer)) > 0) {
+                continue;
+        }
+
+        while ((bytes_read = read (session->capture_pipe[0], buffer, sizeof(buffer))) > 0) {
+                if (output_was_handled)
+                        ply_logger_inject_bytes (session->logger, buffer, bytes_read);
+                else
+                        ply_terminal_session_log_bytes (session, buffer, bytes_read);
+        }
+
+        close_pipe (session->capture_pipe);
+        close_pipe (session->output_pipe);
+
+        ply_logger_set_flush_policy (session->logger,
+                                     PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND);
+}
+
+static void
+ply_terminal_session_stop_splicing (ply_terminal_session_t *session)
+{
+        ply_terminal_session_finish_splicing (session, true);
+}
+
+static void
+ply_terminal_session_start_splicing (ply_terminal_session_t *session,
+                                     const char             *filename)
+{
+        assert (!session->is_splicing);
+
+        if (pipe2 (session->capture_pipe, O_CLOEXEC | O_NONBLOCK) < 0 ||
+            pipe2 (session->output_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+                ply_trace ("could not create pipes for splicing: %m");
+                close_pipe (session->capture_pipe);
+                close_pipe (session->output_pipe);
+                return;
+        }
+
+        /* splice() refuses files opened for appending, so the log file
+         * gets a descriptor of its own
+         */
+        session->splice_fd = open (filename, O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (session->splice_fd < 0) {
+                ply_trace ("could not open '%s' for splicing: %m", filename);
+                close_pipe (session->capture_pipe);
+                close_pipe (session->output_pipe);
+                return;
+        }
+
+        /* Everything logged so far has to land before the spliced output */
+        ply_logger_set_flush_policy (session->logger,
+                                     PLY_LOGGER_FLUSH_POLICY_WHEN_ASKED);
+        if (!ply_logger_flush (session->logger) ||
+            lseek (session->splice_fd, 0, SEEK_END) < 0) {
+                ply_trace ("could not catch up with log before splicing: %m");
+                close (session->splice_fd);
+                session->splice_fd = -1;
+                close_pipe (session->capture_pipe);
+                close_pipe (session->output_pipe);
+                ply_logger_set_flush_policy (session->logger,
+                                             PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND);
+                return;
+        }
+
+        ply_trace ("splicing console output to log");
+        session->is_splicing = true;
+}
+
+static bool
+ply_terminal_session_splice_new_data (ply_terminal_session_t *session,
+                                      int                     session_fd)
+{
+        uint8_t buffer[4096];
+        ssize_t bytes_captured, bytes_teed, bytes_read;
+        size_t bytes_left;
+
+        bytes_captured = splice (session_fd, NULL, session->capture_pipe[1], NULL,
+                                 PLY_TERMINAL_SESSION_SPLICE_SIZE,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (bytes_captured < 0) {
+                if (errno == EAGAIN || errno == EINTR)
+                        return true;
+
+                /* Older kernels can't splice from a pseudoterminal */
+                ply_trace ("could not splice console output: %m");
+                ply_terminal_session_stop_splicing (session);
+                return false;
+        }
+
+        if (bytes_captured == 0)
+                return true;
+
+        if (session->output_handler != NULL) {
+                bytes_teed = tee (session->capture_pipe[0], session->output_pipe[1],
+                                  bytes_captured, SPLICE_F_NONBLOCK);
+
+                if (bytes_teed != bytes_captured) {
+                        if (bytes_teed < 0)
+                                ply_trace ("could not tee console output: %m");
+                        else
+                                ply_trace ("only tee'd %zd of %zd bytes of console output",
+                                           bytes_teed, bytes_captured);
+
+                        ply_terminal_session_finish_splicing (session, false);
+                        return true;
+                }
+        }
+
+        while ((bytes_read = read (session->output_pipe[0], buffer, sizeof(buffer))) > 0) {
+                if (session->output_handler != NULL)
+                        session->output_handler (session->user_data,
+                                                 buffer, bytes_read, session);
+        }
+
+        bytes_left = bytes_captured;
+        while (bytes_left > 0) {
+                ssize_t bytes_spliced;
+
+                bytes_spliced = splice (session->capture_pipe[0], NULL, session->splice_fd, NULL,
+                                        bytes_left, SPLICE_F_MOVE);
+
+                if (bytes_spliced < 0 && errno == EINTR)
+                        continue;
+
+                if (bytes_spliced <= 0) {
+                        ply_trace ("could not splice console output to log: %m");
+                        ply_terminal_session_stop_splicing (session);
+                        break;
+                }
+
+                ply_statistics_add (PLY_STATISTIC_BYTES_LOGGED, bytes_spliced);
+                bytes_left -= bytes_spliced;
+        }
+
+        return true;
+}
+
 static void
 ply_terminal_session_on_new_data (ply_terminal_session_t *session,
                                   int                     session_fd)
@@ -310,12 +509,14 @@ ply_terminal_session_on_new_data (ply_terminal_session_t *session,
         assert (session != NULL);
         assert (session_fd >= 0);
 
+        if (session->is_splicing &&
+            ply_terminal_session_splice_new_data (session, session_fd))
+                return;
+
         bytes_read = read (session_fd, buffer, sizeof(buffer));
 
         if (bytes_read > 0)
                 ply_terminal_session_log_bytes (session, buffer, bytes_read);
-
-        ply_logger_flush (session->logger);
 }
 
 static void
@@ -413,8 +614,12 @@ ply_terminal_session_open_log (ply_terminal_session_t *session,
 
         ply_save_errno ();
         log_is_opened = ply_logger_open_file (session->logger, filename);
-        if (log_is_opened)
+        if (log_is_opened) {
+                if ((session->attach_flags & PLY_TERMINAL_SESSION_FLAGS_SPLICE_OUTPUT) != 0 &&
+                    !session->is_splicing)
+                        ply_terminal_session_start_splicing (session, filename);
                 ply_logger_flush (session->logger);
+        }
         ply_restore_errno ();
 
         return log_is_opened;
@@ -426,6 +631,8 @@ ply_terminal_session_close_log (ply_terminal_session_t *session)
         assert (session != NULL);
         assert (session->logger != NULL);
 
+        ply_terminal_session_stop_splicing (session);
+
         return ply_logger_close_file (session->logger);
 }
 
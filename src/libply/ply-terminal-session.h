@@ -47,6 +47,7 @@ typedef enum
         PLY_TERMINAL_SESSION_FLAGS_RUN_IN_PARENT    = 0x1,
         PLY_TERMINAL_SESSION_FLAGS_LOOK_IN_PATH     = 0x2,
         PLY_TERMINAL_SESSION_FLAGS_REDIRECT_CONSOLE = 0x4,
+        PLY_TERMINAL_SESSION_FLAGS_SPLICE_OUTPUT    = 0x8,
 } ply_terminal_session_flags_t;
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
@@ -536,13 +536,66 @@ ply_character_device_exists (const char *device)
         return S_ISCHR (file_info.st_mode);
 }
 
+static const ply_built_in_module_t *built_in_modules = NULL;
+
+void
+ply_set_built_in_modules (const ply_built_in_module_t *modules)
+{
+        built_in_modules = modules;
+}
+
+static const ply_built_in_module_t *
+ply_find_built_in_module (const char *module_path)
+{
+        const ply_built_in_module_t *module;
+        const char *name;
+
+        if (built_in_modules == NULL)
+                return NULL;
+
+        if (!ply_string_has_prefix (module_path, PLYMOUTH_PLUGIN_PATH))
+                return NULL;
+
+        name = module_path + strlen (PLYMOUTH_PLUGIN_PATH);
+
+        for (module = built_in_modules; module->name != NULL; module++) {
+                if (strcmp (module->name, name) == 0)
+                        return module;
+        }
+
+        return NULL;
+}
+
+static const ply_built_in_module_t *
+ply_get_built_in_module_from_handle (ply_module_handle_t *handle)
+{
+        const ply_built_in_module_t *module;
+
+        if (built_in_modules == NULL)
+                return NULL;
+
+        for (module = built_in_modules; module->name != NULL; module++) {
+                if ((ply_module_handle_t *) module == handle)
+                        return module;
+        }
+
+        return NULL;
+}
+
 ply_module_handle_t *
 ply_open_module (const char *module_path)
 {
+        const ply_built_in_module_t *built_in_module;
         ply_module_handle_t *handle;
 
         assert (module_path != NULL);
 
+        built_in_module = ply_find_built_in_module (module_path);
+        if (built_in_module != NULL) {
+                ply_trace ("Using built-in module \"%s\"", built_in_module->name);
+                return (ply_module_handle_t *) built_in_module;
+        }
+
         handle = (ply_module_handle_t *) dlopen (module_path,
                                                  RTLD_NODELETE | RTLD_NOW | RTLD_LOCAL);
 
@@ -576,11 +629,22 @@ ply_module_function_t
 ply_module_look_up_function (ply_module_handle_t *handle,
                              const char          *function_name)
 {
+        const ply_built_in_module_t *built_in_module;
         ply_module_function_t function;
 
         assert (handle != NULL);
         assert (function_name != NULL);
 
+        built_in_module = ply_get_built_in_module_from_handle (handle);
+        if (built_in_module != NULL) {
+                if (strcmp (built_in_module->function_name, function_name) != 0) {
+                        errno = ELIBACC;
+                        return NULL;
+                }
+
+                return built_in_module->function;
+        }
+
         dlerror ();
         function = (ply_module_function_t) dlsym (handle, function_name);
 
@@ -597,6 +661,9 @@ ply_module_look_up_function (ply_module_handle_t *handle,
 void
 ply_close_module (ply_module_handle_t *handle)
 {
+        if (ply_get_built_in_module_from_handle (handle) != NULL)
+                return;
+
         dlclose (handle);
 }
 
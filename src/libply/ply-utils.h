@@ -46,6 +46,15 @@
 typedef intptr_t ply_module_handle_t;
 typedef void (*ply_module_function_t) (void);
 
+/* A plugin linked into the executable. name is the module path relative
+ * to PLYMOUTH_PLUGIN_PATH, for example "renderers/drm.so" */
+typedef struct
+{
+        const char           *name;
+        const char           *function_name;
+        ply_module_function_t function;
+} ply_built_in_module_t;
+
 typedef intptr_t ply_daemon_handle_t;
 
 typedef enum
@@ -96,6 +105,7 @@ bool ply_directory_exists (const char *dir);
 bool ply_file_exists (const char *file);
 bool ply_character_device_exists (const char *device);
 
+void ply_set_built_in_modules (const ply_built_in_module_t *modules);
 ply_module_handle_t *ply_open_module (const char *module_path);
 ply_module_handle_t *ply_open_built_in_module (void);
 
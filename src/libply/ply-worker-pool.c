@@ -0,0 +1,324 @@
+/* ply-worker-pool.c - Runs batches of jobs on worker threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-worker-pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ply-logger.h"
+
+typedef struct
+{
+        ply_worker_pool_t *pool;
+        pthread_t          thread;
+        pid_t              thread_id;
+
+        uint32_t           is_running_job : 1;
+        uint32_t           is_boosted : 1;
+} ply_worker_t;
+
+struct _ply_worker_pool
+{
+        ply_worker_t                 *workers;
+        int                           number_of_threads;
+
+        pthread_mutex_t               mutex;
+        pthread_cond_t                jobs_available;
+        pthread_cond_t                jobs_finished;
+
+        ply_worker_pool_job_handler_t handler;
+        void                        **jobs;
+        int                           number_of_jobs;
+        int                           next_job;
+        int                           number_of_finished_jobs;
+
+        /* Each worker applies these to itself when the generation changes */
+        unsigned int                  scheduling_generation;
+        int                           scheduling_policy;
+        int                           nice_level;
+        int                           cpu;
+
+        uint32_t                      is_shutting_down : 1;
+};
+
+static void ply_worker_pool_apply_scheduling (ply_worker_pool_t *pool,
+                                              pid_t              thread_id);
+
+/* Called with the mutex held, drops it while the job runs.  worker is
+ * NULL for the thread that called ply_worker_pool_run_jobs */
+static bool
+ply_worker_pool_run_next_job (ply_worker_pool_t *pool,
+                              ply_worker_t      *worker)
+{
+        ply_worker_pool_job_handler_t handler;
+        void *job;
+
+        if (pool->next_job >= pool->number_of_jobs)
+                return false;
+
+        handler = pool->handler;
+        job = pool->jobs[pool->next_job];
+        pool->next_job++;
+
+        if (worker != NULL)
+                worker->is_running_job = true;
+
+        pthread_mutex_unlock (&pool->mutex);
+        handler (job);
+        pthread_mutex_lock (&pool->mutex);
+
+        if (worker != NULL) {
+                worker->is_running_job = false;
+
+                if (worker->is_boosted) {
+                        ply_worker_pool_apply_scheduling (pool, 0);
+                        worker->is_boosted = false;
+                }
+        }
+
+        pool->number_of_finished_jobs++;
+        if (pool->number_of_finished_jobs == pool->number_of_jobs)
+                pthread_cond_broadcast (&pool->jobs_finished);
+
+        return true;
+}
+
+/* Policy, nice level and affinity are per thread on Linux, and 0 means
+ * the calling thread */
+static void
+ply_worker_pool_apply_scheduling (ply_worker_pool_t *pool,
+                                  pid_t              thread_id)
+{
+        struct sched_param parameters = { 0 };
+        cpu_set_t cpu_set;
+
+        if (sched_setscheduler (thread_id, pool->scheduling_policy, &parameters) < 0)
+                ply_trace ("could not set scheduling policy of worker thread: %m");
+
+        if (setpriority (PRIO_PROCESS, thread_id, pool->nice_level) < 0)
+                ply_trace ("could not set nice level of worker thread: %m");
+
+        if (pool->cpu < 0)
+                return;
+
+        CPU_ZERO (&cpu_set);
+        CPU_SET (pool->cpu, &cpu_set);
+        if (sched_setaffinity (thread_id, sizeof(cpu_set), &cpu_set) < 0)
+                ply_trace ("could not pin worker thread to cpu %d: %m", pool->cpu);
+}
+
+/* The calling thread is about to wait for jobs that workers already
+ * started.  If the workers run at background priority, a busy system could
+ * keep them off the cpu and stall the caller with them, so lend them the
+ * caller's priority until they finish their current job.
+ */
+static void
+ply_worker_pool_boost_running_workers (ply_worker_pool_t *pool)
+{
+        struct sched_param parameters = { 0 };
+        int nice_level;
+        int i;
+
+        if (pool->scheduling_generation == 0)
+                return;
+
+        nice_level = getpriority (PRIO_PROCESS, 0);
+
+        if (pool->scheduling_policy == SCHED_OTHER && pool->nice_level <= nice_level)
+                return;
+
+        for (i = 0; i < pool->number_of_threads; i++) {
+                ply_worker_t *worker = &pool->workers[i];
+
+                if (!worker->is_running_job || worker->is_boosted)
+                        continue;
+
+                if (sched_setscheduler (worker->thread_id, SCHED_OTHER, &parameters) < 0)
+                        ply_trace ("could not boost scheduling policy of worker thread: %m");
+
+                if (setpriority (PRIO_PROCESS, worker->thread_id, nice_level) < 0)
+                        ply_trace ("could not boost nice level of worker thread: %m");
+
+                worker->is_boosted = true;
+        }
+}
+
+static void *
+ply_worker_pool_run_worker (void *user_data)
+{
+        ply_worker_t *worker = user_data;
+        ply_worker_pool_t *pool = worker->pool;
+        unsigned int scheduling_generation = 0;
+
+        pthread_mutex_lock (&pool->mutex);
+        worker->thread_id = (pid_t) syscall (SYS_gettid);
+
+        while (!pool->is_shutting_down) {
+                if (scheduling_generation != pool->scheduling_generation) {
+                        scheduling_generation = pool->scheduling_generation;
+                        ply_worker_pool_apply_scheduling (pool, 0);
+                        continue;
+                }
+
+                if (!ply_worker_pool_run_next_job (pool, worker))
+                        pthread_cond_wait (&pool->jobs_available, &pool->mutex);
+        }
+        pthread_mutex_unlock (&pool->mutex);
+
+        return NULL;
+}
+
+ply_worker_pool_t *
+ply_worker_pool_new (int number_of_workers)
+{
+        ply_worker_pool_t *pool;
+        sigset_t all_signals, old_signals;
+        int i;
+
+        pool = calloc (1, sizeof(ply_worker_pool_t));
+        pthread_mutex_init (&pool->mutex, NULL);
+        pthread_cond_init (&pool->jobs_available, NULL);
+        pthread_cond_init (&pool->jobs_finished, NULL);
+
+        if (number_of_workers <= 0)
+                return pool;
+
+        /* Signals are handled by the event loop on the main thread */
+        sigfillset (&all_signals);
+        pthread_sigmask (SIG_SETMASK, &all_signals, &old_signals);
+
+        pool->workers = calloc (number_of_workers, sizeof(ply_worker_t));
+        for (i = 0; i < number_of_workers; i++) {
+                pool->workers[i].pool = pool;
+
+                if (pthread_create (&pool->workers[i].thread, NULL,
+                                    ply_worker_pool_run_worker, &pool->workers[i]) != 0) {
+                        ply_trace ("could not start worker thread %d: %m", i);
+                        break;
+                }
+                pool->number_of_threads++;
+        }
+
+        pthread_sigmask (SIG_SETMASK, &old_signals, NULL);
+
+        ply_trace ("started %d worker threads", pool->number_of_threads);
+
+        return pool;
+}
+
+void
+ply_worker_pool_free (ply_worker_pool_t *pool)
+{
+        int i;
+
+        if (pool == NULL)
+                return;
+
+        pthread_mutex_lock (&pool->mutex);
+        pool->is_shutting_down = true;
+        pthread_cond_broadcast (&pool->jobs_available);
+        pthread_mutex_unlock (&pool->mutex);
+
+        for (i = 0; i < pool->number_of_threads; i++) {
+                pthread_join (pool->workers[i].thread, NULL);
+        }
+
+        pthread_cond_destroy (&pool->jobs_finished);
+        pthread_cond_destroy (&pool->jobs_available);
+        pthread_mutex_destroy (&pool->mutex);
+
+        free (pool->workers);
+        free (pool);
+}
+
+int
+ply_worker_pool_get_number_of_workers (ply_worker_pool_t *pool)
+{
+        return pool->number_of_threads;
+}
+
+void
+ply_worker_pool_set_scheduling (ply_worker_pool_t *pool,
+                                int                policy,
+                                int                nice_level,
+                                int                cpu)
+{
+        assert (pool != NULL);
+
+        pthread_mutex_lock (&pool->mutex);
+        pool->scheduling_policy = policy;
+        pool->nice_level = nice_level;
+        pool->cpu = cpu;
+        pool->scheduling_generation++;
+        pthread_cond_broadcast (&pool->jobs_available);
+        pthread_mutex_unlock (&pool->mutex);
+}
+
+void
+ply_worker_pool_run_jobs (ply_worker_pool_t            *pool,
+                          ply_worker_pool_job_handler_t handler,
+                          void                        **jobs,
+                          int                           number_of_jobs)
+{
+        assert (pool != NULL);
+        assert (handler != NULL);
+
+        if (number_of_jobs <= 0)
+                return;
+
+        pthread_mutex_lock (&pool->mutex);
+
+        assert (pool->number_of_jobs == 0);
+
+        pool->handler = handler;
+        pool->jobs = jobs;
+        pool->number_of_jobs = number_of_jobs;
+        pool->next_job = 0;
+        pool->number_of_finished_jobs = 0;
+
+        if (number_of_jobs > 1)
+                pthread_cond_broadcast (&pool->jobs_available);
+
+        /* The calling thread works on jobs too, and takes back any the
+         * workers haven't gotten to */
+        while (ply_worker_pool_run_next_job (pool, NULL))
+                continue;
+
+        if (pool->number_of_finished_jobs < pool->number_of_jobs)
+                ply_worker_pool_boost_running_workers (pool);
+
+        while (pool->number_of_finished_jobs < pool->number_of_jobs) {
+                pthread_cond_wait (&pool->jobs_finished, &pool->mutex);
+        }
+
+        pool->handler = NULL;
+        pool->jobs = NULL;
+        pool->number_of_jobs = 0;
+        pool->next_job = 0;
+
+        pthread_mutex_unlock (&pool->mutex);
+}
@@ -0,0 +1,50 @@
+/* ply-worker-pool.h - Runs batches of jobs on worker threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_WORKER_POOL_H
+#define PLY_WORKER_POOL_H
+
+#include <stdbool.h>
+
+typedef struct _ply_worker_pool ply_worker_pool_t;
+typedef void (*ply_worker_pool_job_handler_t) (void *job);
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_worker_pool_t *ply_worker_pool_new (int number_of_workers);
+void ply_worker_pool_free (ply_worker_pool_t *pool);
+int ply_worker_pool_get_number_of_workers (ply_worker_pool_t *pool);
+
+/* Sets the scheduling policy, nice level and cpu (or -1 to leave the
+ * affinity alone) of the workers.  The thread that runs jobs keeps its own.
+ */
+void ply_worker_pool_set_scheduling (ply_worker_pool_t *pool,
+                                     int                policy,
+                                     int                nice_level,
+                                     int                cpu);
+
+/* Calls handler once for each job, spread over the workers and the
+ * calling thread, and returns when all of them are done.  Workers still
+ * running a job when the caller runs out of jobs get the caller's priority
+ * until they finish it.
+ */
+void ply_worker_pool_run_jobs (ply_worker_pool_t            *pool,
+                               ply_worker_pool_job_handler_t handler,
+                               void                        **jobs,
+                               int                           number_of_jobs);
+#endif
+
+#endif /* PLY_WORKER_POOL_H */
@@ -0,0 +1,85 @@
+/* ply-logger-test.c - tests for the background log writer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ply-logger.h"
+
+#define CHUNK_SIZE 1024
+#define NUMBER_OF_CHUNKS 64
+#define TIMEOUT_IN_SECONDS 10
+
+static const char end_marker[] = "end of log\n";
+
+int
+main (int    argc,
+      char **argv)
+{
+        ply_logger_t *logger;
+        char chunk[CHUNK_SIZE];
+        char output[2 * CHUNK_SIZE * NUMBER_OF_CHUNKS];
+        ssize_t bytes_read;
+        size_t total_read;
+        int pipe_fds[2];
+        int i;
+
+        /* A writer that wedges itself takes the injections down with it */
+        alarm (TIMEOUT_IN_SECONDS);
+
+        logger = ply_logger_new ();
+        ply_logger_set_flush_policy (logger, PLY_LOGGER_FLUSH_POLICY_IN_BACKGROUND);
+
+        memset (chunk, 'x', sizeof(chunk) - 1);
+        chunk[sizeof(chunk) - 1] = '\n';
+
+        /* Well past the flush threshold, with nowhere to write yet */
+        for (i = 0; i < NUMBER_OF_CHUNKS; i++) {
+                ply_logger_inject_bytes (logger, chunk, sizeof(chunk));
+        }
+
+        if (pipe (pipe_fds) < 0) {
+                perror ("pipe");
+                return 1;
+        }
+
+        ply_logger_set_output_fd (logger, pipe_fds[1]);
+        ply_logger_inject_bytes (logger, end_marker, strlen (end_marker));
+
+        /* Flushes what is left and closes the write end */
+        ply_logger_free (logger);
+
+        total_read = 0;
+        while ((bytes_read = read (pipe_fds[0], output + total_read,
+                                   sizeof(output) - total_read)) > 0) {
+                total_read += bytes_read;
+        }
+        close (pipe_fds[0]);
+
+        if (total_read < strlen (end_marker) ||
+            memcmp (output + total_read - strlen (end_marker),
+                    end_marker, strlen (end_marker)) != 0) {
+                fprintf (stderr, "log output did not end with the last injection\n");
+                return 1;
+        }
+
+        return 0;
+}
@@ -34,6 +34,8 @@
 #include <unistd.h>
 #include <wchar.h>
 #include <paths.h>
+#include <sched.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <values.h>
 #include <locale.h>
@@ -45,11 +47,16 @@
 #include "ply-command-parser.h"
 #include "ply-boot-server.h"
 #include "ply-boot-splash.h"
+#include "ply-built-in-modules.h"
 #include "ply-device-manager.h"
 #include "ply-event-loop.h"
+#include "ply-frame-governor.h"
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
+#include "ply-statistics.h"
+#include "ply-pixel-display.h"
 #include "ply-renderer.h"
 #include "ply-terminal-session.h"
 #include "ply-trigger.h"
@@ -59,6 +66,20 @@
 #define BOOT_DURATION_FILE     PLYMOUTH_TIME_DIRECTORY "/boot-duration"
 #define SHUTDOWN_DURATION_FILE PLYMOUTH_TIME_DIRECTORY "/shutdown-duration"
 
+/* Status and system update requests are passed on to the splash at most
+ * this often, the latest one winning
+ */
+#ifndef SPLASH_UPDATE_INTERVAL
+#define SPLASH_UPDATE_INTERVAL (1.0 / 30)
+#endif
+
+/* Only the tail of the console output is kept for the splash to replay;
+ * all of it goes to the boot log
+ */
+#ifndef BOOT_BUFFER_MAX_SIZE
+#define BOOT_BUFFER_MAX_SIZE (64 * 4096)
+#endif
+
 typedef struct
 {
         const char    *keys;
@@ -98,6 +119,11 @@ typedef struct
         double                  splash_delay;
         double                  device_timeout;
 
+        int                     scheduling_policy;
+        int                     nice_level;
+        int                     normal_nice_level;
+        int                     cpu_affinity;
+
         uint32_t                no_boot_log : 1;
         uint32_t                showing_details : 1;
         uint32_t                system_initialized : 1;
@@ -110,6 +136,13 @@ typedef struct
         uint32_t                should_force_details : 1;
         uint32_t                should_force_default_splash : 1;
         uint32_t                splash_is_becoming_idle : 1;
+        uint32_t                splash_update_is_scheduled : 1;
+        uint32_t                has_pending_system_update : 1;
+        uint32_t                has_nice_level : 1;
+        uint32_t                is_using_boot_scheduling : 1;
+
+        char                   *pending_status;
+        int                     pending_system_update;
 
         char                   *override_splash_path;
         char                   *system_default_splash_path;
@@ -179,6 +212,65 @@ on_session_hangup (state_t *state)
         ply_trace ("got hang up on terminal session fd");
 }
 
+static void
+deliver_pending_updates (state_t *state)
+{
+        if (state->boot_splash != NULL) {
+                if (state->pending_status != NULL)
+                        ply_boot_splash_update_status (state->boot_splash,
+                                                       state->pending_status);
+
+                if (state->has_pending_system_update) {
+                        ply_trace ("setting system update to '%i'", state->pending_system_update);
+                        if (!ply_boot_splash_system_update (state->boot_splash,
+                                                            state->pending_system_update))
+                                ply_trace ("failed to update splash");
+                }
+        }
+
+        free (state->pending_status);
+        state->pending_status = NULL;
+        state->has_pending_system_update = false;
+}
+
+static void
+on_splash_update_timeout (state_t *state)
+{
+        state->splash_update_is_scheduled = false;
+        deliver_pending_updates (state);
+}
+
+/* Hands queued updates over right away, so they reach the splash before
+ * whatever request comes next
+ */
+static void
+send_pending_updates_to_splash (state_t *state)
+{
+        if (!state->splash_update_is_scheduled)
+                return;
+
+        ply_event_loop_stop_watching_for_timeout (state->loop,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_splash_update_timeout,
+                                                  state);
+        state->splash_update_is_scheduled = false;
+        deliver_pending_updates (state);
+}
+
+static void
+schedule_splash_update (state_t *state)
+{
+        if (state->splash_update_is_scheduled)
+                return;
+
+        ply_event_loop_watch_for_timeout (state->loop,
+                                          SPLASH_UPDATE_INTERVAL,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_splash_update_timeout,
+                                          state);
+        state->splash_update_is_scheduled = true;
+}
+
 static void
 on_update (state_t    *state,
            const char *status)
@@ -186,9 +278,13 @@ on_update (state_t    *state,
         ply_trace ("updating status to '%s'", status);
         ply_progress_status_update (state->progress,
                                     status);
-        if (state->boot_splash != NULL)
-                ply_boot_splash_update_status (state->boot_splash,
-                                               status);
+
+        if (state->boot_splash == NULL)
+                return;
+
+        free (state->pending_status);
+        state->pending_status = strdup (status);
+        schedule_splash_update (state);
 }
 
 static void
@@ -220,6 +316,8 @@ on_change_mode (state_t    *state,
                 return;
         }
 
+        send_pending_updates_to_splash (state);
+
         if (!ply_boot_splash_show (state->boot_splash, state->mode)) {
                 ply_trace ("failed to update splash");
                 return;
@@ -235,11 +333,9 @@ on_system_update (state_t *state,
                 return;
         }
 
-        ply_trace ("setting system update to '%i'", progress);
-        if (!ply_boot_splash_system_update (state->boot_splash, progress)) {
-                ply_trace ("failed to update splash");
-                return;
-        }
+        state->pending_system_update = progress;
+        state->has_pending_system_update = true;
+        schedule_splash_update (state);
 }
 
 static void
@@ -301,6 +397,7 @@ load_settings (state_t    *state,
         bool settings_loaded = false;
         char *scale_string = NULL;
         char *splash_string = NULL;
+        char *policy_string = NULL;
 
         ply_trace ("Trying to load %s", path);
         key_file = ply_key_file_new (path);
@@ -335,8 +432,43 @@ load_settings (state_t    *state,
                 free (scale_string);
         }
 
+        if (ply_key_file_get_bool (key_file, "Daemon", "ParallelRendering"))
+                ply_pixel_display_set_parallel_rendering (true);
+
+        if (state->scheduling_policy < 0)
+                policy_string = ply_key_file_get_value (key_file, "Daemon", "SchedulingPolicy");
+
+        if (policy_string != NULL) {
+                if (strcmp (policy_string, "idle") == 0)
+                        state->scheduling_policy = SCHED_IDLE;
+                else if (strcmp (policy_string, "batch") == 0)
+                        state->scheduling_policy = SCHED_BATCH;
+                else if (strcmp (policy_string, "other") == 0)
+                        state->scheduling_policy = SCHED_OTHER;
+
+                if (state->scheduling_policy >= 0)
+                        ply_trace ("Scheduling policy is set to %s", policy_string);
+                else
+                        ply_trace ("Unknown scheduling policy '%s'", policy_string);
+        }
+
+        if (!state->has_nice_level && ply_key_file_has_key (key_file, "Daemon", "NiceLevel")) {
+                state->nice_level = CLAMP ((int) ply_key_file_get_long (key_file, "Daemon", "NiceLevel", 0),
+                                           -20, 19);
+                state->has_nice_level = true;
+                ply_trace ("Nice level is set to %d", state->nice_level);
+        }
+
+        if (state->cpu_affinity < 0) {
+                state->cpu_affinity = (int) ply_key_file_get_long (key_file, "Daemon", "CPUAffinity", -1);
+
+                if (state->cpu_affinity >= 0)
+                        ply_trace ("CPU affinity is set to %d", state->cpu_affinity);
+        }
+
         settings_loaded = true;
 out:
+        free (policy_string);
         free (splash_string);
         ply_key_file_free (key_file);
 
@@ -1173,6 +1305,7 @@ load_devices (state_t                   *state,
                                           (ply_text_display_removed_handler_t)
                                           on_text_display_removed,
                                           state);
+        ply_phase_tracer_mark (PLY_PHASE_DEVICES_WATCHED);
 
         if (ply_device_manager_has_serial_consoles (state->device_manager)) {
                 state->should_force_details = true;
@@ -1183,6 +1316,7 @@ static void
 quit_splash (state_t *state)
 {
         ply_trace ("quitting splash");
+        send_pending_updates_to_splash (state);
         if (state->boot_splash != NULL) {
                 ply_trace ("freeing splash");
                 ply_boot_splash_free (state->boot_splash);
@@ -1215,6 +1349,7 @@ hide_splash (state_t *state)
         if (state->boot_splash == NULL)
                 return;
 
+        send_pending_updates_to_splash (state);
         ply_boot_splash_hide (state->boot_splash);
 
         if (state->local_console_terminal != NULL)
@@ -1245,9 +1380,27 @@ on_hide_splash (state_t *state)
         dump_details_and_quit_splash (state);
 }
 
+/* Goes to the error log rather than the trace, so that the report
+ * shows up with plymouth.profile-handlers alone */
+static void
+write_handler_profile (state_t *state)
+{
+        char *report;
+
+        report = ply_event_loop_get_handler_profile_report (state->loop, 10);
+
+        if (report == NULL)
+                return;
+
+        ply_error_without_new_line ("slowest event loop handlers:\n%s", report);
+        free (report);
+}
+
 static void
 quit_program (state_t *state)
 {
+        write_handler_profile (state);
+
         ply_trace ("cleaning up devices");
         ply_device_manager_free (state->device_manager);
 
@@ -1459,6 +1612,80 @@ on_has_active_vt (state_t *state)
                 return false;
 }
 
+static long
+get_resident_set_size (void)
+{
+        unsigned long size, resident_pages;
+        FILE *fp;
+        int number_of_fields;
+
+        fp = fopen ("/proc/self/statm", "re");
+        if (fp == NULL)
+                return -1;
+
+        number_of_fields = fscanf (fp, "%lu %lu", &size, &resident_pages);
+        fclose (fp);
+
+        if (number_of_fields != 2)
+                return -1;
+
+        return resident_pages * sysconf (_SC_PAGESIZE);
+}
+
+static char *
+on_statistics (state_t *state)
+{
+        ply_buffer_t *buffer;
+        char *statistics;
+        int i;
+
+        buffer = ply_buffer_new ();
+
+        for (i = 0; i < PLY_NUMBER_OF_STATISTICS; i++) {
+                ply_buffer_append (buffer, "%s %llu\n",
+                                   ply_statistics_get_name (i),
+                                   (unsigned long long) ply_statistics_get (i));
+        }
+
+        ply_buffer_append (buffer, "pending-timeouts %d\n",
+                           ply_event_loop_get_number_of_pending_timeouts (state->loop));
+        ply_buffer_append (buffer, "boot-buffer-size %zu\n",
+                           ply_buffer_get_size (state->boot_buffer));
+        ply_buffer_append (buffer, "resident-set-size %ld\n",
+                           get_resident_set_size ());
+
+        if (state->device_manager != NULL) {
+                ply_list_t *displays;
+                ply_list_node_t *node;
+
+                i = 0;
+                displays = ply_device_manager_get_pixel_displays (state->device_manager);
+                ply_list_foreach (displays, node) {
+                        ply_pixel_display_t *display = ply_list_node_get_data (node);
+                        unsigned long number_of_frames;
+                        double average_frame_time, p99_frame_time;
+
+                        ply_pixel_display_get_frame_statistics (display,
+                                                                &number_of_frames,
+                                                                &average_frame_time,
+                                                                &p99_frame_time);
+
+                        ply_buffer_append (buffer, "head%d-size %lux%lu\n", i,
+                                           ply_pixel_display_get_width (display),
+                                           ply_pixel_display_get_height (display));
+                        ply_buffer_append (buffer, "head%d-frames %lu\n", i, number_of_frames);
+                        ply_buffer_append (buffer, "head%d-average-frame-time %.6f\n", i, average_frame_time);
+                        ply_buffer_append (buffer, "head%d-p99-frame-time %.6f\n", i, p99_frame_time);
+                        i++;
+                }
+        }
+
+        statistics = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return statistics;
+}
+
 static ply_boot_server_t *
 start_boot_server (state_t *state)
 {
@@ -1485,6 +1712,7 @@ start_boot_server (state_t *state)
                                       (ply_boot_server_quit_handler_t) on_quit,
                                       (ply_boot_server_has_active_vt_handler_t) on_has_active_vt,
                                       (ply_boot_server_reload_handler_t) on_reload,
+                                      (ply_boot_server_statistics_handler_t) on_statistics,
                                       state);
 
         if (!ply_boot_server_listen (server)) {
@@ -1513,9 +1741,58 @@ validate_input (state_t    *state,
 }
 
 
+static void
+check_scheduling_settings (state_t *state)
+{
+        if (state->scheduling_policy < 0 && !state->has_nice_level && state->cpu_affinity < 0)
+                return;
+
+        if (ply_pixel_display_get_parallel_rendering ())
+                return;
+
+        ply_error ("plymouthd: SchedulingPolicy, NiceLevel and CPUAffinity only affect "
+                   "render workers, which need ParallelRendering=true");
+}
+
+/* Animations run under the configured boot scheduling policy, so they only
+ * get CPU time the rest of boot isn't using.  Requests, input and the event
+ * loop share the main thread, which has to keep its normal priority, so the
+ * policy only goes to the render workers, and animation timers just tick
+ * less often.  While a prompt is up, go back to normal scheduling so typing
+ * stays responsive.
+ */
+static void
+update_scheduling (state_t *state)
+{
+        bool should_use_boot_scheduling;
+
+        if (state->scheduling_policy < 0 && !state->has_nice_level && state->cpu_affinity < 0)
+                return;
+
+        should_use_boot_scheduling = ply_list_get_length (state->entry_triggers) == 0;
+
+        if (should_use_boot_scheduling == state->is_using_boot_scheduling)
+                return;
+
+        if (should_use_boot_scheduling) {
+                ply_trace ("using boot scheduling policy for animations");
+                ply_pixel_display_set_render_scheduling (state->scheduling_policy >= 0 ? state->scheduling_policy : SCHED_OTHER,
+                                                         state->has_nice_level ? state->nice_level : state->normal_nice_level,
+                                                         state->cpu_affinity);
+        } else {
+                ply_trace ("prompting for input, using normal scheduling policy");
+                ply_pixel_display_set_render_scheduling (SCHED_OTHER, state->normal_nice_level, -1);
+        }
+        ply_frame_governor_set_background (should_use_boot_scheduling);
+
+        state->is_using_boot_scheduling = should_use_boot_scheduling;
+}
+
 static void
 update_display (state_t *state)
 {
+        update_scheduling (state);
+
         if (!state->boot_splash) return;
 
         ply_list_node_t *node;
@@ -1774,6 +2051,8 @@ load_built_in_theme (state_t *state)
                 return NULL;
         }
 
+        ply_phase_tracer_mark (PLY_PHASE_SPLASH_LOADED);
+
         ply_trace ("attaching plugin to event loop");
         ply_boot_splash_attach_to_event_loop (splash, state->loop);
 
@@ -1806,6 +2085,8 @@ load_theme (state_t    *state,
                 return NULL;
         }
 
+        ply_phase_tracer_mark (PLY_PHASE_SPLASH_LOADED);
+
         ply_trace ("attaching plugin to event loop");
         ply_boot_splash_attach_to_event_loop (splash, state->loop);
 
@@ -1840,6 +2121,8 @@ show_theme (state_t    *state,
                 return NULL;
         }
 
+        ply_phase_tracer_mark (PLY_PHASE_SPLASH_SHOWN);
+
         ply_device_manager_activate_keyboards (state->device_manager);
 
         return splash;
@@ -1857,7 +2140,7 @@ attach_to_running_session (state_t *state)
         should_be_redirected = !state->no_boot_log;
 
         if (should_be_redirected)
-                flags |= PLY_TERMINAL_SESSION_FLAGS_REDIRECT_CONSOLE;
+                flags |= PLY_TERMINAL_SESSION_FLAGS_REDIRECT_CONSOLE | PLY_TERMINAL_SESSION_FLAGS_SPLICE_OUTPUT;
 
         if (state->session == NULL) {
                 ply_trace ("creating new terminal session");
@@ -2179,6 +2462,13 @@ start_plymouthd_fd_escrow (void)
         }
 }
 
+static void
+on_profile_signal (state_t *state)
+{
+        ply_event_loop_set_handler_profiling (state->loop, true);
+        write_handler_profile (state);
+}
+
 static void
 on_term_signal (state_t *state)
 {
@@ -2235,10 +2525,13 @@ main (int    argc,
         ply_device_manager_flags_t device_manager_flags = PLY_DEVICE_MANAGER_FLAGS_NONE;
 
         state.start_time = ply_get_timestamp ();
+        ply_phase_tracer_mark (PLY_PHASE_DAEMON_STARTED);
         state.command_parser = ply_command_parser_new ("plymouthd", "Splash server");
 
         state.loop = ply_event_loop_get_default ();
 
+        ply_set_built_in_modules (ply_built_in_modules);
+
         /* Initialize the translations if they are available (!initrd) */
         if (ply_file_exists (PLYMOUTH_LOCALE_DIRECTORY "/nl/LC_MESSAGES/plymouth.mo"))
                 setlocale (LC_ALL, "");
@@ -2385,6 +2678,16 @@ main (int    argc,
         ply_event_loop_watch_signal (state.loop, SIGTERM,
                                      (ply_event_handler_t) on_term_signal, &state);
 
+        /* Time every event loop handler while debugging. SIGUSR1 writes
+         * the slowest ones to the error log, and starts timing if it
+         * wasn't already on */
+        if (ply_is_tracing () ||
+            ply_kernel_command_line_has_argument ("plymouth.profile-handlers"))
+                ply_event_loop_set_handler_profiling (state.loop, true);
+
+        ply_event_loop_watch_signal (state.loop, SIGUSR1,
+                                     (ply_event_handler_t) on_profile_signal, &state);
+
         state.boot_server = start_boot_server (&state);
 
         if (state.boot_server == NULL) {
@@ -2396,6 +2699,7 @@ main (int    argc,
         }
 
         state.boot_buffer = ply_buffer_new ();
+        ply_buffer_set_max_size (state.boot_buffer, BOOT_BUFFER_MAX_SIZE);
 
         if (attach_to_session) {
                 state.should_be_attached = attach_to_session;
@@ -2410,6 +2714,9 @@ main (int    argc,
         state.progress = ply_progress_new ();
         state.splash_delay = NAN;
         state.device_timeout = NAN;
+        state.scheduling_policy = -1;
+        state.cpu_affinity = -1;
+        state.normal_nice_level = getpriority (PRIO_PROCESS, 0);
 
         ply_progress_load_cache (state.progress,
                                  get_cache_file_for_mode (state.mode));
@@ -2426,6 +2733,14 @@ main (int    argc,
         find_override_splash (&state);
         find_system_default_splash (&state);
         find_distribution_default_splash (&state);
+        ply_phase_tracer_mark (PLY_PHASE_SETTINGS_LOADED);
+
+        if (ply_kernel_command_line_has_argument ("plymouth.parallel-rendering"))
+                ply_pixel_display_set_parallel_rendering (true);
+
+        check_scheduling_settings (&state);
+
+        update_scheduling (&state);
 
         if (ply_kernel_command_line_has_argument ("plymouth.ignore-serial-consoles") ||
             ignore_serial_consoles == true)
@@ -231,16 +231,18 @@ static void
 draw_bitmap (ply_label_plugin_control_t *label,
              uint32_t                   *target,
              ply_rectangle_t             target_size,
+             ply_rectangle_t            *clip_area,
              FT_Bitmap                  *source,
              FT_Int                      x_start,
              FT_Int                      y_start)
 {
         FT_Int x, y, xs, ys;
-        FT_Int x_end = MIN (x_start + source->width, target_size.width);
-        FT_Int y_end = MIN (y_start + source->rows, target_size.height);
+        FT_Int x_begin = MAX (x_start, clip_area->x);
+        FT_Int y_begin = MAX (y_start, clip_area->y);
+        FT_Int x_end = MIN (x_start + (FT_Int) source->width, clip_area->x + (FT_Int) clip_area->width);
+        FT_Int y_end = MIN (y_start + (FT_Int) source->rows, clip_area->y + (FT_Int) clip_area->height);
 
-        if ((uint32_t) x_start >= target_size.width ||
-            (uint32_t) y_start >= target_size.height)
+        if (x_begin >= x_end || y_begin >= y_end)
                 return;
 
         uint8_t rs, gs, bs, rd, gd, bd, ad;
@@ -248,8 +250,8 @@ draw_bitmap (ply_label_plugin_control_t *label,
         gs = 255 * label->green;
         bs = 255 * label->blue;
 
-        for (y = y_start, ys = 0; y < y_end; ++y, ++ys) {
-                for (x = x_start, xs = 0; x < x_end; ++x, ++xs) {
+        for (y = y_begin, ys = y_begin - y_start; y < y_end; ++y, ++ys) {
+                for (x = x_begin, xs = x_begin - x_start; x < x_end; ++x, ++xs) {
                         float alpha = label->alpha *
                                       (source->buffer[xs + source->pitch * ys] / 255.0f);
                         float invalpha = 1.0f - alpha;
@@ -286,13 +288,12 @@ draw_control (ply_label_plugin_control_t *label,
         FT_GlyphSlot slot;
         const char *cur_c;
         uint32_t *target;
-        ply_rectangle_t target_size;
+        ply_rectangle_t target_size, draw_area, clip_area;
 
         if (label->is_hidden)
                 return;
 
-        /* Check for overlap.
-         * TODO: Don't redraw everything if only a part should be drawn! */
+        /* Check for overlap. */
         if (label->area.x > x + (long) width || label->area.y > y + (long) height
             || label->area.x + (long) label->area.width < x
             || label->area.y + (long) label->area.height < y)
@@ -308,6 +309,15 @@ draw_control (ply_label_plugin_control_t *label,
         if (target_size.height == 0)
                 return; /* This happens sometimes. */
 
+        /* Only touch pixels inside the area being drawn */
+        draw_area.x = x;
+        draw_area.y = y;
+        draw_area.width = width;
+        draw_area.height = height;
+        target_size.x = 0;
+        target_size.y = 0;
+        ply_rectangle_intersect (&draw_area, &target_size, &clip_area);
+
         /* 64ths of a pixel */
         pen.y = label->area.y << 6;
 
@@ -343,7 +353,7 @@ draw_control (ply_label_plugin_control_t *label,
                         } else {
                                 positiveBearingX = slot->bitmap_left;
                         }
-                        draw_bitmap (label, target, target_size, &slot->bitmap,
+                        draw_bitmap (label, target, target_size, &clip_area, &slot->bitmap,
                                      (pen.x >> 6) + positiveBearingX,
                                      (pen.y >> 6) - slot->bitmap_top);
 
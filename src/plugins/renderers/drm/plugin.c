@@ -30,6 +30,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
 #include <stdbool.h>
@@ -45,6 +46,7 @@
 
 #include <drm.h>
 #include <drm_mode.h>
+#include <drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
@@ -68,27 +70,60 @@
 /* For builds with libdrm < 2.4.89 */
 #ifndef DRM_MODE_ROTATE_0
 #define DRM_MODE_ROTATE_0 (1 << 0)
+#define DRM_MODE_ROTATE_90 (1 << 1)
+#define DRM_MODE_ROTATE_180 (1 << 2)
+#define DRM_MODE_ROTATE_270 (1 << 3)
 #endif
 
+/* Software rotation copies the shadow buffer to the scan out buffer in
+ * square blocks of this many pixels, so the transposed writes stay in cache.
+ */
+#define ROTATION_BLOCK_SIZE 16
+
 struct _ply_renderer_head
 {
-        ply_renderer_backend_t *backend;
-        ply_pixel_buffer_t     *pixel_buffer;
-        ply_rectangle_t         area;
+        ply_renderer_backend_t     *backend;
+        ply_pixel_buffer_t         *pixel_buffer;
+        ply_rectangle_t             area;          /* scan out size, in device pixels */
+        ply_rectangle_t             shadow_area;   /* upright size, in device pixels */
+
+        unsigned long               row_stride;
+
+        ply_array_t                *connector_ids;
+        drmModeModeInfo             connector0_mode;
+
+        uint32_t                    controller_id;
+        uint32_t                    console_buffer_id;
+        uint32_t                    scan_out_buffer_id;
+        bool                        scan_out_buffer_needs_reset;
+
+        ply_pixel_buffer_rotation_t rotation;
+        bool                        uses_hw_rotation;
+        uint64_t                    hw_rotation;
+        uint32_t                    primary_plane_id;
+        uint32_t                    rotation_prop_id;
 
-        unsigned long           row_stride;
+        int                         gamma_size;
+        uint16_t                   *gamma;
 
-        ply_array_t            *connector_ids;
-        drmModeModeInfo         connector0_mode;
+        int                         controller_index;
+        ply_list_t                 *sprites;
+
+        int                         device_scale;
+        ply_renderer_head_t        *clone_source;  /* head whose shadow buffer this one shows */
+};
 
-        uint32_t                controller_id;
-        uint32_t                console_buffer_id;
-        uint32_t                scan_out_buffer_id;
-        bool                    scan_out_buffer_needs_reset;
-        bool                    uses_hw_rotation;
+struct _ply_renderer_sprite
+{
+        ply_renderer_head_t *head;            /* NULL once the head is gone */
+        ply_pixel_buffer_t  *pixel_buffer;
+        ply_rectangle_t      area;            /* on the head, in device pixels */
 
-        int                     gamma_size;
-        uint16_t               *gamma;
+        uint32_t             plane_id;
+        uint32_t             buffer_id;
+        unsigned long        buffer_width;
+        unsigned long        buffer_height;
+        unsigned long        row_stride;
 };
 
 struct _ply_renderer_input_source
@@ -133,6 +168,9 @@ typedef struct
         bool                        connected;
         bool                        uses_hw_rotation;
         bool                        is_non_desktop;
+        uint64_t                    hw_rotation;
+        uint32_t                    primary_plane_id;
+        uint32_t                    rotation_prop_id;
 } ply_output_t;
 
 struct _ply_renderer_backend
@@ -147,14 +185,25 @@ struct _ply_renderer_backend
 
         ply_renderer_input_source_t input_source;
         ply_list_t                 *heads;
+        ply_list_t                 *unique_heads;  /* heads without the clones */
         ply_hashtable_t            *heads_by_controller_id;
 
         ply_hashtable_t            *output_buffers;
 
+        /* flush_head runs on worker threads when rendering in parallel,
+         * this guards everything but copying the pixels */
+        pthread_mutex_t             flush_mutex;
+
         ply_output_t               *outputs;
         int                         outputs_len;
         int                         connected_count;
 
+        /* Connection state each connector had at its last full (EDID/DDC)
+         * probe.  probe_connectors uses it off the main thread, so it's
+         * guarded by probe_mutex */
+        ply_hashtable_t            *probed_connector_states;
+        pthread_mutex_t             probe_mutex;
+
         int32_t                     dither_red;
         int32_t                     dither_green;
         int32_t                     dither_blue;
@@ -162,6 +211,9 @@ struct _ply_renderer_backend
         uint32_t                    is_active : 1;
         uint32_t                    requires_explicit_flushing : 1;
         uint32_t                    input_source_is_open : 1;
+        uint32_t                    sprite_planes_disabled : 1;
+        uint32_t                    should_probe_connectors : 1;
+        uint32_t                    is_probed : 1;
 
         int                         panel_width;
         int                         panel_height;
@@ -175,8 +227,12 @@ ply_renderer_plugin_interface_t *ply_renderer_backend_get_interface (void);
 static bool using_input_device (ply_renderer_input_source_t *backend);
 static bool open_input_source (ply_renderer_backend_t      *backend,
                                ply_renderer_input_source_t *input_source);
-static void flush_head (ply_renderer_backend_t *backend,
+static bool flush_head (ply_renderer_backend_t *backend,
                         ply_renderer_head_t    *head);
+static bool ply_renderer_sprite_show (ply_renderer_backend_t *backend,
+                                      ply_renderer_sprite_t  *sprite);
+static void ply_renderer_sprite_flush (ply_renderer_backend_t *backend,
+                                       ply_renderer_sprite_t  *sprite);
 
 static bool
 ply_renderer_buffer_map (ply_renderer_backend_t *backend,
@@ -294,10 +350,11 @@ get_buffer_from_id (ply_renderer_backend_t *backend,
 }
 
 static uint32_t
-create_output_buffer (ply_renderer_backend_t *backend,
-                      unsigned long           width,
-                      unsigned long           height,
-                      unsigned long          *row_stride)
+create_output_buffer_with_depth (ply_renderer_backend_t *backend,
+                                 unsigned long           width,
+                                 unsigned long           height,
+                                 int                     depth,
+                                 unsigned long          *row_stride)
 {
         ply_renderer_buffer_t *buffer;
 
@@ -309,7 +366,7 @@ create_output_buffer (ply_renderer_backend_t *backend,
         }
 
         if (drmModeAddFB (backend->device_fd, width, height,
-                          24, 32, buffer->row_stride, buffer->handle,
+                          depth, 32, buffer->row_stride, buffer->handle,
                           &buffer->id) != 0) {
                 ply_trace ("Could not set up GEM object as frame buffer: %m");
                 ply_renderer_buffer_free (backend, buffer);
@@ -326,6 +383,15 @@ create_output_buffer (ply_renderer_backend_t *backend,
         return buffer->id;
 }
 
+static uint32_t
+create_output_buffer (ply_renderer_backend_t *backend,
+                      unsigned long           width,
+                      unsigned long           height,
+                      unsigned long          *row_stride)
+{
+        return create_output_buffer_with_depth (backend, width, height, 24, row_stride);
+}
+
 static bool
 map_buffer (ply_renderer_backend_t *backend,
             uint32_t                buffer_id)
@@ -410,14 +476,17 @@ get_primary_plane_rotation (ply_renderer_backend_t *backend,
                             uint32_t                controller_id,
                             int                    *primary_id_ret,
                             int                    *rotation_prop_id_ret,
-                            uint64_t               *rotation_ret)
+                            uint64_t               *rotation_ret,
+                            uint64_t               *supported_rotations_ret)
 {
         drmModeObjectPropertiesPtr plane_props;
         drmModePlaneResPtr plane_resources;
         drmModePropertyPtr prop;
         drmModePlanePtr plane;
         uint64_t rotation = 0;
+        uint64_t supported_rotations = 0;
         uint32_t i, j;
+        int k;
         int rotation_prop_id = -1;
         int primary_id = -1;
         int err;
@@ -462,6 +531,12 @@ get_primary_plane_rotation (ply_renderer_backend_t *backend,
                         if (strcmp (prop->name, "rotation") == 0) {
                                 rotation_prop_id = plane_props->props[j];
                                 rotation = plane_props->prop_values[j];
+
+                                /* The enum values of a bitmask property are bit numbers */
+                                supported_rotations = 0;
+                                for (k = 0; (prop->flags & DRM_MODE_PROP_BITMASK) && k < prop->count_enums; k++) {
+                                        supported_rotations |= 1ULL << prop->enums[k].value;
+                                }
                         }
 
                         drmModeFreeProperty (prop);
@@ -483,6 +558,7 @@ get_primary_plane_rotation (ply_renderer_backend_t *backend,
                 *primary_id_ret = primary_id;
                 *rotation_prop_id_ret = rotation_prop_id;
                 *rotation_ret = rotation;
+                *supported_rotations_ret = supported_rotations;
                 return true;
         }
 
@@ -511,6 +587,31 @@ connector_orientation_prop_to_rotation (drmModePropertyPtr prop,
         return PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
 }
 
+/* DRM rotates counter clockwise, our rotations are the correction to apply */
+static uint64_t
+rotation_to_drm_rotation (ply_pixel_buffer_rotation_t rotation)
+{
+        switch (rotation) {
+        case PLY_PIXEL_BUFFER_ROTATE_UPRIGHT:
+                return DRM_MODE_ROTATE_0;
+        case PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN:
+                return DRM_MODE_ROTATE_180;
+        case PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE:
+                return DRM_MODE_ROTATE_270;
+        case PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE:
+                return DRM_MODE_ROTATE_90;
+        }
+
+        return DRM_MODE_ROTATE_0;
+}
+
+static bool
+rotation_swaps_axes (ply_pixel_buffer_rotation_t rotation)
+{
+        return rotation == PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE ||
+               rotation == PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE;
+}
+
 static void
 ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
                                        drmModeConnector       *connector,
@@ -518,7 +619,7 @@ ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
 {
         int i, primary_id, rotation_prop_id;
         drmModePropertyPtr prop;
-        uint64_t rotation;
+        uint64_t rotation, supported_rotations;
 
         output->rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
         output->tiled = false;
@@ -549,19 +650,37 @@ ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
                 drmModeFreeProperty (prop);
         }
 
+        if (output->rotation == PLY_PIXEL_BUFFER_ROTATE_UPRIGHT ||
+            !get_primary_plane_rotation (backend, output->controller_id,
+                                         &primary_id, &rotation_prop_id,
+                                         &rotation, &supported_rotations))
+                return;
+
+        output->primary_plane_id = primary_id;
+        output->rotation_prop_id = rotation_prop_id;
+
         /* If the firmware setup the plane to use hw 180° rotation, then we keep
          * the hw rotation. This avoids a flicker and avoids the splash turning
          * upside-down when mutter turns hw-rotation back on and then fades from
          * the splash to the login screen.
          */
         if (output->rotation == PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN &&
-            get_primary_plane_rotation (backend, output->controller_id,
-                                        &primary_id, &rotation_prop_id,
-                                        &rotation) &&
             rotation == DRM_MODE_ROTATE_180) {
                 ply_trace ("Keeping hw 180° rotation");
                 output->rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
                 output->uses_hw_rotation = true;
+                output->hw_rotation = DRM_MODE_ROTATE_180;
+                return;
+        }
+
+        /* Otherwise let the primary plane do the rotation if it can, so that
+         * the shadow buffer stays upright and can be copied out as is.
+         */
+        if (supported_rotations & rotation_to_drm_rotation (output->rotation)) {
+                output->uses_hw_rotation = true;
+                output->hw_rotation = rotation_to_drm_rotation (output->rotation);
+                ply_trace ("Using hw rotation 0x%llx on primary plane %d",
+                           (unsigned long long) output->hw_rotation, primary_id);
         }
 }
 
@@ -591,6 +710,21 @@ ply_renderer_head_add_connector (ply_renderer_head_t *head,
         return true;
 }
 
+static void
+ply_renderer_head_create_pixel_buffer (ply_renderer_head_t *head)
+{
+        /* The shadow buffer is always upright, rotation is either done by the
+         * primary plane or while copying to the scan out buffer in flush_head.
+         */
+        head->pixel_buffer = ply_pixel_buffer_new (head->shadow_area.width, head->shadow_area.height);
+        ply_pixel_buffer_set_device_scale (head->pixel_buffer, head->device_scale);
+
+        ply_pixel_buffer_fill_with_color (head->pixel_buffer, NULL,
+                                          0.0, 0.0, 0.0, 1.0);
+        /* Delay flush till first actual draw */
+        ply_region_clear (ply_pixel_buffer_get_updated_areas (head->pixel_buffer));
+}
+
 static ply_renderer_head_t *
 ply_renderer_head_new (ply_renderer_backend_t *backend,
                        ply_output_t           *output,
@@ -607,13 +741,33 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         head->controller_id = output->controller_id;
         head->console_buffer_id = console_buffer_id;
         head->connector0_mode = output->mode;
+        head->rotation = output->rotation;
         head->uses_hw_rotation = output->uses_hw_rotation;
+        head->hw_rotation = output->hw_rotation;
+        head->primary_plane_id = output->primary_plane_id;
+        head->rotation_prop_id = output->rotation_prop_id;
+        head->sprites = ply_list_new ();
+
+        /* Planes list the controllers they work with by index */
+        head->controller_index = -1;
+        for (i = 0; backend->resources != NULL && i < backend->resources->count_crtcs; i++) {
+                if (backend->resources->crtcs[i] == output->controller_id) {
+                        head->controller_index = i;
+                        break;
+                }
+        }
 
         head->area.x = 0;
         head->area.y = 0;
         head->area.width = output->mode.hdisplay;
         head->area.height = output->mode.vdisplay;
 
+        head->shadow_area = head->area;
+        if (rotation_swaps_axes (head->rotation)) {
+                head->shadow_area.width = head->area.height;
+                head->shadow_area.height = head->area.width;
+        }
+
         if (gamma_size) {
                 head->gamma_size = gamma_size;
                 head->gamma = malloc (gamma_size * 3 * sizeof(uint16_t));
@@ -629,14 +783,9 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         ply_renderer_head_add_connector (head, output);
         assert (ply_array_get_size (head->connector_ids) > 0);
 
-        head->pixel_buffer = ply_pixel_buffer_new_with_device_rotation (head->area.width, head->area.height, output->rotation);
-        ply_pixel_buffer_set_device_scale (head->pixel_buffer, output->device_scale);
-
         ply_trace ("Creating %ldx%ld renderer head", head->area.width, head->area.height);
-        ply_pixel_buffer_fill_with_color (head->pixel_buffer, NULL,
-                                          0.0, 0.0, 0.0, 1.0);
-        /* Delay flush till first actual draw */
-        ply_region_clear (ply_pixel_buffer_get_updated_areas (head->pixel_buffer));
+        head->device_scale = output->device_scale;
+        ply_renderer_head_create_pixel_buffer (head);
 
         /*
          * On devices without a builtin display, use the info from the first
@@ -662,30 +811,128 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         return head;
 }
 
+static void
+ply_renderer_sprite_hide (ply_renderer_backend_t *backend,
+                          ply_renderer_sprite_t  *sprite)
+{
+        drmModeSetPlane (backend->device_fd, sprite->plane_id,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+/* Takes the sprite off its plane and frees its frame buffer.  The sprite
+ * itself stays around until destroy_sprite, since whoever created it may
+ * still be drawing to it.
+ */
+static void
+ply_renderer_sprite_release (ply_renderer_backend_t *backend,
+                             ply_renderer_sprite_t  *sprite)
+{
+        if (sprite->head == NULL)
+                return;
+
+        if (backend->is_active)
+                ply_renderer_sprite_hide (backend, sprite);
+
+        unmap_buffer (backend, sprite->buffer_id);
+        destroy_output_buffer (backend, sprite->buffer_id);
+        sprite->buffer_id = 0;
+        sprite->head = NULL;
+}
+
 static void
 ply_renderer_head_free (ply_renderer_head_t *head)
 {
+        ply_list_node_t *node;
+
         ply_trace ("freeing %ldx%ld renderer head", head->area.width, head->area.height);
-        ply_pixel_buffer_free (head->pixel_buffer);
+        if (head->clone_source == NULL)
+                ply_pixel_buffer_free (head->pixel_buffer);
+
+        ply_list_foreach (head->sprites, node) {
+                ply_renderer_sprite_t *sprite = ply_list_node_get_data (node);
+                ply_renderer_sprite_release (head->backend, sprite);
+        }
+        ply_list_free (head->sprites);
 
         ply_array_free (head->connector_ids);
         free (head->gamma);
         free (head);
 }
 
+static bool
+get_plane_rotation (ply_renderer_backend_t *backend,
+                    uint32_t                plane_id,
+                    uint32_t                rotation_prop_id,
+                    uint64_t               *rotation)
+{
+        drmModeObjectPropertiesPtr plane_props;
+        bool found = false;
+        uint32_t i;
+
+        plane_props = drmModeObjectGetProperties (backend->device_fd,
+                                                  plane_id,
+                                                  DRM_MODE_OBJECT_PLANE);
+        if (!plane_props)
+                return false;
+
+        for (i = 0; i < plane_props->count_props; i++) {
+                if (plane_props->props[i] == rotation_prop_id) {
+                        *rotation = plane_props->prop_values[i];
+                        found = true;
+                        break;
+                }
+        }
+
+        drmModeFreeObjectProperties (plane_props);
+
+        return found;
+}
+
+static bool
+ply_renderer_head_set_plane_rotation (ply_renderer_backend_t *backend,
+                                      ply_renderer_head_t    *head)
+{
+        uint64_t rotation;
+        int err;
+
+        if (get_plane_rotation (backend, head->primary_plane_id,
+                                head->rotation_prop_id, &rotation) &&
+            rotation == head->hw_rotation)
+                return true;
+
+        /* With 90° rotation the scan out buffer has its width and height
+         * swapped, which does not fit the buffer that is being scanned out
+         * right now, so turn the controller off while switching.
+         */
+        if (rotation_swaps_axes (head->rotation))
+                drmModeSetCrtc (backend->device_fd, head->controller_id,
+                                0, 0, 0, NULL, 0, NULL);
+
+        err = drmModeObjectSetProperty (backend->device_fd,
+                                        head->primary_plane_id,
+                                        DRM_MODE_OBJECT_PLANE,
+                                        head->rotation_prop_id,
+                                        head->hw_rotation);
+        ply_trace ("Set rotation 0x%llx on primary plane %u result %d",
+                   (unsigned long long) head->hw_rotation,
+                   head->primary_plane_id, err);
+
+        return err == 0;
+}
+
 static void
 ply_renderer_head_clear_plane_rotation (ply_renderer_backend_t *backend,
                                         ply_renderer_head_t    *head)
 {
         int primary_id, rotation_prop_id, err;
-        uint64_t rotation;
+        uint64_t rotation, supported_rotations;
 
         if (head->uses_hw_rotation)
                 return;
 
         if (get_primary_plane_rotation (backend, head->controller_id,
                                         &primary_id, &rotation_prop_id,
-                                        &rotation) &&
+                                        &rotation, &supported_rotations) &&
             rotation != DRM_MODE_ROTATE_0) {
                 err = drmModeObjectSetProperty (backend->device_fd,
                                                 primary_id,
@@ -724,6 +971,12 @@ ply_renderer_head_set_scan_out_buffer (ply_renderer_backend_t *backend,
                 head->gamma = NULL;
         }
 
+        if (head->uses_hw_rotation && !ply_renderer_head_set_plane_rotation (backend, head)) {
+                ply_trace ("Couldn't set rotation for head with controller id %d",
+                           head->controller_id);
+                return false;
+        }
+
         /* Tell the controller to use the allocated scan out buffer on each connectors
          */
         if (drmModeSetCrtc (backend->device_fd, head->controller_id, buffer_id,
@@ -741,15 +994,23 @@ static bool
 ply_renderer_head_map (ply_renderer_backend_t *backend,
                        ply_renderer_head_t    *head)
 {
+        ply_rectangle_t *buffer_area;
+
         assert (backend != NULL);
         assert (backend->device_fd >= 0);
         assert (backend != NULL);
 
         assert (head != NULL);
 
+        /* A hw rotated plane scans out the upright buffer */
+        if (head->uses_hw_rotation)
+                buffer_area = &head->shadow_area;
+        else
+                buffer_area = &head->area;
+
         ply_trace ("Creating buffer for %ldx%ld renderer head", head->area.width, head->area.height);
         head->scan_out_buffer_id = create_output_buffer (backend,
-                                                         head->area.width, head->area.height,
+                                                         buffer_area->width, buffer_area->height,
                                                          &head->row_stride);
 
         if (head->scan_out_buffer_id == 0)
@@ -777,13 +1038,108 @@ ply_renderer_head_unmap (ply_renderer_backend_t *backend,
         head->scan_out_buffer_id = 0;
 }
 
+static bool
+heads_can_share_pixel_buffer (ply_renderer_head_t *head,
+                              ply_renderer_head_t *other_head)
+{
+        return head->area.width == other_head->area.width &&
+               head->area.height == other_head->area.height &&
+               head->rotation == other_head->rotation &&
+               head->device_scale == other_head->device_scale;
+}
+
+static bool
+ply_renderer_head_has_clones (ply_renderer_backend_t *backend,
+                              ply_renderer_head_t    *head)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (backend->heads, node) {
+                ply_renderer_head_t *other_head = ply_list_node_get_data (node);
+
+                if (other_head->clone_source == head)
+                        return true;
+        }
+
+        return false;
+}
+
+static void
+ply_renderer_head_stop_cloning (ply_renderer_head_t *head)
+{
+        ply_trace ("%ldx%ld renderer head on controller %u no longer mirrors controller %u",
+                   head->area.width, head->area.height,
+                   head->controller_id, head->clone_source->controller_id);
+
+        head->clone_source = NULL;
+        ply_renderer_head_create_pixel_buffer (head);
+}
+
+/* Heads showing the same mode, scale and rotation, e.g. a panel mirrored
+ * to a projector, share one shadow buffer.  Only the first of them is
+ * handed out by get_heads, so splash plugins draw the scene once and
+ * flush_head copies it to each of them.
+ */
+static void
+update_cloned_heads (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node, *unique_node;
+        ply_renderer_head_t *head, *source;
+
+        ply_list_remove_all_nodes (backend->unique_heads);
+
+        ply_list_foreach (backend->heads, node) {
+                head = ply_list_node_get_data (node);
+
+                source = NULL;
+                ply_list_foreach (backend->unique_heads, unique_node) {
+                        ply_renderer_head_t *unique_head = ply_list_node_get_data (unique_node);
+
+                        if (heads_can_share_pixel_buffer (unique_head, head)) {
+                                source = unique_head;
+                                break;
+                        }
+                }
+
+                if (source != head->clone_source && head->clone_source != NULL)
+                        ply_renderer_head_stop_cloning (head);
+
+                if (source == NULL) {
+                        ply_list_append_data (backend->unique_heads, head);
+                        continue;
+                }
+
+                if (source == head->clone_source)
+                        continue;
+
+                ply_trace ("%ldx%ld renderer head on controller %u mirrors controller %u",
+                           head->area.width, head->area.height,
+                           head->controller_id, source->controller_id);
+
+                ply_pixel_buffer_free (head->pixel_buffer);
+                head->pixel_buffer = source->pixel_buffer;
+                head->clone_source = source;
+        }
+}
+
 static void
 ply_renderer_head_remove (ply_renderer_backend_t *backend,
                           ply_renderer_head_t    *head)
 {
+        ply_list_node_t *node;
+
         if (head->scan_out_buffer_id)
                 ply_renderer_head_unmap (backend, head);
 
+        ply_list_foreach (backend->heads, node) {
+                ply_renderer_head_t *clone = ply_list_node_get_data (node);
+
+                if (clone->clone_source == head)
+                        ply_renderer_head_stop_cloning (clone);
+        }
+
+        ply_list_remove_data (backend->unique_heads, head);
+
         ply_hashtable_remove (backend->heads_by_controller_id,
                               (void *) (intptr_t) head->controller_id);
         ply_list_remove_data (backend->heads, head);
@@ -843,6 +1199,71 @@ flush_area (const char      *src,
         }
 }
 
+/* Copies an area of the upright shadow buffer to the scan out buffer,
+ * rotating it on the way.  This walks the area in square blocks, so that
+ * neither the reads nor the transposed writes leave the cache for long.
+ */
+static void
+flush_area_rotated (const uint32_t             *src,
+                    unsigned long               src_width,
+                    unsigned long               src_height,
+                    char                       *dst,
+                    unsigned long               dst_row_stride,
+                    ply_pixel_buffer_rotation_t rotation,
+                    ply_rectangle_t            *area_to_flush)
+{
+        unsigned long x1, y1, x2, y2, block_x, block_y, x, y;
+        long x_step, y_step;
+
+        /* Where pixel (x, y) of the shadow buffer ends up is
+         * dst + x * x_step + y * y_step
+         */
+        switch (rotation) {
+        case PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN:
+                dst += (src_height - 1) * dst_row_stride + (src_width - 1) * BYTES_PER_PIXEL;
+                x_step = -BYTES_PER_PIXEL;
+                y_step = -(long) dst_row_stride;
+                break;
+        case PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE:
+                dst += (src_height - 1) * BYTES_PER_PIXEL;
+                x_step = dst_row_stride;
+                y_step = -BYTES_PER_PIXEL;
+                break;
+        case PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE:
+                dst += (src_width - 1) * dst_row_stride;
+                x_step = -(long) dst_row_stride;
+                y_step = BYTES_PER_PIXEL;
+                break;
+        case PLY_PIXEL_BUFFER_ROTATE_UPRIGHT:
+        default:
+                x_step = BYTES_PER_PIXEL;
+                y_step = dst_row_stride;
+                break;
+        }
+
+        x1 = area_to_flush->x;
+        y1 = area_to_flush->y;
+        x2 = x1 + area_to_flush->width;
+        y2 = y1 + area_to_flush->height;
+
+        for (block_y = y1; block_y < y2; block_y += ROTATION_BLOCK_SIZE) {
+                unsigned long block_y2 = MIN (block_y + ROTATION_BLOCK_SIZE, y2);
+
+                for (block_x = x1; block_x < x2; block_x += ROTATION_BLOCK_SIZE) {
+                        unsigned long block_x2 = MIN (block_x + ROTATION_BLOCK_SIZE, x2);
+
+                        for (y = block_y; y < block_y2; y++) {
+                                const uint32_t *src_row = &src[y * src_width];
+                                char *dst_row = dst + (long) y * y_step;
+
+                                for (x = block_x; x < block_x2; x++) {
+                                        *(uint32_t *) (dst_row + (long) x * x_step) = src_row[x];
+                                }
+                        }
+                }
+        }
+}
+
 static void
 ply_renderer_head_flush_area (ply_renderer_head_t *head,
                               ply_rectangle_t     *area_to_flush,
@@ -853,10 +1274,39 @@ ply_renderer_head_flush_area (ply_renderer_head_t *head,
 
         shadow_buffer = ply_pixel_buffer_get_argb32_data (head->pixel_buffer);
 
+        if (!head->uses_hw_rotation && head->rotation != PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
+                flush_area_rotated (shadow_buffer,
+                                    head->shadow_area.width, head->shadow_area.height,
+                                    map_address, head->row_stride,
+                                    head->rotation, area_to_flush);
+                return;
+        }
+
         dst = &map_address[area_to_flush->y * head->row_stride + area_to_flush->x * BYTES_PER_PIXEL];
-        src = (char *) &shadow_buffer[area_to_flush->y * head->area.width + area_to_flush->x];
+        src = (char *) &shadow_buffer[area_to_flush->y * head->shadow_area.width + area_to_flush->x];
+
+        flush_area (src, head->shadow_area.width * 4, dst, head->row_stride, area_to_flush);
+}
+
+/* Called when the primary plane refuses the rotation we asked for, recreates
+ * the scan out buffer in the unrotated size and makes flush_head rotate.
+ */
+static bool
+ply_renderer_head_fall_back_to_sw_rotation (ply_renderer_backend_t *backend,
+                                            ply_renderer_head_t    *head)
+{
+        ply_trace ("Falling back to software rotation for %ldx%ld renderer head",
+                   head->area.width, head->area.height);
+
+        ply_renderer_head_unmap (backend, head);
+        head->uses_hw_rotation = false;
 
-        flush_area (src, head->area.width * 4, dst, head->row_stride, area_to_flush);
+        if (!ply_renderer_head_map (backend, head))
+                return false;
+
+        ply_region_add_rectangle (ply_pixel_buffer_get_updated_areas (head->pixel_buffer),
+                                  &head->shadow_area);
+        return true;
 }
 
 static void
@@ -877,6 +1327,8 @@ free_heads (ply_renderer_backend_t *backend)
 
                 node = next_node;
         }
+
+        ply_list_remove_all_nodes (backend->unique_heads);
 }
 
 static ply_renderer_backend_t *
@@ -898,6 +1350,7 @@ create_backend (const char     *device_name,
 
         backend->loop = ply_event_loop_get_default ();
         backend->heads = ply_list_new ();
+        backend->unique_heads = ply_list_new ();
         backend->input_source.key_buffer = ply_buffer_new ();
         backend->input_source.input_devices = ply_list_new ();
         backend->terminal = terminal;
@@ -905,6 +1358,10 @@ create_backend (const char     *device_name,
         backend->output_buffers = ply_hashtable_new (ply_hashtable_direct_hash,
                                                      ply_hashtable_direct_compare);
         backend->heads_by_controller_id = ply_hashtable_new (NULL, NULL);
+        backend->probed_connector_states = ply_hashtable_new (NULL, NULL);
+        pthread_mutex_init (&backend->probe_mutex, NULL);
+        pthread_mutex_init (&backend->flush_mutex, NULL);
+        backend->sprite_planes_disabled = ply_kernel_command_line_has_argument ("plymouth.no-sprite-planes");
 
         return backend;
 }
@@ -922,8 +1379,12 @@ destroy_backend (ply_renderer_backend_t *backend)
         free_heads (backend);
 
         free (backend->device_name);
+        ply_list_free (backend->unique_heads);
         ply_hashtable_free (backend->output_buffers);
+        pthread_mutex_destroy (&backend->flush_mutex);
         ply_hashtable_free (backend->heads_by_controller_id);
+        ply_hashtable_free (backend->probed_connector_states);
+        pthread_mutex_destroy (&backend->probe_mutex);
         ply_list_free (backend->input_source.input_devices);
 
         free (backend->outputs);
@@ -934,7 +1395,8 @@ static void
 activate (ply_renderer_backend_t *backend)
 {
         ply_renderer_head_t *head;
-        ply_list_node_t *node;
+        ply_renderer_sprite_t *sprite;
+        ply_list_node_t *node, *sprite_node;
 
         ply_trace ("taking master and scanning out");
         backend->is_active = true;
@@ -943,8 +1405,18 @@ activate (ply_renderer_backend_t *backend)
         node = ply_list_get_first_node (backend->heads);
         while (node != NULL) {
                 head = (ply_renderer_head_t *) ply_list_node_get_data (node);
-                /* Flush out any pending drawing to the buffer */
-                flush_head (backend, head);
+                /* Flush out any pending drawing to the buffer, clones get
+                 * flushed along with the head they mirror */
+                if (head->clone_source == NULL)
+                        flush_head (backend, head);
+
+                /* Whoever had master in the meantime may have used our planes */
+                ply_list_foreach (head->sprites, sprite_node) {
+                        sprite = ply_list_node_get_data (sprite_node);
+                        ply_renderer_sprite_flush (backend, sprite);
+                        ply_renderer_sprite_show (backend, sprite);
+                }
+
                 node = ply_list_get_next_node (backend->heads, node);
         }
 }
@@ -952,6 +1424,21 @@ activate (ply_renderer_backend_t *backend)
 static void
 deactivate (ply_renderer_backend_t *backend)
 {
+        ply_renderer_head_t *head;
+        ply_renderer_sprite_t *sprite;
+        ply_list_node_t *node, *sprite_node;
+
+        /* Whoever takes over shouldn't find our sprites on top of their
+         * output, activate puts them back */
+        ply_list_foreach (backend->heads, node) {
+                head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+
+                ply_list_foreach (head->sprites, sprite_node) {
+                        sprite = ply_list_node_get_data (sprite_node);
+                        ply_renderer_sprite_hide (backend, sprite);
+                }
+        }
+
         ply_trace ("dropping master");
         drmDropMaster (backend->device_fd);
         backend->is_active = false;
@@ -1022,7 +1509,7 @@ open_device (ply_renderer_backend_t *backend)
         assert (backend != NULL);
         assert (backend->device_name != NULL);
 
-        if (!load_driver (backend))
+        if (backend->device_fd < 0 && !load_driver (backend))
                 return false;
 
         if (backend->terminal == NULL)
@@ -1189,6 +1676,151 @@ get_active_mode (ply_renderer_backend_t *backend,
         return mode;
 }
 
+#define PROBED_CONNECTOR_DISCONNECTED 1
+#define PROBED_CONNECTOR_CONNECTED    2
+
+static intptr_t
+get_probed_connector_state (drmModeConnector *connector)
+{
+        if (connector->connection == DRM_MODE_CONNECTED)
+                return PROBED_CONNECTOR_CONNECTED;
+
+        return PROBED_CONNECTOR_DISCONNECTED;
+}
+
+static bool
+connector_changed_since_probe (ply_renderer_backend_t *backend,
+                               drmModeConnector       *connector)
+{
+        intptr_t state;
+
+        pthread_mutex_lock (&backend->probe_mutex);
+        state = (intptr_t) ply_hashtable_lookup (backend->probed_connector_states,
+                                                 (void *) (intptr_t) connector->connector_id);
+        pthread_mutex_unlock (&backend->probe_mutex);
+
+        return state != get_probed_connector_state (connector);
+}
+
+static void
+remember_probed_connector (ply_renderer_backend_t *backend,
+                           drmModeConnector       *connector)
+{
+        void *connector_id = (void *) (intptr_t) connector->connector_id;
+
+        /* The table doesn't replace existing keys */
+        pthread_mutex_lock (&backend->probe_mutex);
+        ply_hashtable_remove (backend->probed_connector_states, connector_id);
+        ply_hashtable_insert (backend->probed_connector_states, connector_id,
+                              (void *) get_probed_connector_state (connector));
+        pthread_mutex_unlock (&backend->probe_mutex);
+}
+
+static bool
+connector_needs_probe (ply_renderer_backend_t *backend,
+                       drmModeConnector       *connector)
+{
+        bool is_connected;
+        int i;
+
+        if (connector->connection == DRM_MODE_UNKNOWNCONNECTION)
+                return true;
+
+        is_connected = connector->connection == DRM_MODE_CONNECTED;
+
+        if (is_connected && connector->count_modes <= 0)
+                return true;
+
+        /* Nothing changed since the last full probe, so what the kernel
+         * has is current */
+        if (!connector_changed_since_probe (backend, connector))
+                return false;
+
+        if (backend->should_probe_connectors)
+                return true;
+
+        /* The kernel updates the connection status on hotplug, but the
+         * modes only get refreshed by a probe
+         */
+        for (i = 0; i < backend->outputs_len; i++) {
+                if (backend->outputs[i].connector_id == connector->connector_id)
+                        return backend->outputs[i].connected != is_connected;
+        }
+
+        return false;
+}
+
+/* Probing a connector reads EDID over DDC, which can take a long time.
+ * Use what the kernel already knows about the connector unless that's
+ * not good enough.
+ */
+static drmModeConnector *
+get_connector (ply_renderer_backend_t *backend,
+               uint32_t                connector_id)
+{
+        drmModeConnector *connector;
+
+        connector = drmModeGetConnectorCurrent (backend->device_fd, connector_id);
+
+        if (connector != NULL && !connector_needs_probe (backend, connector))
+                return connector;
+
+        if (connector != NULL)
+                drmModeFreeConnector (connector);
+
+        ply_trace ("probing connector %u", connector_id);
+        connector = drmModeGetConnector (backend->device_fd, connector_id);
+
+        if (connector != NULL)
+                remember_probed_connector (backend, connector);
+
+        return connector;
+}
+
+/* Does the slow part of handling a change event ahead of time, on
+ * another thread: fully probing the connectors whose state changed since
+ * their last probe.  Only uses the device and the probe table, so it can
+ * run while the main thread renders.
+ */
+static void
+probe_connectors (ply_renderer_backend_t *backend)
+{
+        drmModeRes *resources;
+        drmModeConnector *connector;
+        int i;
+
+        resources = drmModeGetResources (backend->device_fd);
+        if (resources == NULL) {
+                ply_trace ("Could not get card resources to probe connectors");
+                return;
+        }
+
+        for (i = 0; i < resources->count_connectors; i++) {
+                connector = drmModeGetConnectorCurrent (backend->device_fd,
+                                                        resources->connectors[i]);
+                if (connector == NULL)
+                        continue;
+
+                if (connector->connection != DRM_MODE_UNKNOWNCONNECTION &&
+                    !connector_changed_since_probe (backend, connector)) {
+                        drmModeFreeConnector (connector);
+                        continue;
+                }
+
+                drmModeFreeConnector (connector);
+
+                ply_trace ("probing connector %u in the background", resources->connectors[i]);
+                connector = drmModeGetConnector (backend->device_fd, resources->connectors[i]);
+                if (connector == NULL)
+                        continue;
+
+                remember_probed_connector (backend, connector);
+                drmModeFreeConnector (connector);
+        }
+
+        drmModeFreeResources (resources);
+}
+
 static void
 get_output_info (ply_renderer_backend_t *backend,
                  uint32_t                connector_id,
@@ -1201,7 +1833,7 @@ get_output_info (ply_renderer_backend_t *backend,
         memset (output, 0, sizeof(*output));
         output->connector_id = connector_id;
 
-        connector = drmModeGetConnector (backend->device_fd, connector_id);
+        connector = get_connector (backend, connector_id);
         if (connector == NULL)
                 return;
 
@@ -1524,6 +2156,9 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
         backend->outputs_len = outputs_len;
         backend->outputs = outputs;
 
+        if (changed)
+                update_cloned_heads (backend);
+
         ply_trace ("outputs %schanged\n", changed ? "" : "un");
 
         return changed;
@@ -1571,6 +2206,9 @@ query_device (ply_renderer_backend_t *backend)
         assert (backend != NULL);
         assert (backend->device_fd >= 0);
 
+        if (backend->is_probed)
+                return true;
+
         backend->resources = drmModeGetResources (backend->device_fd);
 
         if (backend->resources == NULL) {
@@ -1592,6 +2230,26 @@ query_device (ply_renderer_backend_t *backend)
         return ret;
 }
 
+static bool
+probe_device (ply_renderer_backend_t *backend)
+{
+        assert (backend != NULL);
+        assert (backend->device_fd < 0);
+
+        if (!load_driver (backend))
+                return false;
+
+        if (!query_device (backend)) {
+                free_heads (backend);
+                drmClose (backend->device_fd);
+                backend->device_fd = -1;
+                return false;
+        }
+
+        backend->is_probed = true;
+        return true;
+}
+
 static bool
 handle_change_event (ply_renderer_backend_t *backend)
 {
@@ -1603,6 +2261,7 @@ handle_change_event (ply_renderer_backend_t *backend)
                 return false;
         }
 
+        backend->should_probe_connectors = true;
         ret = create_heads_for_active_connectors (backend, true);
 
         drmModeFreeResources (backend->resources);
@@ -1689,38 +2348,46 @@ reset_scan_out_buffer_if_needed (ply_renderer_backend_t *backend,
         return did_reset;
 }
 
+static bool
+ply_renderer_head_prepare_flush (ply_renderer_backend_t *backend,
+                                 ply_renderer_head_t    *head)
+{
+        /* A hotplugged head may not be mapped yet, map it now. */
+        if (!head->scan_out_buffer_id) {
+                if (!ply_renderer_head_map (backend, head))
+                        return false;
+        }
+
+        /* Find out if the plane takes our rotation before drawing into a
+         * scan out buffer which may have the wrong size.
+         */
+        if (head->uses_hw_rotation && head->scan_out_buffer_needs_reset &&
+            (backend->terminal == NULL || ply_terminal_is_active (backend->terminal)) &&
+            !ply_renderer_head_set_plane_rotation (backend, head)) {
+                if (!ply_renderer_head_fall_back_to_sw_rotation (backend, head))
+                        return false;
+        }
+
+        return true;
+}
+
 static void
-flush_head (ply_renderer_backend_t *backend,
-            ply_renderer_head_t    *head)
+ply_renderer_head_flush_areas (ply_renderer_backend_t *backend,
+                               ply_renderer_head_t    *head,
+                               ply_list_t             *areas_to_flush)
 {
         ply_rectangle_t *area_to_flush;
-        ply_region_t *updated_region;
-        ply_list_t *areas_to_flush;
         ply_list_node_t *node;
-        ply_pixel_buffer_t *pixel_buffer;
         char *map_address;
         bool dirty = false;
 
-        assert (backend != NULL);
-
-        if (!backend->is_active)
-                return;
-
-        if (backend->terminal != NULL) {
-                ply_terminal_set_mode (backend->terminal, PLY_TERMINAL_MODE_GRAPHICS);
-                ply_terminal_set_unbuffered_input (backend->terminal);
-        }
-        pixel_buffer = head->pixel_buffer;
-        updated_region = ply_pixel_buffer_get_updated_areas (pixel_buffer);
-        areas_to_flush = ply_region_get_sorted_rectangle_list (updated_region);
-
-        /* A hotplugged head may not be mapped yet, map it now. */
+        pthread_mutex_lock (&backend->flush_mutex);
         if (!head->scan_out_buffer_id) {
-                if (!ply_renderer_head_map (backend, head))
-                        return;
+                pthread_mutex_unlock (&backend->flush_mutex);
+                return;
         }
-
         map_address = begin_flush (backend, head->scan_out_buffer_id);
+        pthread_mutex_unlock (&backend->flush_mutex);
 
         node = ply_list_get_first_node (areas_to_flush);
         while (node != NULL) {
@@ -1733,20 +2400,375 @@ flush_head (ply_renderer_backend_t *backend,
         }
 
         if (dirty) {
+                pthread_mutex_lock (&backend->flush_mutex);
                 if (reset_scan_out_buffer_if_needed (backend, head))
                         ply_trace ("Needed to reset scan out buffer on %ldx%ld renderer head",
                                    head->area.width, head->area.height);
 
                 end_flush (backend, head->scan_out_buffer_id);
+                pthread_mutex_unlock (&backend->flush_mutex);
+        }
+}
+
+static bool
+flush_head (ply_renderer_backend_t *backend,
+            ply_renderer_head_t    *head)
+{
+        ply_region_t *updated_region;
+        ply_list_t *areas_to_flush;
+        ply_list_node_t *node;
+        ply_renderer_head_t *clone;
+
+        assert (backend != NULL);
+
+        if (!backend->is_active)
+                return false;
+
+        pthread_mutex_lock (&backend->flush_mutex);
+
+        if (backend->terminal != NULL) {
+                ply_terminal_set_mode (backend->terminal, PLY_TERMINAL_MODE_GRAPHICS);
+                ply_terminal_set_unbuffered_input (backend->terminal);
+        }
+
+        /* Heads mirroring this one show the same shadow buffer, so they get
+         * the same updates.  Prepare all of them first, since falling back
+         * to software rotation adds to the updated areas.
+         */
+        ply_renderer_head_prepare_flush (backend, head);
+        ply_list_foreach (backend->heads, node) {
+                clone = ply_list_node_get_data (node);
+                if (clone->clone_source == head)
+                        ply_renderer_head_prepare_flush (backend, clone);
+        }
+
+        updated_region = ply_pixel_buffer_get_updated_areas (head->pixel_buffer);
+        areas_to_flush = ply_region_get_sorted_rectangle_list (updated_region);
+
+        pthread_mutex_unlock (&backend->flush_mutex);
+
+        ply_renderer_head_flush_areas (backend, head, areas_to_flush);
+        ply_list_foreach (backend->heads, node) {
+                clone = ply_list_node_get_data (node);
+                if (clone->clone_source == head)
+                        ply_renderer_head_flush_areas (backend, clone, areas_to_flush);
         }
 
         ply_region_clear (updated_region);
+
+        return true;
+}
+
+static int
+get_plane_type (ply_renderer_backend_t *backend,
+                uint32_t                plane_id)
+{
+        drmModeObjectPropertiesPtr plane_props;
+        drmModePropertyPtr prop;
+        int type = -1;
+        uint32_t i;
+
+        plane_props = drmModeObjectGetProperties (backend->device_fd, plane_id,
+                                                  DRM_MODE_OBJECT_PLANE);
+
+        for (i = 0; plane_props && (i < plane_props->count_props); i++) {
+                prop = drmModeGetProperty (backend->device_fd, plane_props->props[i]);
+                if (!prop)
+                        continue;
+
+                if (strcmp (prop->name, "type") == 0)
+                        type = plane_props->prop_values[i];
+
+                drmModeFreeProperty (prop);
+        }
+
+        drmModeFreeObjectProperties (plane_props);
+
+        return type;
+}
+
+static bool
+plane_supports_format (drmModePlanePtr plane,
+                       uint32_t        format)
+{
+        uint32_t i;
+
+        for (i = 0; i < plane->count_formats; i++) {
+                if (plane->formats[i] == format)
+                        return true;
+        }
+
+        return false;
+}
+
+static bool
+plane_is_used_by_sprite (ply_renderer_backend_t *backend,
+                         uint32_t                plane_id)
+{
+        ply_list_node_t *head_node, *sprite_node;
+
+        ply_list_foreach (backend->heads, head_node) {
+                ply_renderer_head_t *head = ply_list_node_get_data (head_node);
+
+                ply_list_foreach (head->sprites, sprite_node) {
+                        ply_renderer_sprite_t *sprite = ply_list_node_get_data (sprite_node);
+
+                        if (sprite->plane_id == plane_id)
+                                return true;
+                }
+        }
+
+        return false;
+}
+
+/* Looks for an unused plane that can show an ARGB buffer on the head's
+ * controller.  Overlay planes are preferred.  Cursor planes only take
+ * sprites that fit the cursor size, and want a buffer of exactly that size.
+ */
+static uint32_t
+find_sprite_plane (ply_renderer_backend_t *backend,
+                   ply_renderer_head_t    *head,
+                   unsigned long           width,
+                   unsigned long           height,
+                   unsigned long          *buffer_width,
+                   unsigned long          *buffer_height)
+{
+        drmModePlaneResPtr plane_resources;
+        drmModePlanePtr plane;
+        uint64_t cursor_width = 64, cursor_height = 64;
+        uint32_t overlay_plane_id = 0, cursor_plane_id = 0;
+        uint32_t i;
+        int type;
+
+        if (head->controller_index < 0)
+                return 0;
+
+        if (drmSetClientCap (backend->device_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0)
+                return 0;
+
+        plane_resources = drmModeGetPlaneResources (backend->device_fd);
+        if (!plane_resources)
+                return 0;
+
+        drmGetCap (backend->device_fd, DRM_CAP_CURSOR_WIDTH, &cursor_width);
+        drmGetCap (backend->device_fd, DRM_CAP_CURSOR_HEIGHT, &cursor_height);
+
+        for (i = 0; i < plane_resources->count_planes && overlay_plane_id == 0; i++) {
+                plane = drmModeGetPlane (backend->device_fd, plane_resources->planes[i]);
+                if (!plane)
+                        continue;
+
+                if ((plane->possible_crtcs & (1 << head->controller_index)) &&
+                    plane->fb_id == 0 &&
+                    plane_supports_format (plane, DRM_FORMAT_ARGB8888) &&
+                    !plane_is_used_by_sprite (backend, plane->plane_id)) {
+                        type = get_plane_type (backend, plane->plane_id);
+
+                        if (type == DRM_PLANE_TYPE_OVERLAY)
+                                overlay_plane_id = plane->plane_id;
+                        else if (type == DRM_PLANE_TYPE_CURSOR && cursor_plane_id == 0 &&
+                                 width <= cursor_width && height <= cursor_height)
+                                cursor_plane_id = plane->plane_id;
+                }
+
+                drmModeFreePlane (plane);
+        }
+
+        drmModeFreePlaneResources (plane_resources);
+
+        if (overlay_plane_id != 0) {
+                *buffer_width = width;
+                *buffer_height = height;
+                return overlay_plane_id;
+        }
+
+        *buffer_width = cursor_width;
+        *buffer_height = cursor_height;
+        return cursor_plane_id;
+}
+
+static bool
+ply_renderer_sprite_show (ply_renderer_backend_t *backend,
+                          ply_renderer_sprite_t  *sprite)
+{
+        if (drmModeSetPlane (backend->device_fd, sprite->plane_id,
+                             sprite->head->controller_id, sprite->buffer_id, 0,
+                             sprite->area.x, sprite->area.y,
+                             sprite->buffer_width, sprite->buffer_height,
+                             0, 0,
+                             sprite->buffer_width << 16, sprite->buffer_height << 16) != 0) {
+                ply_trace ("Couldn't show sprite on plane %u: %m", sprite->plane_id);
+                return false;
+        }
+
+        return true;
+}
+
+static void
+ply_renderer_sprite_flush (ply_renderer_backend_t *backend,
+                          ply_renderer_sprite_t  *sprite)
+{
+        ply_rectangle_t *area_to_flush;
+        ply_region_t *updated_region;
+        ply_list_t *areas_to_flush;
+        ply_list_node_t *node;
+        uint32_t *sprite_buffer;
+        char *map_address;
+        char *dst, *src;
+
+        updated_region = ply_pixel_buffer_get_updated_areas (sprite->pixel_buffer);
+        areas_to_flush = ply_region_get_sorted_rectangle_list (updated_region);
+        sprite_buffer = ply_pixel_buffer_get_argb32_data (sprite->pixel_buffer);
+
+        if (ply_list_get_length (areas_to_flush) == 0)
+                return;
+
+        map_address = begin_flush (backend, sprite->buffer_id);
+
+        ply_list_foreach (areas_to_flush, node) {
+                area_to_flush = (ply_rectangle_t *) ply_list_node_get_data (node);
+
+                dst = &map_address[area_to_flush->y * sprite->row_stride + area_to_flush->x * BYTES_PER_PIXEL];
+                src = (char *) &sprite_buffer[area_to_flush->y * sprite->area.width + area_to_flush->x];
+
+                flush_area (src, sprite->area.width * 4, dst, sprite->row_stride, area_to_flush);
+        }
+
+        end_flush (backend, sprite->buffer_id);
+        ply_region_clear (updated_region);
+}
+
+static ply_renderer_sprite_t *
+create_sprite (ply_renderer_backend_t *backend,
+               ply_renderer_head_t    *head,
+               long                    x,
+               long                    y,
+               unsigned long           width,
+               unsigned long           height)
+{
+        ply_renderer_sprite_t *sprite;
+        unsigned long buffer_width, buffer_height;
+        uint32_t plane_id;
+        char *map_address;
+        int scale;
+
+        if (backend->sprite_planes_disabled || !backend->is_active)
+                return NULL;
+
+        /* The head's rotation would have to be applied to the plane as well */
+        if (head->rotation != PLY_PIXEL_BUFFER_ROTATE_UPRIGHT || head->uses_hw_rotation)
+                return NULL;
+
+        /* The sprite would only show up on one of the mirrored outputs */
+        if (ply_renderer_head_has_clones (backend, head))
+                return NULL;
+
+        scale = ply_pixel_buffer_get_device_scale (head->pixel_buffer);
+        width *= scale;
+        height *= scale;
+
+        if (width == 0 || height == 0 || x < 0 || y < 0 ||
+            x * scale + width > head->area.width ||
+            y * scale + height > head->area.height)
+                return NULL;
+
+        plane_id = find_sprite_plane (backend, head, width, height,
+                                      &buffer_width, &buffer_height);
+        if (plane_id == 0) {
+                ply_trace ("No free plane for %lux%lu sprite", width, height);
+                return NULL;
+        }
+
+        sprite = calloc (1, sizeof(ply_renderer_sprite_t));
+        sprite->head = head;
+        sprite->plane_id = plane_id;
+        sprite->area.x = x * scale;
+        sprite->area.y = y * scale;
+        sprite->area.width = width;
+        sprite->area.height = height;
+        sprite->buffer_width = buffer_width;
+        sprite->buffer_height = buffer_height;
+
+        sprite->buffer_id = create_output_buffer_with_depth (backend,
+                                                             buffer_width, buffer_height,
+                                                             32, &sprite->row_stride);
+        if (sprite->buffer_id == 0) {
+                free (sprite);
+                return NULL;
+        }
+
+        if (!map_buffer (backend, sprite->buffer_id)) {
+                destroy_output_buffer (backend, sprite->buffer_id);
+                free (sprite);
+                return NULL;
+        }
+
+        /* Cursor plane buffers can be larger than the sprite */
+        map_address = begin_flush (backend, sprite->buffer_id);
+        memset (map_address, 0, sprite->row_stride * buffer_height);
+        end_flush (backend, sprite->buffer_id);
+
+        if (!ply_renderer_sprite_show (backend, sprite)) {
+                ply_renderer_sprite_release (backend, sprite);
+                free (sprite);
+                return NULL;
+        }
+
+        sprite->pixel_buffer = ply_pixel_buffer_new (width, height);
+        ply_pixel_buffer_set_device_scale (sprite->pixel_buffer, scale);
+
+        ply_list_append_data (head->sprites, sprite);
+
+        ply_trace ("Showing %lux%lu sprite on plane %u of %ldx%ld renderer head",
+                   width, height, plane_id, head->area.width, head->area.height);
+
+        return sprite;
+}
+
+static void
+destroy_sprite (ply_renderer_backend_t *backend,
+                ply_renderer_sprite_t  *sprite)
+{
+        if (sprite->head != NULL) {
+                ply_list_remove_data (sprite->head->sprites, sprite);
+                ply_renderer_sprite_release (backend, sprite);
+        }
+
+        ply_pixel_buffer_free (sprite->pixel_buffer);
+        free (sprite);
+}
+
+static ply_pixel_buffer_t *
+get_buffer_for_sprite (ply_renderer_backend_t *backend,
+                       ply_renderer_sprite_t  *sprite)
+{
+        return sprite->pixel_buffer;
+}
+
+static void
+flush_sprite (ply_renderer_backend_t *backend,
+              ply_renderer_sprite_t  *sprite)
+{
+        /* Drawing is kept in the pixel buffer until activate */
+        if (sprite->head == NULL || !backend->is_active)
+                return;
+
+        if (backend->terminal != NULL && !ply_terminal_is_active (backend->terminal))
+                return;
+
+        ply_renderer_sprite_flush (backend, sprite);
+}
+
+static bool
+can_flush_heads_in_parallel (ply_renderer_backend_t *backend)
+{
+        return true;
 }
 
 static ply_list_t *
 get_heads (ply_renderer_backend_t *backend)
 {
-        return backend->heads;
+        return backend->unique_heads;
 }
 
 static ply_pixel_buffer_t *
@@ -2050,7 +3072,9 @@ ply_renderer_backend_get_interface (void)
                 .open_device                  = open_device,
                 .close_device                 = close_device,
                 .query_device                 = query_device,
+                .probe_device                 = probe_device,
                 .handle_change_event          = handle_change_event,
+                .probe_connectors             = probe_connectors,
                 .map_to_device                = map_to_device,
                 .unmap_from_device            = unmap_from_device,
                 .activate                     = activate,
@@ -2068,6 +3092,11 @@ ply_renderer_backend_get_interface (void)
                 .get_keymap                   = get_keymap,
                 .add_input_device             = add_input_device,
                 .remove_input_device          = remove_input_device,
+                .create_sprite                = create_sprite,
+                .destroy_sprite               = destroy_sprite,
+                .get_buffer_for_sprite        = get_buffer_for_sprite,
+                .flush_sprite                 = flush_sprite,
+                .can_flush_heads_in_parallel  = can_flush_heads_in_parallel,
         };
 
         return &plugin_interface;
@@ -574,7 +574,7 @@ unmap_from_device (ply_renderer_backend_t *backend)
         }
 }
 
-static void
+static bool
 flush_head (ply_renderer_backend_t *backend,
             ply_renderer_head_t    *head)
 {
@@ -587,7 +587,7 @@ flush_head (ply_renderer_backend_t *backend,
         assert (&backend->head == head);
 
         if (!backend->is_active)
-                return;
+                return false;
 
         if (backend->terminal != NULL) {
                 ply_terminal_set_mode (backend->terminal, PLY_TERMINAL_MODE_GRAPHICS);
@@ -612,6 +612,8 @@ flush_head (ply_renderer_backend_t *backend,
         }
 
         ply_region_clear (updated_region);
+
+        return true;
 }
 
 static void
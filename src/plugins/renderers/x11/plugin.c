@@ -418,7 +418,7 @@ deactivate (ply_renderer_backend_t *backend)
         backend->is_active = false;
 }
 
-static void
+static bool
 flush_head (ply_renderer_backend_t *backend,
             ply_renderer_head_t    *head)
 {
@@ -430,7 +430,7 @@ flush_head (ply_renderer_backend_t *backend,
         assert (backend != NULL);
 
         if (!backend->is_active)
-                return;
+                return false;
 
         pixel_buffer = head->pixel_buffer;
         updated_region = ply_pixel_buffer_get_updated_areas (pixel_buffer);
@@ -459,6 +459,8 @@ flush_head (ply_renderer_backend_t *backend,
                 node = next_node;
         }
         ply_region_clear (updated_region);
+
+        return true;
 }
 
 static ply_list_t *
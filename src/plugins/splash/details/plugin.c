@@ -44,6 +44,7 @@
 #include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-key-file.h"
+#include "ply-keyboard.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-text-display.h"
@@ -53,6 +54,8 @@
 #include <linux/kd.h>
 
 #define CLEAR_LINE_SEQUENCE "\033[2K\r"
+#define PAGE_UP_SEQUENCE "\033[5~"
+#define PAGE_DOWN_SEQUENCE "\033[6~"
 
 typedef enum
 {
@@ -65,6 +68,11 @@ typedef struct
 {
         ply_boot_splash_plugin_t *plugin;
         ply_text_display_t       *display;
+
+        /* How many rows of boot output the view is scrolled back by,
+         * live output only shows up when this is 0
+         */
+        int                       scrollback_rows;
 } view_t;
 
 ply_boot_splash_plugin_interface_t *ply_boot_splash_plugin_get_interface (void);
@@ -77,6 +85,7 @@ struct _ply_boot_splash_plugin
         ply_list_t                    *views;
         ply_boot_splash_display_type_t state;
         ply_list_t                    *messages;
+        ply_keyboard_t                *keyboard;
 
         ply_buffer_t                  *boot_buffer;
 };
@@ -202,27 +211,125 @@ view_write (view_t     *view,
         ply_terminal_write (terminal, "%.*s", (int) number_of_bytes, text);
 }
 
+/* Finds where the last rows of output start, counting lines
+ * that wrap as more than one row
+ */
+static size_t
+find_start_of_last_rows (const char *bytes,
+                         size_t      size,
+                         int         number_of_rows,
+                         int         number_of_columns)
+{
+        size_t line_start, line_end;
+
+        if (number_of_rows <= 0 || number_of_columns <= 0)
+                return size;
+
+        line_end = size;
+        while (true) {
+                int rows_in_line;
+
+                line_start = line_end;
+                while (line_start > 0 && bytes[line_start - 1] != '\n') {
+                        line_start--;
+                }
+
+                rows_in_line = MAX (1, (int) ((line_end - line_start + number_of_columns - 1) / number_of_columns));
+
+                if (rows_in_line >= number_of_rows)
+                        return line_start + (size_t) (rows_in_line - number_of_rows) * number_of_columns;
+
+                number_of_rows -= rows_in_line;
+
+                if (line_start == 0)
+                        return 0;
+
+                line_end = line_start - 1;
+        }
+}
+
+/* Writes the screenful of boot output that ends scrollback_rows rows
+ * before the end, rather than all of it
+ */
+static void
+view_write_boot_buffer_window (view_t *view)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+        const char *bytes;
+        size_t start, end;
+        int number_of_rows, number_of_columns;
+
+        if (plugin->boot_buffer == NULL)
+                return;
+
+        bytes = ply_buffer_get_bytes (plugin->boot_buffer);
+        end = ply_buffer_get_size (plugin->boot_buffer);
+        number_of_rows = ply_text_display_get_number_of_rows (view->display);
+        number_of_columns = ply_text_display_get_number_of_columns (view->display);
+
+        if (view->scrollback_rows > 0) {
+                end = find_start_of_last_rows (bytes, end, view->scrollback_rows, number_of_columns);
+
+                /* Don't let the last line scroll the window */
+                if (end > 0 && bytes[end - 1] == '\n')
+                        end--;
+        }
+
+        start = find_start_of_last_rows (bytes, end, number_of_rows, number_of_columns);
+
+        view_write (view, bytes + start, end - start);
+}
+
 static void
 view_write_boot_buffer (view_t *view)
 {
-        ply_boot_splash_plugin_t *plugin;
         ply_terminal_t *terminal;
 
-        plugin = view->plugin;
-
         terminal = ply_text_display_get_terminal (view->display);
 
         ply_text_display_clear_screen (view->display);
         ply_terminal_activate_vt (terminal);
 
-        if (plugin->boot_buffer != NULL) {
-                size_t size;
-                const char *bytes;
+        view_write_boot_buffer_window (view);
+}
 
-                size = ply_buffer_get_size (plugin->boot_buffer);
-                bytes = ply_buffer_get_bytes (plugin->boot_buffer);
-                view_write (view, bytes, size);
-        }
+static void
+view_scroll (view_t *view,
+             int     number_of_rows)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+        int scrollback_rows;
+
+        if (plugin->boot_buffer == NULL)
+                return;
+
+        scrollback_rows = MAX (0, view->scrollback_rows + number_of_rows);
+
+        /* Stop at the oldest output still kept */
+        if (scrollback_rows > view->scrollback_rows &&
+            find_start_of_last_rows (ply_buffer_get_bytes (plugin->boot_buffer),
+                                     ply_buffer_get_size (plugin->boot_buffer),
+                                     scrollback_rows + ply_text_display_get_number_of_rows (view->display),
+                                     ply_text_display_get_number_of_columns (view->display)) == 0)
+                return;
+
+        if (scrollback_rows == view->scrollback_rows)
+                return;
+
+        view->scrollback_rows = scrollback_rows;
+        ply_text_display_clear_screen (view->display);
+        view_write_boot_buffer_window (view);
+}
+
+static void
+view_return_to_live_output (view_t *view)
+{
+        if (view->scrollback_rows == 0)
+                return;
+
+        view->scrollback_rows = 0;
+        ply_text_display_clear_screen (view->display);
+        view_write_boot_buffer_window (view);
 }
 
 static void
@@ -244,12 +351,62 @@ write_on_views (ply_boot_splash_plugin_t *plugin,
                 view = ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (plugin->views, node);
 
+                view_return_to_live_output (view);
                 view_write (view, text, number_of_bytes);
 
                 node = next_node;
         }
 }
 
+static void
+on_keyboard_input (ply_boot_splash_plugin_t *plugin,
+                   const char               *keyboard_input,
+                   size_t                    character_size)
+{
+        ply_list_node_t *node;
+        int direction;
+
+        if (character_size == strlen (PAGE_UP_SEQUENCE) &&
+            strncmp (keyboard_input, PAGE_UP_SEQUENCE, character_size) == 0)
+                direction = 1;
+        else if (character_size == strlen (PAGE_DOWN_SEQUENCE) &&
+                 strncmp (keyboard_input, PAGE_DOWN_SEQUENCE, character_size) == 0)
+                direction = -1;
+        else
+                return;
+
+        ply_list_foreach (plugin->views, node) {
+                view_t *view = ply_list_node_get_data (node);
+                int page_size;
+
+                /* Keep a row of context between pages */
+                page_size = MAX (1, ply_text_display_get_number_of_rows (view->display) - 1);
+                view_scroll (view, direction * page_size);
+        }
+}
+
+static void
+set_keyboard (ply_boot_splash_plugin_t *plugin,
+              ply_keyboard_t           *keyboard)
+{
+        plugin->keyboard = keyboard;
+
+        ply_keyboard_add_input_handler (keyboard,
+                                        (ply_keyboard_input_handler_t)
+                                        on_keyboard_input, plugin);
+}
+
+static void
+unset_keyboard (ply_boot_splash_plugin_t *plugin,
+                ply_keyboard_t           *keyboard)
+{
+        ply_keyboard_remove_input_handler (keyboard,
+                                           (ply_keyboard_input_handler_t)
+                                           on_keyboard_input);
+
+        plugin->keyboard = NULL;
+}
+
 static void
 add_text_display (ply_boot_splash_plugin_t *plugin,
                   ply_text_display_t       *display)
@@ -298,8 +455,6 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                     ply_buffer_t             *boot_buffer,
                     ply_boot_splash_mode_t    mode)
 {
-        size_t size;
-
         assert (plugin != NULL);
 
         plugin->loop = loop;
@@ -310,10 +465,15 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                                        plugin);
 
         if (boot_buffer) {
+                ply_list_node_t *node;
+
                 plugin->boot_buffer = boot_buffer;
 
-                size = ply_buffer_get_size (boot_buffer);
-                write_on_views (plugin, ply_buffer_get_bytes (boot_buffer), size);
+                ply_list_foreach (plugin->views, node) {
+                        view_t *view = ply_list_node_get_data (node);
+
+                        view_write_boot_buffer_window (view);
+                }
         }
 
         return true;
@@ -333,9 +493,18 @@ on_boot_output (ply_boot_splash_plugin_t *plugin,
                 const char               *output,
                 size_t                    size)
 {
+        ply_list_node_t *node;
+
         ply_trace ("writing '%s' to all views (%d bytes)",
                    output, (int) size);
-        write_on_views (plugin, output, size);
+
+        /* Views that are scrolled back pick this up when they return */
+        ply_list_foreach (plugin->views, node) {
+                view_t *view = ply_list_node_get_data (node);
+
+                if (view->scrollback_rows == 0)
+                        view_write (view, output, size);
+        }
 }
 
 static void
@@ -449,6 +618,8 @@ ply_boot_splash_plugin_get_interface (void)
         {
                 .create_plugin       = create_plugin,
                 .destroy_plugin      = destroy_plugin,
+                .set_keyboard        = set_keyboard,
+                .unset_keyboard      = unset_keyboard,
                 .add_text_display    = add_text_display,
                 .remove_text_display = remove_text_display,
                 .show_splash_screen  = show_splash_screen,
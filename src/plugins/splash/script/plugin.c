@@ -45,6 +45,7 @@
 #include "ply-buffer.h"
 #include "ply-entry.h"
 #include "ply-event-loop.h"
+#include "ply-frame-governor.h"
 #include "ply-key-file.h"
 #include "ply-list.h"
 #include "ply-logger.h"
@@ -89,7 +90,11 @@ struct _ply_boot_splash_plugin
         script_lib_math_data_t     *script_math_lib;
         script_lib_string_data_t   *script_string_lib;
 
+        ply_frame_governor_t       *frame_governor;
+        int                         refresh_rate;
+
         uint32_t                    is_animating : 1;
+        uint32_t                    is_ticking : 1;
 };
 
 typedef struct
@@ -180,6 +185,8 @@ create_plugin (ply_key_file_t *key_file)
         ply_key_file_foreach_entry (key_file, add_script_env_var, plugin->script_env_vars);
 
         plugin->displays = ply_list_new ();
+        plugin->refresh_rate = FRAMES_PER_SECOND;
+        plugin->frame_governor = ply_frame_governor_new ("script refresh", plugin->refresh_rate);
         return plugin;
 }
 
@@ -210,6 +217,7 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
                 free (env_var);
         }
         ply_list_free (plugin->script_env_vars);
+        ply_frame_governor_free (plugin->frame_governor);
         free (plugin->script_filename);
         free (plugin->image_dir);
         free (plugin);
@@ -219,19 +227,55 @@ static void
 on_timeout (ply_boot_splash_plugin_t *plugin)
 {
         double sleep_time;
+        bool has_damage;
 
-        sleep_time = 1.0 / plugin->script_plymouth_lib->refresh_rate;
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        plugin->is_ticking = false;
+
+        if (plugin->script_plymouth_lib->refresh_rate != plugin->refresh_rate &&
+            plugin->script_plymouth_lib->refresh_rate > 0) {
+                plugin->refresh_rate = plugin->script_plymouth_lib->refresh_rate;
+                ply_frame_governor_set_frames_per_second (plugin->frame_governor,
+                                                          plugin->refresh_rate);
+        }
+
+        ply_frame_governor_begin_frame (plugin->frame_governor);
 
         script_lib_plymouth_on_refresh (plugin->script_state,
                                         plugin->script_plymouth_lib);
 
         pause_displays (plugin);
-        script_lib_sprite_refresh (plugin->script_sprite_lib);
+        has_damage = script_lib_sprite_refresh (plugin->script_sprite_lib);
         unpause_displays (plugin);
+
+        sleep_time = ply_frame_governor_end_frame (plugin->frame_governor);
+
+        /* Without a refresh function nothing on screen moves by itself, so
+         * stop ticking until one of the other callbacks gets run
+         */
+        if (!has_damage &&
+            script_obj_is_null (plugin->script_plymouth_lib->script_refresh_func)) {
+                ply_frame_governor_reset (plugin->frame_governor);
+                return;
+        }
+
+        plugin->is_ticking = true;
+        ply_event_loop_watch_for_timeout (plugin->loop,
+                                          sleep_time,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_timeout, plugin);
+}
+
+static void
+queue_refresh (ply_boot_splash_plugin_t *plugin)
+{
+        if (plugin->loop == NULL || !plugin->is_animating || plugin->is_ticking)
+                return;
+
+        plugin->is_ticking = true;
+        ply_event_loop_watch_for_timeout (plugin->loop,
+                                          1.0 / ply_frame_governor_get_frames_per_second (plugin->frame_governor),
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_timeout, plugin);
 }
 
 static void
@@ -243,6 +287,9 @@ on_boot_progress (ply_boot_splash_plugin_t *plugin,
                                               plugin->script_plymouth_lib,
                                               duration,
                                               fraction_done);
+
+        if (!script_obj_is_null (plugin->script_plymouth_lib->script_boot_progress_func))
+                queue_refresh (plugin);
 }
 
 static bool
@@ -317,10 +364,11 @@ stop_script_animation (ply_boot_splash_plugin_t *plugin)
                                      plugin->script_plymouth_lib);
         script_lib_sprite_refresh (plugin->script_sprite_lib);
 
-        if (plugin->loop != NULL)
+        if (plugin->loop != NULL && plugin->is_ticking)
                 ply_event_loop_stop_watching_for_timeout (plugin->loop,
                                                           (ply_event_loop_timeout_handler_t)
                                                           on_timeout, plugin);
+        plugin->is_ticking = false;
 
         if (plugin->keyboard != NULL) {
                 ply_keyboard_remove_input_handler (plugin->keyboard,
@@ -372,6 +420,7 @@ on_keyboard_input (ply_boot_splash_plugin_t *plugin,
         script_lib_plymouth_on_keyboard_input (plugin->script_state,
                                                plugin->script_plymouth_lib,
                                                keyboard_string);
+        queue_refresh (plugin);
 }
 
 static void
@@ -397,6 +446,7 @@ add_pixel_display (ply_boot_splash_plugin_t *plugin,
         if (plugin->script_sprite_lib != NULL) {
                 script_lib_sprite_pixel_display_added (plugin->script_sprite_lib, display);
                 script_lib_plymouth_on_display_hotplug (plugin->script_state, plugin->script_plymouth_lib);
+                queue_refresh (plugin);
         }
 }
 
@@ -407,6 +457,7 @@ remove_pixel_display (ply_boot_splash_plugin_t *plugin,
         if (plugin->script_sprite_lib != NULL) {
                 script_lib_sprite_pixel_display_removed (plugin->script_sprite_lib, display);
                 script_lib_plymouth_on_display_hotplug (plugin->script_state, plugin->script_plymouth_lib);
+                queue_refresh (plugin);
         }
 
         ply_list_remove_data (plugin->displays, display);
@@ -443,6 +494,7 @@ system_update (ply_boot_splash_plugin_t *plugin,
         script_lib_plymouth_on_system_update (plugin->script_state,
                                               plugin->script_plymouth_lib,
                                               progress);
+        queue_refresh (plugin);
 }
 
 static void
@@ -452,6 +504,7 @@ update_status (ply_boot_splash_plugin_t *plugin,
         script_lib_plymouth_on_update_status (plugin->script_state,
                                               plugin->script_plymouth_lib,
                                               status);
+        queue_refresh (plugin);
 }
 
 static void
@@ -476,6 +529,7 @@ on_root_mounted (ply_boot_splash_plugin_t *plugin)
 {
         script_lib_plymouth_on_root_mounted (plugin->script_state,
                                              plugin->script_plymouth_lib);
+        queue_refresh (plugin);
 }
 
 static void
@@ -492,6 +546,7 @@ display_normal (ply_boot_splash_plugin_t *plugin)
         script_lib_plymouth_on_display_normal (plugin->script_state,
                                                plugin->script_plymouth_lib);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 static void
@@ -505,6 +560,7 @@ display_password (ply_boot_splash_plugin_t *plugin,
                                                  prompt,
                                                  bullets);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 static void
@@ -518,6 +574,7 @@ display_question (ply_boot_splash_plugin_t *plugin,
                                                  prompt,
                                                  entry_text);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 static bool
@@ -525,10 +582,15 @@ validate_input (ply_boot_splash_plugin_t *plugin,
                 const char               *entry_text,
                 const char               *add_text)
 {
-        return script_lib_plymouth_on_validate_input (plugin->script_state,
-                                                      plugin->script_plymouth_lib,
-                                                      entry_text,
-                                                      add_text);
+        bool is_valid;
+
+        is_valid = script_lib_plymouth_on_validate_input (plugin->script_state,
+                                                          plugin->script_plymouth_lib,
+                                                          entry_text,
+                                                          add_text);
+        queue_refresh (plugin);
+
+        return is_valid;
 }
 
 static void
@@ -544,6 +606,7 @@ display_prompt (ply_boot_splash_plugin_t *plugin,
                                                entry_text,
                                                is_secret);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 static void
@@ -555,6 +618,7 @@ display_message (ply_boot_splash_plugin_t *plugin,
                                                 plugin->script_plymouth_lib,
                                                 message);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 static void
@@ -566,6 +630,7 @@ hide_message (ply_boot_splash_plugin_t *plugin,
                                              plugin->script_plymouth_lib,
                                              message);
         unpause_displays (plugin);
+        queue_refresh (plugin);
 }
 
 ply_boot_splash_plugin_interface_t *
@@ -755,15 +755,17 @@ void script_lib_sprite_pixel_display_removed (script_lib_sprite_data_t *data,
                 update_displays (data);
 }
 
-void
+/* Returns true if anything had to be redrawn */
+bool
 script_lib_sprite_refresh (script_lib_sprite_data_t *data)
 {
         ply_list_node_t *node;
         ply_region_t *region;
         ply_list_t *rectable_list;
+        bool has_damage;
 
         if (!data)
-                return;
+                return false;
 
         region = ply_region_new ();
 
@@ -838,6 +840,7 @@ script_lib_sprite_refresh (script_lib_sprite_data_t *data)
         }
 
         rectable_list = ply_region_get_rectangle_list (region);
+        has_damage = ply_list_get_length (rectable_list) > 0;
 
         for (node = ply_list_get_first_node (rectable_list);
              node;
@@ -851,6 +854,8 @@ script_lib_sprite_refresh (script_lib_sprite_data_t *data)
         }
 
         ply_region_free (region);
+
+        return has_damage;
 }
 
 void script_lib_sprite_destroy (script_lib_sprite_data_t *data)
@@ -121,6 +121,7 @@ view_show_message (view_t *view)
         display_width = ply_text_display_get_number_of_columns (view->display);
         display_height = ply_text_display_get_number_of_rows (view->display);
 
+        ply_text_display_begin_frame (view->display);
         ply_text_display_set_cursor_position (view->display, 0,
                                               display_height / 2);
         ply_text_display_clear_line (view->display);
@@ -130,6 +131,7 @@ view_show_message (view_t *view)
                                               display_height / 2);
 
         ply_text_display_write (view->display, "%s", plugin->message);
+        ply_text_display_end_frame (view->display);
 }
 
 static void
@@ -142,6 +144,8 @@ view_show_prompt (view_t     *view,
 
         display_width = ply_text_display_get_number_of_columns (view->display);
         display_height = ply_text_display_get_number_of_rows (view->display);
+
+        ply_text_display_begin_frame (view->display);
         ply_text_display_set_background_color (view->display, PLY_TERMINAL_COLOR_DEFAULT);
         ply_text_display_clear_screen (view->display);
 
@@ -156,6 +160,7 @@ view_show_prompt (view_t     *view,
                                               display_height / 2);
 
         ply_text_display_write (view->display, "%s:%s", prompt, entered_text);
+        ply_text_display_end_frame (view->display);
 
         ply_text_display_show_cursor (view->display);
 }
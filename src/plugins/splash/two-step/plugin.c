@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -40,6 +41,7 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include "ply-bgrt.h"
 #include "ply-boot-splash-plugin.h"
 #include "ply-buffer.h"
 #include "ply-capslock-icon.h"
@@ -75,11 +77,8 @@
 #define PROGRESS_BAR_WIDTH  400
 #define PROGRESS_BAR_HEIGHT 5
 
-#define BGRT_STATUS_ORIENTATION_OFFSET_0    (0 << 1)
-#define BGRT_STATUS_ORIENTATION_OFFSET_90   (1 << 1)
-#define BGRT_STATUS_ORIENTATION_OFFSET_180  (2 << 1)
-#define BGRT_STATUS_ORIENTATION_OFFSET_270  (3 << 1)
-#define BGRT_STATUS_ORIENTATION_OFFSET_MASK (3 << 1)
+/* How long after the splash is shown to load the end animation */
+#define END_ANIMATION_PREFETCH_DELAY 1.0
 
 typedef enum
 {
@@ -94,6 +93,23 @@ typedef enum
         PROGRESS_FUNCTION_TYPE_LINEAR,
 } progress_function_t;
 
+/* A firmware logo background, shared by all views of the same size,
+ * scale and panel properties */
+typedef struct
+{
+        int                         screen_width;
+        int                         screen_height;
+        int                         screen_scale;
+        int                         panel_width;
+        int                         panel_height;
+        int                         panel_scale;
+        ply_pixel_buffer_rotation_t panel_rotation;
+        bool                        have_panel_props;
+
+        ply_pixel_buffer_t         *buffer;
+        int                         reference_count;
+} bgrt_background_t;
+
 typedef struct
 {
         ply_boot_splash_plugin_t *plugin;
@@ -112,7 +128,10 @@ typedef struct
         ply_rectangle_t           box_area, lock_area, watermark_area, dialog_area, secure_boot_area;
         ply_trigger_t            *end_trigger;
         ply_pixel_buffer_t       *background_buffer;
+        bgrt_background_t        *bgrt_background;
         int                       animation_bottom;
+
+        uint32_t                  prompt_is_loaded : 1;
 } view_t;
 
 typedef struct
@@ -143,6 +162,7 @@ struct _ply_boot_splash_plugin
         ply_image_t                        *watermark_image;
         ply_image_t                        *secure_boot_warning_image;
         ply_list_t                         *views;
+        ply_list_t                         *bgrt_backgrounds;
 
         ply_boot_splash_display_type_t      state;
 
@@ -162,6 +182,7 @@ struct _ply_boot_splash_plugin
         double                              animation_horizontal_alignment;
         double                              animation_vertical_alignment;
         char                               *animation_dir;
+        const char                         *end_animation_prefix;
 
         ply_progress_animation_transition_t transition;
         double                              transition_duration;
@@ -191,12 +212,17 @@ struct _ply_boot_splash_plugin
         uint32_t                            use_firmware_background : 1;
         uint32_t                            dialog_clears_firmware_background : 1;
         uint32_t                            message_below_animation : 1;
+        uint32_t                            background_bgrt_fallback_is_loaded : 1;
+        uint32_t                            prompt_is_loaded : 1;
+        uint32_t                            end_animation_prefetch_is_pending : 1;
+        uint32_t                            end_animation_is_prefetched : 1;
 };
 
 ply_boot_splash_plugin_interface_t *ply_boot_splash_plugin_get_interface (void);
 
 static void stop_animation (ply_boot_splash_plugin_t *plugin);
 static void detach_from_event_loop (ply_boot_splash_plugin_t *plugin);
+static void cancel_end_animation_prefetch (ply_boot_splash_plugin_t *plugin);
 static void display_message (ply_boot_splash_plugin_t *plugin,
                              const char               *message);
 static void become_idle (ply_boot_splash_plugin_t *plugin,
@@ -214,9 +240,6 @@ view_new (ply_boot_splash_plugin_t *plugin,
         view->plugin = plugin;
         view->display = display;
 
-        view->entry = ply_entry_new (plugin->animation_dir);
-        view->keymap_icon = ply_keymap_icon_new (display, plugin->animation_dir);
-        view->capslock_icon = ply_capslock_icon_new (plugin->animation_dir);
         view->progress_animation = ply_progress_animation_new (plugin->animation_dir,
                                                                "progress-");
         ply_progress_animation_set_transition (view->progress_animation,
@@ -246,12 +269,28 @@ view_new (ply_boot_splash_plugin_t *plugin,
         return view;
 }
 
+static void
+unref_bgrt_background (ply_boot_splash_plugin_t *plugin,
+                       bgrt_background_t        *background)
+{
+        background->reference_count--;
+
+        if (background->reference_count > 0)
+                return;
+
+        ply_list_remove_data (plugin->bgrt_backgrounds, background);
+        ply_pixel_buffer_free (background->buffer);
+        free (background);
+}
+
 static void
 view_free (view_t *view)
 {
-        ply_entry_free (view->entry);
-        ply_keymap_icon_free (view->keymap_icon);
-        ply_capslock_icon_free (view->capslock_icon);
+        if (view->prompt_is_loaded) {
+                ply_entry_free (view->entry);
+                ply_keymap_icon_free (view->keymap_icon);
+                ply_capslock_icon_free (view->capslock_icon);
+        }
         ply_animation_free (view->end_animation);
         ply_progress_animation_free (view->progress_animation);
         ply_progress_bar_free (view->progress_bar);
@@ -261,22 +300,50 @@ view_free (view_t *view)
         ply_label_free (view->title_label);
         ply_label_free (view->subtitle_label);
 
-        if (view->background_buffer != NULL)
+        if (view->bgrt_background != NULL)
+                unref_bgrt_background (view->plugin, view->bgrt_background);
+        else if (view->background_buffer != NULL)
                 ply_pixel_buffer_free (view->background_buffer);
 
         free (view);
 }
 
-static void
-view_load_end_animation (view_t *view)
+static bool
+has_animation_frames (const char *image_dir,
+                      const char *frames_prefix)
 {
-        ply_boot_splash_plugin_t *plugin = view->plugin;
-        const char *animation_prefix;
+        struct dirent *entry;
+        bool has_frames = false;
+        size_t length;
+        DIR *dir;
 
-        if (!plugin->mode_settings[plugin->mode].use_end_animation)
-                return;
+        dir = opendir (image_dir);
 
-        ply_trace ("loading animation");
+        if (dir == NULL)
+                return false;
+
+        while ((entry = readdir (dir)) != NULL) {
+                length = strlen (entry->d_name);
+
+                if (strncmp (entry->d_name, frames_prefix, strlen (frames_prefix)) == 0 &&
+                    length > 4 && strcmp (entry->d_name + length - 4, ".png") == 0) {
+                        has_frames = true;
+                        break;
+                }
+        }
+
+        closedir (dir);
+
+        return has_frames;
+}
+
+/* Only looks at file names, the frames get loaded later by
+ * view_load_end_animation
+ */
+static const char *
+find_end_animation_prefix (ply_boot_splash_plugin_t *plugin)
+{
+        const char *animation_prefix;
 
         switch (plugin->mode) {
         case PLY_BOOT_SPLASH_MODE_BOOT_UP:
@@ -292,104 +359,85 @@ view_load_end_animation (view_t *view)
         case PLY_BOOT_SPLASH_MODE_INVALID:
         default:
                 ply_trace ("unexpected splash mode 0x%x\n", plugin->mode);
-                return;
+                return NULL;
         }
 
         ply_trace ("trying prefix: %s", animation_prefix);
-        view->end_animation = ply_animation_new (plugin->animation_dir,
-                                                 animation_prefix);
+        if (has_animation_frames (plugin->animation_dir, animation_prefix))
+                return animation_prefix;
 
-        if (ply_animation_load (view->end_animation))
+        ply_trace ("now trying more general prefix: animation-");
+        if (has_animation_frames (plugin->animation_dir, "animation-"))
+                return "animation-";
+
+        ply_trace ("now trying old compat prefix: throbber-");
+        if (has_animation_frames (plugin->animation_dir, "throbber-"))
+                return "throbber-";
+
+        return NULL;
+}
+
+static void
+view_load_end_animation (view_t *view)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+
+        if (!plugin->mode_settings[plugin->mode].use_end_animation)
                 return;
-        ply_animation_free (view->end_animation);
 
-        ply_trace ("now trying more general prefix: animation-");
-        view->end_animation = ply_animation_new (plugin->animation_dir,
-                                                 "animation-");
-        if (ply_animation_load (view->end_animation))
+        if (view->end_animation != NULL)
                 return;
-        ply_animation_free (view->end_animation);
 
-        ply_trace ("now trying old compat prefix: throbber-");
+        ply_trace ("loading animation with prefix %s", plugin->end_animation_prefix);
         view->end_animation = ply_animation_new (plugin->animation_dir,
-                                                 "throbber-");
-        if (ply_animation_load (view->end_animation)) {
-                /* files named throbber- are for end animation, so
-                 * there's no throbber */
-                ply_throbber_free (view->throbber);
-                view->throbber = NULL;
+                                                 plugin->end_animation_prefix);
+
+        if (ply_animation_load (view->end_animation))
                 return;
-        }
 
         ply_trace ("optional animation didn't load");
         ply_animation_free (view->end_animation);
         view->end_animation = NULL;
-        plugin->mode_settings[plugin->mode].use_end_animation = false;
 }
 
-static bool
-get_bgrt_sysfs_info (int                         *x_offset,
-                     int                         *y_offset,
-                     ply_pixel_buffer_rotation_t *rotation)
+static ply_image_t *
+load_image (ply_boot_splash_plugin_t *plugin,
+            const char               *name)
 {
-        bool ret = false;
-        char buf[64];
-        int status;
-        FILE *f;
-
-        f = fopen ("/sys/firmware/acpi/bgrt/status", "r");
-        if (!f)
-                return false;
-
-        if (!fgets (buf, sizeof(buf), f))
-                goto out;
+        ply_image_t *image;
+        char *image_path;
 
-        if (sscanf (buf, "%d", &status) != 1)
-                goto out;
-
-        fclose (f);
+        asprintf (&image_path, "%s/%s", plugin->animation_dir, name);
+        image = ply_image_new (image_path);
+        free (image_path);
 
-        switch (status & BGRT_STATUS_ORIENTATION_OFFSET_MASK) {
-        case BGRT_STATUS_ORIENTATION_OFFSET_0:
-                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
-                break;
-        case BGRT_STATUS_ORIENTATION_OFFSET_90:
-                *rotation = PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE;
-                break;
-        case BGRT_STATUS_ORIENTATION_OFFSET_180:
-                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN;
-                break;
-        case BGRT_STATUS_ORIENTATION_OFFSET_270:
-                *rotation = PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE;
-                break;
+        ply_trace ("loading %s", name);
+        if (!ply_image_load (image)) {
+                ply_image_free (image);
+                return NULL;
         }
 
-        f = fopen ("/sys/firmware/acpi/bgrt/xoffset", "r");
-        if (!f)
-                return false;
-
-        if (!fgets (buf, sizeof(buf), f))
-                goto out;
-
-        if (sscanf (buf, "%d", x_offset) != 1)
-                goto out;
-
-        fclose (f);
+        return image;
+}
 
-        f = fopen ("/sys/firmware/acpi/bgrt/yoffset", "r");
-        if (!f)
+static bool
+load_background_bgrt_fallback_image (ply_boot_splash_plugin_t *plugin)
+{
+        if (plugin->background_bgrt_fallback_image == NULL)
                 return false;
 
-        if (!fgets (buf, sizeof(buf), f))
-                goto out;
+        if (plugin->background_bgrt_fallback_is_loaded)
+                return true;
 
-        if (sscanf (buf, "%d", y_offset) != 1)
-                goto out;
+        ply_trace ("loading background bgrt fallback image");
+        if (!ply_image_load (plugin->background_bgrt_fallback_image)) {
+                ply_image_free (plugin->background_bgrt_fallback_image);
+                plugin->background_bgrt_fallback_image = NULL;
+                return false;
+        }
 
-        ret = true;
-out:
-        fclose (f);
-        return ret;
+        plugin->background_bgrt_fallback_is_loaded = true;
+        return true;
 }
 
 /* The Microsoft boot logo spec says that the logo must use a black background
@@ -403,35 +451,29 @@ out:
  * that is based on the EFI fb resolution which may not be the native
  * resolution of the screen (esp. when using multiple heads).
  */
-static void
-view_set_bgrt_background (view_t *view)
+static ply_pixel_buffer_t *
+create_bgrt_background_buffer (ply_boot_splash_plugin_t *plugin,
+                               bgrt_background_t        *background)
 {
-        ply_pixel_buffer_rotation_t panel_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+        ply_pixel_buffer_rotation_t panel_rotation = background->panel_rotation;
         ply_pixel_buffer_rotation_t bgrt_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
         int x_offset, y_offset, sysfs_x_offset, sysfs_y_offset, width, height;
-        int panel_width = 0, panel_height = 0, panel_scale = 1;
-        int screen_width, screen_height, screen_scale;
-        ply_pixel_buffer_t *bgrt_buffer;
-        bool have_panel_props;
-
-        if (!view->plugin->background_bgrt_image)
-                return;
-
-        if (!get_bgrt_sysfs_info (&sysfs_x_offset, &sysfs_y_offset,
-                                  &bgrt_rotation)) {
+        int panel_width = background->panel_width;
+        int panel_height = background->panel_height;
+        int panel_scale = background->panel_scale;
+        int screen_width = background->screen_width;
+        int screen_height = background->screen_height;
+        int screen_scale = background->screen_scale;
+        bool have_panel_props = background->have_panel_props;
+        ply_pixel_buffer_t *bgrt_buffer, *buffer;
+
+        if (!ply_bgrt_get_placement (&sysfs_x_offset, &sysfs_y_offset,
+                                     &bgrt_rotation)) {
                 ply_trace ("get bgrt sysfs info failed");
-                return;
+                return NULL;
         }
 
-        screen_width = ply_pixel_display_get_width (view->display);
-        screen_height = ply_pixel_display_get_height (view->display);
-        screen_scale = ply_pixel_display_get_device_scale (view->display);
-
-        bgrt_buffer = ply_image_get_buffer (view->plugin->background_bgrt_image);
-
-        have_panel_props = ply_renderer_get_panel_properties (ply_pixel_display_get_renderer (view->display),
-                                                              &panel_width, &panel_height,
-                                                              &panel_rotation, &panel_scale);
+        bgrt_buffer = ply_image_get_buffer (plugin->background_bgrt_image);
 
         /*
          * Some buggy Lenovo 2-in-1s with a 90 degree rotated panel, behave as
@@ -446,8 +488,8 @@ view_set_bgrt_background (view_t *view)
         if (have_panel_props &&
             (panel_rotation == PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE ||
              panel_rotation == PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE) &&
-            (panel_width - view->plugin->background_bgrt_raw_width) / 2 != sysfs_x_offset &&
-            (panel_height - view->plugin->background_bgrt_raw_width) / 2 == sysfs_x_offset)
+            (panel_width - plugin->background_bgrt_raw_width) / 2 != sysfs_x_offset &&
+            (panel_height - plugin->background_bgrt_raw_width) / 2 == sysfs_x_offset)
                 bgrt_rotation = panel_rotation;
 
         /*
@@ -465,7 +507,7 @@ view_set_bgrt_background (view_t *view)
         if (bgrt_rotation != PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
                 if (bgrt_rotation != panel_rotation) {
                         ply_trace ("bgrt orientation mismatch, bgrt_rot %d panel_rot %d", (int) bgrt_rotation, (int) panel_rotation);
-                        return;
+                        return NULL;
                 }
 
                 /* Set panel properties to their post-rotations values */
@@ -478,9 +520,13 @@ view_set_bgrt_background (view_t *view)
                 panel_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
         }
 
+        /* The image is shared, so don't keep what the last view set */
         if (have_panel_props) {
                 ply_pixel_buffer_set_device_rotation (bgrt_buffer, panel_rotation);
                 ply_pixel_buffer_set_device_scale (bgrt_buffer, panel_scale);
+        } else {
+                ply_pixel_buffer_set_device_rotation (bgrt_buffer, PLY_PIXEL_BUFFER_ROTATE_UPRIGHT);
+                ply_pixel_buffer_set_device_scale (bgrt_buffer, 1);
         }
 
         width = ply_pixel_buffer_get_width (bgrt_buffer);
@@ -508,7 +554,7 @@ view_set_bgrt_background (view_t *view)
          * between the (external) screen's and the panel's resolution.
          */
         if (have_panel_props &&
-            (panel_width - view->plugin->background_bgrt_raw_width) / 2 == sysfs_x_offset) {
+            (panel_width - plugin->background_bgrt_raw_width) / 2 == sysfs_x_offset) {
                 if (panel_rotation == PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE ||
                     panel_rotation == PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE) {
                         /*
@@ -519,7 +565,7 @@ view_set_bgrt_background (view_t *view)
                          * to "flip" the y_offset in this case.
                          */
                         if (panel_rotation == PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE)
-                                sysfs_y_offset = panel_height - view->plugin->background_bgrt_raw_height - sysfs_y_offset;
+                                sysfs_y_offset = panel_height - plugin->background_bgrt_raw_height - sysfs_y_offset;
 
                         /* 90 degrees rotated, swap x and y */
                         x_offset = sysfs_y_offset / panel_scale;
@@ -558,14 +604,83 @@ view_set_bgrt_background (view_t *view)
         ply_trace ("using %dx%d bgrt image centered at %dx%d for %dx%d screen",
                    width, height, x_offset, y_offset, screen_width, screen_height);
 
-        view->background_buffer = ply_pixel_buffer_new (screen_width * screen_scale, screen_height * screen_scale);
-        ply_pixel_buffer_set_device_scale (view->background_buffer, screen_scale);
-        ply_pixel_buffer_fill_with_hex_color (view->background_buffer, NULL, 0x000000);
+        buffer = ply_pixel_buffer_new (screen_width * screen_scale, screen_height * screen_scale);
+        ply_pixel_buffer_set_device_scale (buffer, screen_scale);
+        ply_pixel_buffer_fill_with_hex_color (buffer, NULL, 0x000000);
         if (x_offset >= 0 && y_offset >= 0) {
                 bgrt_buffer = ply_pixel_buffer_rotate_upright (bgrt_buffer);
-                ply_pixel_buffer_fill_with_buffer (view->background_buffer, bgrt_buffer, x_offset, y_offset);
+                ply_pixel_buffer_fill_with_buffer (buffer, bgrt_buffer, x_offset, y_offset);
                 ply_pixel_buffer_free (bgrt_buffer);
         }
+
+        return buffer;
+}
+
+static bool
+bgrt_background_matches (bgrt_background_t *a,
+                         bgrt_background_t *b)
+{
+        return a->screen_width == b->screen_width &&
+               a->screen_height == b->screen_height &&
+               a->screen_scale == b->screen_scale &&
+               a->have_panel_props == b->have_panel_props &&
+               a->panel_width == b->panel_width &&
+               a->panel_height == b->panel_height &&
+               a->panel_scale == b->panel_scale &&
+               a->panel_rotation == b->panel_rotation;
+}
+
+static void
+view_set_bgrt_background (view_t *view)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+        bgrt_background_t key = { 0 }, *background;
+        ply_list_node_t *node;
+
+        if (!plugin->background_bgrt_image || view->bgrt_background != NULL)
+                return;
+
+        key.screen_width = ply_pixel_display_get_width (view->display);
+        key.screen_height = ply_pixel_display_get_height (view->display);
+        key.screen_scale = ply_pixel_display_get_device_scale (view->display);
+
+        key.panel_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+        key.panel_scale = 1;
+        key.have_panel_props = ply_renderer_get_panel_properties (ply_pixel_display_get_renderer (view->display),
+                                                                  &key.panel_width, &key.panel_height,
+                                                                  &key.panel_rotation, &key.panel_scale);
+        if (!key.have_panel_props) {
+                key.panel_width = 0;
+                key.panel_height = 0;
+                key.panel_rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+                key.panel_scale = 1;
+        }
+
+        ply_list_foreach (plugin->bgrt_backgrounds, node) {
+                background = ply_list_node_get_data (node);
+
+                if (bgrt_background_matches (background, &key)) {
+                        ply_trace ("sharing bgrt background for %dx%d screen",
+                                   key.screen_width, key.screen_height);
+                        background->reference_count++;
+                        view->bgrt_background = background;
+                        view->background_buffer = background->buffer;
+                        return;
+                }
+        }
+
+        key.buffer = create_bgrt_background_buffer (plugin, &key);
+
+        if (key.buffer == NULL)
+                return;
+
+        background = calloc (1, sizeof(bgrt_background_t));
+        *background = key;
+        background->reference_count = 1;
+        ply_list_append_data (plugin->bgrt_backgrounds, background);
+
+        view->bgrt_background = background;
+        view->background_buffer = background->buffer;
 }
 
 static void
@@ -612,7 +727,7 @@ view_load (view_t *view)
 
         view_set_bgrt_background (view);
 
-        if (!view->background_buffer && plugin->background_bgrt_fallback_image != NULL)
+        if (!view->background_buffer && load_background_bgrt_fallback_image (plugin))
                 view_set_bgrt_fallback_background (view);
 
         if (!view->background_buffer && plugin->background_tile_image != NULL) {
@@ -657,14 +772,16 @@ view_load (view_t *view)
                            screen_width, screen_height);
         }
 
-        ply_trace ("loading entry");
-        if (!ply_entry_load (view->entry))
-                return false;
-
-        ply_keymap_icon_load (view->keymap_icon);
-        ply_capslock_icon_load (view->capslock_icon);
+        /* files named throbber- are for end animation, so
+         * there's no throbber */
+        if (plugin->mode_settings[plugin->mode].use_end_animation &&
+            strcmp (plugin->end_animation_prefix, "throbber-") == 0) {
+                ply_throbber_free (view->throbber);
+                view->throbber = NULL;
+        }
 
-        view_load_end_animation (view);
+        if (plugin->end_animation_is_prefetched)
+                view_load_end_animation (view);
 
         if (view->progress_animation != NULL) {
                 ply_trace ("loading progress animation");
@@ -819,6 +936,11 @@ view_start_end_animation (view_t        *view,
         if (view->progress_animation != NULL)
                 ply_progress_animation_hide (view->progress_animation);
 
+        if (view->end_animation == NULL) {
+                ply_trigger_pull (trigger, NULL);
+                return;
+        }
+
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
         width = ply_animation_get_width (view->end_animation);
@@ -909,6 +1031,50 @@ view_start_progress_animation (view_t *view)
         }
 }
 
+static bool
+view_load_prompt (view_t *view)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+
+        if (view->prompt_is_loaded)
+                return true;
+
+        view->entry = ply_entry_new (plugin->animation_dir);
+
+        ply_trace ("loading entry");
+        if (!ply_entry_load (view->entry)) {
+                ply_entry_free (view->entry);
+                view->entry = NULL;
+                return false;
+        }
+
+        view->keymap_icon = ply_keymap_icon_new (view->display, plugin->animation_dir);
+        ply_keymap_icon_load (view->keymap_icon);
+
+        view->capslock_icon = ply_capslock_icon_new (plugin->animation_dir);
+        ply_capslock_icon_load (view->capslock_icon);
+
+        view->prompt_is_loaded = true;
+
+        return true;
+}
+
+static void
+view_unload_prompt (view_t *view)
+{
+        if (!view->prompt_is_loaded)
+                return;
+
+        ply_entry_free (view->entry);
+        view->entry = NULL;
+        ply_keymap_icon_free (view->keymap_icon);
+        view->keymap_icon = NULL;
+        ply_capslock_icon_free (view->capslock_icon);
+        view->capslock_icon = NULL;
+
+        view->prompt_is_loaded = false;
+}
+
 static void
 view_show_prompt (view_t     *view,
                   const char *prompt,
@@ -926,12 +1092,19 @@ view_show_prompt (view_t     *view,
 
         plugin = view->plugin;
 
+        if (!view_load_prompt (view)) {
+                ply_trace ("couldn't load entry, not showing prompt");
+                return;
+        }
+
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
 
         if (ply_entry_is_hidden (view->entry)) {
-                view->lock_area.width = ply_image_get_width (plugin->lock_image);
-                view->lock_area.height = ply_image_get_height (plugin->lock_image);
+                if (plugin->lock_image != NULL) {
+                        view->lock_area.width = ply_image_get_width (plugin->lock_image);
+                        view->lock_area.height = ply_image_get_height (plugin->lock_image);
+                }
 
                 entry_width = ply_entry_get_width (view->entry);
                 entry_height = ply_entry_get_height (view->entry);
@@ -1014,9 +1187,11 @@ view_hide_prompt (view_t *view)
 {
         assert (view != NULL);
 
-        ply_entry_hide (view->entry);
-        ply_capslock_icon_hide (view->capslock_icon);
-        ply_keymap_icon_hide (view->keymap_icon);
+        if (view->prompt_is_loaded) {
+                ply_entry_hide (view->entry);
+                ply_capslock_icon_hide (view->capslock_icon);
+                ply_keymap_icon_hide (view->keymap_icon);
+        }
         ply_label_hide (view->label);
 }
 
@@ -1075,14 +1250,6 @@ create_plugin (ply_key_file_t *key_file)
 
         ply_trace ("Using '%s' as working directory", image_dir);
 
-        asprintf (&image_path, "%s/lock.png", image_dir);
-        plugin->lock_image = ply_image_new (image_path);
-        free (image_path);
-
-        asprintf (&image_path, "%s/box.png", image_dir);
-        plugin->box_image = ply_image_new (image_path);
-        free (image_path);
-
         asprintf (&image_path, "%s/corner-image.png", image_dir);
         plugin->corner_image = ply_image_new (image_path);
         free (image_path);
@@ -1213,8 +1380,6 @@ create_plugin (ply_key_file_t *key_file)
         load_mode_settings (plugin, key_file, "firmware-upgrade", PLY_BOOT_SPLASH_MODE_FIRMWARE_UPGRADE);
 
         if (plugin->use_firmware_background) {
-                plugin->background_bgrt_image = ply_image_new ("/sys/firmware/acpi/bgrt/image");
-
                 asprintf (&image_path, "%s/bgrt-fallback.png", image_dir);
                 plugin->background_bgrt_fallback_image = ply_image_new (image_path);
                 free (image_path);
@@ -1251,6 +1416,7 @@ create_plugin (ply_key_file_t *key_file)
         free (show_animation_fraction);
 
         plugin->views = ply_list_new ();
+        plugin->bgrt_backgrounds = ply_list_new ();
 
         return plugin;
 }
@@ -1293,6 +1459,7 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 
         if (plugin->loop != NULL) {
                 stop_animation (plugin);
+                cancel_end_animation_prefetch (plugin);
 
                 ply_event_loop_stop_watching_for_exit (plugin->loop, (ply_event_loop_exit_handler_t)
                                                        detach_from_event_loop,
@@ -1300,7 +1467,8 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
                 detach_from_event_loop (plugin);
         }
 
-        ply_image_free (plugin->lock_image);
+        if (plugin->lock_image != NULL)
+                ply_image_free (plugin->lock_image);
 
         if (plugin->box_image != NULL)
                 ply_image_free (plugin->box_image);
@@ -1314,9 +1482,6 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
         if (plugin->background_tile_image != NULL)
                 ply_image_free (plugin->background_tile_image);
 
-        if (plugin->background_bgrt_image != NULL)
-                ply_image_free (plugin->background_bgrt_image);
-
         if (plugin->background_bgrt_fallback_image != NULL)
                 ply_image_free (plugin->background_bgrt_fallback_image);
 
@@ -1332,6 +1497,7 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
         free (plugin->title_font);
         free (plugin->animation_dir);
         free_views (plugin);
+        ply_list_free (plugin->bgrt_backgrounds);
         free (plugin);
 }
 
@@ -1372,6 +1538,7 @@ start_end_animation (ply_boot_splash_plugin_t *plugin,
         while (node != NULL) {
                 view = ply_list_node_get_data (node);
 
+                view_load_end_animation (view);
                 ply_trigger_ignore_next_pull (trigger);
 
                 if (view->throbber != NULL) {
@@ -1553,23 +1720,27 @@ on_draw (view_t             *view,
                                                                 box_data);
                 }
 
-                ply_entry_draw_area (view->entry,
-                                     pixel_buffer,
-                                     x, y, width, height);
-                ply_keymap_icon_draw_area (view->keymap_icon,
-                                           pixel_buffer,
-                                           x, y, width, height);
-                ply_capslock_icon_draw_area (view->capslock_icon,
+                if (view->prompt_is_loaded) {
+                        ply_entry_draw_area (view->entry,
                                              pixel_buffer,
                                              x, y, width, height);
+                        ply_keymap_icon_draw_area (view->keymap_icon,
+                                                   pixel_buffer,
+                                                   x, y, width, height);
+                        ply_capslock_icon_draw_area (view->capslock_icon,
+                                                     pixel_buffer,
+                                                     x, y, width, height);
+                }
                 ply_label_draw_area (view->label,
                                      pixel_buffer,
                                      x, y, width, height);
 
-                lock_data = ply_image_get_data (plugin->lock_image);
-                ply_pixel_buffer_fill_with_argb32_data (pixel_buffer,
-                                                        &view->lock_area,
-                                                        lock_data);
+                if (plugin->lock_image != NULL) {
+                        lock_data = ply_image_get_data (plugin->lock_image);
+                        ply_pixel_buffer_fill_with_argb32_data (pixel_buffer,
+                                                                &view->lock_area,
+                                                                lock_data);
+                }
         } else {
                 if (plugin->mode_settings[plugin->mode].use_progress_bar)
                         ply_progress_bar_draw_area (view->progress_bar, pixel_buffer,
@@ -1645,6 +1816,11 @@ add_pixel_display (ply_boot_splash_plugin_t *plugin,
         ply_pixel_display_set_draw_handler (view->display,
                                             (ply_pixel_display_draw_handler_t)
                                             on_draw, view);
+        /* on_draw only reads plugin state and draws view state, clipped
+         * to the area it's given
+         */
+        ply_pixel_display_set_draw_handler_is_thread_safe (view->display, true);
+        ply_pixel_display_set_draw_handler_can_draw_tiles (view->display, true);
         if (plugin->is_visible) {
                 if (view_load (view)) {
                         ply_list_append_data (plugin->views, view);
@@ -1684,6 +1860,58 @@ remove_pixel_display (ply_boot_splash_plugin_t *plugin,
         }
 }
 
+static bool
+has_prompt_images (ply_boot_splash_plugin_t *plugin)
+{
+        const char *names[] = { "lock.png", "entry.png", "bullet.png", NULL };
+        char *image_path;
+        bool has_image;
+        int i;
+
+        for (i = 0; names[i] != NULL; i++) {
+                asprintf (&image_path, "%s/%s", plugin->animation_dir, names[i]);
+                has_image = ply_file_exists (image_path);
+                free (image_path);
+
+                if (!has_image)
+                        return false;
+        }
+
+        return true;
+}
+
+static void
+on_end_animation_prefetch_timeout (ply_boot_splash_plugin_t *plugin)
+{
+        ply_list_node_t *node;
+        view_t *view;
+
+        plugin->end_animation_prefetch_is_pending = false;
+
+        ply_trace ("prefetching end animation");
+        node = ply_list_get_first_node (plugin->views);
+        while (node != NULL) {
+                view = ply_list_node_get_data (node);
+                view_load_end_animation (view);
+                node = ply_list_get_next_node (plugin->views, node);
+        }
+
+        plugin->end_animation_is_prefetched = true;
+}
+
+static void
+cancel_end_animation_prefetch (ply_boot_splash_plugin_t *plugin)
+{
+        if (!plugin->end_animation_prefetch_is_pending)
+                return;
+
+        ply_event_loop_stop_watching_for_timeout (plugin->loop,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_end_animation_prefetch_timeout,
+                                                  plugin);
+        plugin->end_animation_prefetch_is_pending = false;
+}
+
 static bool
 show_splash_screen (ply_boot_splash_plugin_t *plugin,
                     ply_event_loop_t         *loop,
@@ -1695,17 +1923,11 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
         plugin->loop = loop;
         plugin->mode = mode;
 
-        ply_trace ("loading lock image");
-        if (!ply_image_load (plugin->lock_image))
+        /* The prompt only gets loaded when it's first shown, but a theme
+         * without one isn't usable */
+        if (!has_prompt_images (plugin)) {
+                ply_trace ("theme is missing lock, entry or bullet image");
                 return false;
-
-        if (plugin->box_image != NULL) {
-                ply_trace ("loading box image");
-
-                if (!ply_image_load (plugin->box_image)) {
-                        ply_image_free (plugin->box_image);
-                        plugin->box_image = NULL;
-                }
         }
 
         if (plugin->corner_image != NULL) {
@@ -1734,23 +1956,12 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                 }
         }
 
-        if (plugin->background_bgrt_image != NULL) {
-                ply_trace ("loading background bgrt image");
-                if (ply_image_load (plugin->background_bgrt_image)) {
-                        plugin->background_bgrt_raw_width = ply_image_get_width (plugin->background_bgrt_image);
-                        plugin->background_bgrt_raw_height = ply_image_get_height (plugin->background_bgrt_image);
-                } else {
-                        ply_image_free (plugin->background_bgrt_image);
-                        plugin->background_bgrt_image = NULL;
-                }
-        }
+        if (plugin->use_firmware_background) {
+                plugin->background_bgrt_image = ply_bgrt_get_image ();
 
-        if (plugin->background_bgrt_fallback_image != NULL) {
-                ply_trace ("loading background bgrt fallback image");
-                if (!ply_image_load (plugin->background_bgrt_fallback_image)) {
-                        ply_image_free (plugin->background_bgrt_fallback_image);
-                        plugin->background_bgrt_fallback_image = NULL;
-                }
+                if (plugin->background_bgrt_image != NULL)
+                        ply_bgrt_get_size (&plugin->background_bgrt_raw_width,
+                                           &plugin->background_bgrt_raw_height);
         }
 
         if (plugin->watermark_image != NULL) {
@@ -1769,6 +1980,15 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                 }
         }
 
+        if (plugin->mode_settings[plugin->mode].use_end_animation) {
+                plugin->end_animation_prefix = find_end_animation_prefix (plugin);
+
+                if (plugin->end_animation_prefix == NULL) {
+                        ply_trace ("optional animation not found");
+                        plugin->mode_settings[plugin->mode].use_end_animation = false;
+                }
+        }
+
         if (!load_views (plugin)) {
                 ply_trace ("couldn't load views");
                 return false;
@@ -1778,6 +1998,16 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                                        detach_from_event_loop,
                                        plugin);
 
+        if (plugin->mode_settings[plugin->mode].use_end_animation &&
+            !plugin->end_animation_is_prefetched) {
+                ply_event_loop_watch_for_timeout (loop,
+                                                  END_ANIMATION_PREFETCH_DELAY,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_end_animation_prefetch_timeout,
+                                                  plugin);
+                plugin->end_animation_prefetch_is_pending = true;
+        }
+
         ply_trace ("starting boot animations");
         start_progress_animation (plugin);
 
@@ -1892,6 +2122,7 @@ hide_splash_screen (ply_boot_splash_plugin_t *plugin,
         ply_trace ("hiding splash");
         if (plugin->loop != NULL) {
                 stop_animation (plugin);
+                cancel_end_animation_prefetch (plugin);
 
                 ply_event_loop_stop_watching_for_exit (plugin->loop, (ply_event_loop_exit_handler_t)
                                                        detach_from_event_loop,
@@ -1912,6 +2143,13 @@ show_prompt (ply_boot_splash_plugin_t *plugin,
         view_t *view;
 
         ply_trace ("showing prompt");
+
+        if (!plugin->prompt_is_loaded) {
+                plugin->lock_image = load_image (plugin, "lock.png");
+                plugin->box_image = load_image (plugin, "box.png");
+                plugin->prompt_is_loaded = true;
+        }
+
         node = ply_list_get_first_node (plugin->views);
         while (node != NULL) {
                 view = ply_list_node_get_data (node);
@@ -1968,6 +2206,38 @@ hide_prompt (ply_boot_splash_plugin_t *plugin)
         }
 }
 
+/* Most boots never show a prompt, and the ones that do only show it
+ * for a little while, so don't keep its images around */
+static void
+unload_prompt (ply_boot_splash_plugin_t *plugin)
+{
+        ply_list_node_t *node;
+        view_t *view;
+
+        if (!plugin->prompt_is_loaded)
+                return;
+
+        ply_trace ("unloading prompt");
+        node = ply_list_get_first_node (plugin->views);
+        while (node != NULL) {
+                view = ply_list_node_get_data (node);
+                view_unload_prompt (view);
+                node = ply_list_get_next_node (plugin->views, node);
+        }
+
+        if (plugin->lock_image != NULL) {
+                ply_image_free (plugin->lock_image);
+                plugin->lock_image = NULL;
+        }
+
+        if (plugin->box_image != NULL) {
+                ply_image_free (plugin->box_image);
+                plugin->box_image = NULL;
+        }
+
+        plugin->prompt_is_loaded = false;
+}
+
 static void
 view_show_message (view_t     *view,
                    const char *message)
@@ -2034,6 +2304,7 @@ display_normal (ply_boot_splash_plugin_t *plugin)
                 hide_prompt (plugin);
 
         plugin->state = PLY_BOOT_SPLASH_DISPLAY_NORMAL;
+        unload_prompt (plugin);
         start_progress_animation (plugin);
         redraw_views (plugin);
         unpause_views (plugin);
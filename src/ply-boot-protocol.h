@@ -22,6 +22,8 @@
 #ifndef PLY_BOOT_PROTOCOL_H
 #define PLY_BOOT_PROTOCOL_H
 
+#include <stdint.h>
+
 #define PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_SOCKET_PATH "/org/freedesktop/plymouthd"
 #define PLY_BOOT_PROTOCOL_OLD_ABSTRACT_SOCKET_PATH "/ply-boot-protocol"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING "P"
@@ -47,6 +49,10 @@
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT "R"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT "V"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR "!"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_USE_VERSION "v"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_CHANNEL "p"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_STARTUP_TIMES "T"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS "s"
 
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK "\x6"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK "\x15"
@@ -54,4 +60,58 @@
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS "\t"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER "\x5"
 
+/* A client that sends a USE_VERSION request with the argument "2" and
+ * gets an ACK back has switched the connection to version 2 framing.
+ * From then on, every request and reply is a frame made of
+ *
+ *   uint32  payload size, little endian
+ *   uint32  request id, little endian
+ *   payload
+ *
+ * A request payload is the command, followed by the argument and its NUL
+ * terminator, if there is an argument.  A reply payload is the response
+ * type, followed by the answer, if there is one.  Replies carry the id of
+ * the request they answer, and may arrive in any order.
+ */
+#define PLY_BOOT_PROTOCOL_VERSION_2 "2"
+#define PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE 8
+#define PLY_BOOT_PROTOCOL_MAX_FRAME_PAYLOAD_SIZE (64 * 1024)
+
+static inline uint32_t
+ply_boot_protocol_get_uint32 (const char *bytes)
+{
+        const uint8_t *buffer = (const uint8_t *) bytes;
+
+        return (buffer[0] << 0) |
+               (buffer[1] << 8) |
+               (buffer[2] << 16) |
+               ((uint32_t) buffer[3] << 24);
+}
+
+static inline void
+ply_boot_protocol_put_uint32 (char     *bytes,
+                              uint32_t  value)
+{
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
+}
+
+/* On a version 2 connection, a client can ask for a progress channel.
+ * The ACK comes with a memfd (passed with SCM_RIGHTS) holding a progress
+ * page, which the client maps and writes progress to, and which the daemon
+ * reads once per frame.  Writers make sequence odd, store the values, then
+ * make sequence even again.  Readers retry when they see an odd sequence or
+ * when it changed while they were reading.
+ */
+#define PLY_BOOT_PROTOCOL_PROGRESS_PAGE_MAGIC 0x706c7931
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t sequence;
+        int32_t  system_update_progress; /* 0-100, or -1 if unset */
+} ply_boot_protocol_progress_page_t;
+
 #endif /* PLY_BOOT_PROTOCOL_H */
@@ -24,9 +24,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -36,9 +38,15 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
+#include "ply-statistics.h"
 #include "ply-trigger.h"
 #include "ply-utils.h"
 
+#ifndef PROGRESS_CHANNEL_POLL_INTERVAL
+#define PROGRESS_CHANNEL_POLL_INTERVAL (1.0 / 30)
+#endif
+
 typedef struct
 {
         int                fd;
@@ -47,12 +55,25 @@ typedef struct
         uid_t              uid;
         pid_t              pid;
 
+        int                protocol_version;
+        ply_buffer_t      *buffer;   /* unparsed version 2 frames */
+
+        ply_boot_protocol_progress_page_t *progress_page;
+        uint32_t           progress_sequence;
+
         int                reference_count;
 
         uint32_t           credentials_read : 1;
         uint32_t           disconnected : 1;
 } ply_boot_connection_t;
 
+/* A reply that is sent once a trigger fires */
+typedef struct
+{
+        ply_boot_connection_t *connection;
+        uint32_t               request_id;
+} ply_boot_pending_reply_t;
+
 struct _ply_boot_server
 {
         ply_event_loop_t                             *loop;
@@ -81,9 +102,11 @@ struct _ply_boot_server
         ply_boot_server_quit_handler_t                quit_handler;
         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler;
         ply_boot_server_reload_handler_t              reload_handler;
+        ply_boot_server_statistics_handler_t          statistics_handler;
         void                                         *user_data;
 
         uint32_t                                      is_listening : 1;
+        uint32_t                                      progress_poll_is_scheduled : 1;
 };
 
 ply_boot_server_t *
@@ -108,6 +131,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
                      ply_boot_server_quit_handler_t                quit_handler,
                      ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
                      ply_boot_server_reload_handler_t              reload_handler,
+                     ply_boot_server_statistics_handler_t          statistics_handler,
                      void                                         *user_data)
 {
         ply_boot_server_t *server;
@@ -138,12 +162,15 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
         server->quit_handler = quit_handler;
         server->has_active_vt_handler = has_active_vt_handler;
         server->reload_handler = reload_handler;
+        server->statistics_handler = statistics_handler;
         server->user_data = user_data;
 
         return server;
 }
 
 static void ply_boot_connection_on_hangup (ply_boot_connection_t *connection);
+static void ply_boot_connection_remove (ply_boot_connection_t *connection);
+static void ply_boot_server_on_progress_poll_timeout (ply_boot_server_t *server);
 
 void
 ply_boot_server_free (ply_boot_server_t *server)
@@ -154,8 +181,13 @@ ply_boot_server_free (ply_boot_server_t *server)
                 return;
         while ((node = ply_list_get_first_node (server->connections))) {
                 ply_boot_connection_t *connection = ply_list_node_get_data (node);
-                ply_boot_connection_on_hangup (connection);
+                ply_boot_connection_remove (connection);
         }
+        if (server->progress_poll_is_scheduled && server->loop != NULL)
+                ply_event_loop_stop_watching_for_timeout (server->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          ply_boot_server_on_progress_poll_timeout,
+                                                          server);
         ply_list_free (server->connections);
         ply_list_free (server->cached_passwords);
         free (server);
@@ -171,6 +203,7 @@ ply_boot_connection_new (ply_boot_server_t *server,
         connection->fd = fd;
         connection->server = server;
         connection->watch = NULL;
+        connection->protocol_version = 1;
         connection->reference_count = 1;
 
         return connection;
@@ -183,6 +216,9 @@ ply_boot_connection_free (ply_boot_connection_t *connection)
                 return;
 
         close (connection->fd);
+        ply_buffer_free (connection->buffer);
+        if (connection->progress_page != NULL)
+                munmap (connection->progress_page, sizeof(ply_boot_protocol_progress_page_t));
         free (connection);
 }
 
@@ -274,6 +310,220 @@ ply_boot_connection_read_request (ply_boot_connection_t *connection,
         return true;
 }
 
+static bool
+ply_boot_connection_send_reply (ply_boot_connection_t *connection,
+                                uint32_t               request_id,
+                                const char            *response_type,
+                                const char            *answer,
+                                uint32_t               answer_size)
+{
+        char *frame;
+        size_t frame_size;
+        bool written;
+
+        if (connection->protocol_version < 2) {
+                if (!ply_write (connection->fd, response_type, strlen (response_type)))
+                        return false;
+
+                if (answer == NULL)
+                        return true;
+
+                return ply_write_uint32 (connection->fd, answer_size) &&
+                       ply_write (connection->fd, answer, answer_size);
+        }
+
+        frame_size = PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + 1 + answer_size;
+        frame = malloc (frame_size);
+        ply_boot_protocol_put_uint32 (frame, 1 + answer_size);
+        ply_boot_protocol_put_uint32 (frame + 4, request_id);
+        frame[PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE] = response_type[0];
+        if (answer_size > 0)
+                memcpy (frame + PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + 1, answer, answer_size);
+
+        written = ply_write (connection->fd, frame, frame_size);
+        free (frame);
+
+        return written;
+}
+
+static bool
+ply_boot_connection_send_reply_with_fd (ply_boot_connection_t *connection,
+                                        uint32_t               request_id,
+                                        const char            *response_type,
+                                        int                    fd)
+{
+        char frame[PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + 1];
+        char control[CMSG_SPACE (sizeof(int))] = "";
+        struct iovec iov = { frame, sizeof(frame) };
+        struct msghdr message = { 0 };
+        struct cmsghdr *control_message;
+
+        assert (connection->protocol_version >= 2);
+
+        ply_boot_protocol_put_uint32 (frame, 1);
+        ply_boot_protocol_put_uint32 (frame + 4, request_id);
+        frame[PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE] = response_type[0];
+
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        control_message = CMSG_FIRSTHDR (&message);
+        control_message->cmsg_level = SOL_SOCKET;
+        control_message->cmsg_type = SCM_RIGHTS;
+        control_message->cmsg_len = CMSG_LEN (sizeof(int));
+        memcpy (CMSG_DATA (control_message), &fd, sizeof(int));
+
+        return sendmsg (connection->fd, &message, MSG_NOSIGNAL) == (ssize_t) sizeof(frame);
+}
+
+static int
+ply_boot_connection_create_progress_page (ply_boot_connection_t *connection)
+{
+#ifdef HAVE_MEMFD_CREATE
+        ply_boot_protocol_progress_page_t *page;
+        int fd;
+
+        fd = memfd_create ("plymouth-progress", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+        if (fd < 0)
+                return -1;
+
+        /* The client can't shrink the page from under us */
+        if (ftruncate (fd, sizeof(ply_boot_protocol_progress_page_t)) < 0 ||
+            fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+                close (fd);
+                return -1;
+        }
+
+        page = mmap (NULL, sizeof(ply_boot_protocol_progress_page_t),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (page == MAP_FAILED) {
+                close (fd);
+                return -1;
+        }
+
+        page->magic = PLY_BOOT_PROTOCOL_PROGRESS_PAGE_MAGIC;
+        page->sequence = 0;
+        page->system_update_progress = -1;
+
+        connection->progress_page = page;
+        connection->progress_sequence = 0;
+
+        return fd;
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+static void
+ply_boot_connection_poll_progress_page (ply_boot_connection_t *connection)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_boot_protocol_progress_page_t *page = connection->progress_page;
+        uint32_t sequence;
+        int32_t progress;
+        int tries;
+
+        for (tries = 0; tries < 3; tries++) {
+                sequence = __atomic_load_n (&page->sequence, __ATOMIC_ACQUIRE);
+
+                /* Being written, look again next frame */
+                if (sequence & 1)
+                        return;
+
+                progress = __atomic_load_n (&page->system_update_progress, __ATOMIC_RELAXED);
+                __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+                if (__atomic_load_n (&page->sequence, __ATOMIC_RELAXED) == sequence)
+                        break;
+        }
+
+        if (tries == 3 || sequence == connection->progress_sequence)
+                return;
+
+        connection->progress_sequence = sequence;
+
+        if (progress < 0 || progress > 100)
+                return;
+
+        if (server->system_update_handler != NULL)
+                server->system_update_handler (server->user_data, progress, server);
+}
+
+/* Returns whether there are any progress channels */
+static bool
+ply_boot_server_poll_progress_pages (ply_boot_server_t *server)
+{
+        ply_list_node_t *node;
+        bool has_progress_channels = false;
+
+        ply_list_foreach (server->connections, node) {
+                ply_boot_connection_t *connection = ply_list_node_get_data (node);
+
+                if (connection->progress_page == NULL)
+                        continue;
+
+                ply_boot_connection_poll_progress_page (connection);
+                has_progress_channels = true;
+        }
+
+        return has_progress_channels;
+}
+
+static void
+ply_boot_server_on_progress_poll_timeout (ply_boot_server_t *server)
+{
+        server->progress_poll_is_scheduled = false;
+
+        if (ply_boot_server_poll_progress_pages (server) && server->loop != NULL) {
+                ply_event_loop_watch_for_timeout (server->loop,
+                                                  PROGRESS_CHANNEL_POLL_INTERVAL,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  ply_boot_server_on_progress_poll_timeout,
+                                                  server);
+                server->progress_poll_is_scheduled = true;
+        }
+}
+
+static void
+ply_boot_server_schedule_progress_poll (ply_boot_server_t *server)
+{
+        if (server->progress_poll_is_scheduled || server->loop == NULL)
+                return;
+
+        ply_event_loop_watch_for_timeout (server->loop,
+                                          PROGRESS_CHANNEL_POLL_INTERVAL,
+                                          (ply_event_loop_timeout_handler_t)
+                                          ply_boot_server_on_progress_poll_timeout,
+                                          server);
+        server->progress_poll_is_scheduled = true;
+}
+
+static ply_boot_pending_reply_t *
+ply_boot_pending_reply_new (ply_boot_connection_t *connection,
+                            uint32_t               request_id)
+{
+        ply_boot_pending_reply_t *reply;
+
+        reply = calloc (1, sizeof(ply_boot_pending_reply_t));
+        reply->connection = connection;
+        reply->request_id = request_id;
+        ply_boot_connection_take_reference (connection);
+
+        return reply;
+}
+
+static void
+ply_boot_pending_reply_free (ply_boot_pending_reply_t *reply)
+{
+        ply_boot_connection_drop_reference (reply->connection);
+        free (reply);
+}
+
 static bool
 ply_boot_connection_is_from_root (ply_boot_connection_t *connection)
 {
@@ -286,98 +536,90 @@ ply_boot_connection_is_from_root (ply_boot_connection_t *connection)
 }
 
 static void
-ply_boot_connection_send_answer (ply_boot_connection_t *connection,
-                                 const char            *answer)
+ply_boot_connection_send_answer (ply_boot_pending_reply_t *reply,
+                                 const char               *answer)
 {
-        uint32_t size;
-
         /* splash plugin isn't able to ask for password,
          * punt to client
          */
         if (answer == NULL) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
+                if (!ply_boot_connection_send_reply (reply->connection, reply->request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing no answer reply: %m");
         } else {
-                size = strlen (answer);
-
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER)) ||
-                    !ply_write_uint32 (connection->fd,
-                                       size) ||
-                    !ply_write (connection->fd,
-                                answer, size))
+                if (!ply_boot_connection_send_reply (reply->connection, reply->request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
+                                                     answer, strlen (answer)))
                         ply_trace ("could not finish writing answer: %m");
         }
 }
 
 static void
-ply_boot_connection_on_password_answer (ply_boot_connection_t *connection,
-                                        const char            *password)
+ply_boot_connection_on_password_answer (ply_boot_pending_reply_t *reply,
+                                        const char               *password)
 {
         ply_trace ("got password answer");
 
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, password);
+        if (!reply->connection->disconnected)
+                ply_boot_connection_send_answer (reply, password);
 
         if (password != NULL)
-                ply_list_append_data (connection->server->cached_passwords,
+                ply_list_append_data (reply->connection->server->cached_passwords,
                                       strdup (password));
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_pending_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_deactivated (ply_boot_connection_t *connection)
+ply_boot_connection_on_deactivated (ply_boot_pending_reply_t *reply)
 {
         ply_trace ("deactivated");
 
-        if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+        if (!reply->connection->disconnected) {
+                if (!ply_boot_connection_send_reply (reply->connection, reply->request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing deactivate reply: %m");
         }
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_pending_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_quit_complete (ply_boot_connection_t *connection)
+ply_boot_connection_on_quit_complete (ply_boot_pending_reply_t *reply)
 {
         ply_trace ("quit complete");
-        if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+        if (!reply->connection->disconnected) {
+                if (!ply_boot_connection_send_reply (reply->connection, reply->request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing quit reply: %m");
         }
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_pending_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_question_answer (ply_boot_connection_t *connection,
-                                        const char            *answer)
+ply_boot_connection_on_question_answer (ply_boot_pending_reply_t *reply,
+                                        const char               *answer)
 {
         ply_trace ("got question answer: %s", answer);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, answer);
+        if (!reply->connection->disconnected)
+                ply_boot_connection_send_answer (reply, answer);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_pending_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_keystroke_answer (ply_boot_connection_t *connection,
-                                         const char            *key)
+ply_boot_connection_on_keystroke_answer (ply_boot_pending_reply_t *reply,
+                                         const char               *key)
 {
         ply_trace ("got key: %s", key);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, key);
+        if (!reply->connection->disconnected)
+                ply_boot_connection_send_answer (reply, key);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_pending_reply_free (reply);
 }
 
 static void
@@ -404,22 +646,17 @@ print_connection_process_identity (ply_boot_connection_t *connection)
 }
 
 static void
-ply_boot_connection_on_request (ply_boot_connection_t *connection)
+ply_boot_connection_handle_request (ply_boot_connection_t *connection,
+                                    uint32_t               request_id,
+                                    char                  *command,
+                                    char                  *argument)
 {
         ply_boot_server_t *server;
-        char *command, *argument;
-
-        assert (connection != NULL);
-        assert (connection->fd >= 0);
 
         server = connection->server;
         assert (server != NULL);
 
-        if (!ply_boot_connection_read_request (connection,
-                                               &command, &argument)) {
-                ply_trace ("could not read connection request");
-                return;
-        }
+        ply_statistics_add (PLY_STATISTIC_PROTOCOL_REQUESTS, 1);
 
         if (ply_is_tracing ())
                 print_connection_process_identity (connection);
@@ -427,9 +664,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
         if (!ply_boot_connection_is_from_root (connection)) {
                 ply_error ("request came from non-root user");
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing is-not-root nak: %m");
 
                 free (argument);
@@ -437,10 +674,14 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 return;
         }
 
+        /* Progress written to a page before this request was sent has to
+         * be seen first, or e.g. a quit could beat the last update */
+        ply_boot_server_poll_progress_pages (server);
+
         if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)) &&
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0) &&
                     errno != EPIPE)
                         ply_trace ("could not finish writing update reply: %m");
 
@@ -451,9 +692,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 free (command);
                 return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing update reply: %m");
 
                 ply_trace ("got change mode notification");
@@ -473,9 +714,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 }
 
                 ply_trace ("got system-update notification %li%%", value);
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing update reply: %m");
 
                 if (server->system_update_handler != NULL)
@@ -509,8 +750,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (deactivate_trigger,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_deactivated,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_pending_reply_new (connection, request_id));
 
                 if (server->deactivate_handler != NULL)
                         server->deactivate_handler (server->user_data, deactivate_trigger, server);
@@ -537,8 +777,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (quit_trigger,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_quit_complete,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_pending_reply_new (connection, request_id));
 
                 if (server->quit_handler != NULL)
                         server->quit_handler (server->user_data, retain_splash, quit_trigger, server);
@@ -561,8 +800,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_password_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_pending_reply_new (connection, request_id));
 
                 if (server->ask_for_password_handler != NULL) {
                         server->ask_for_password_handler (server->user_data,
@@ -615,22 +853,18 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 if (buffer_size == 0) {
                         ply_trace ("Responding with 'no answer' reply since there are currently "
                                    "no cached answers");
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
+                                                             NULL, 0))
                                 ply_trace ("could not finish writing no answer reply: %m");
                 } else {
                         size = buffer_size;
 
                         ply_trace ("writing %d cached answers",
                                    ply_list_get_length (server->cached_passwords));
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS)) ||
-                            !ply_write_uint32 (connection->fd,
-                                               size) ||
-                            !ply_write (connection->fd,
-                                        ply_buffer_get_bytes (buffer), size))
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
+                                                             ply_buffer_get_bytes (buffer), size))
                                 ply_trace ("could not finish writing cached answer reply: %m");
                 }
 
@@ -646,8 +880,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_question_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_pending_reply_new (connection, request_id));
 
                 if (server->ask_question_handler != NULL) {
                         server->ask_question_handler (server->user_data,
@@ -679,8 +912,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_keystroke_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_pending_reply_new (connection, request_id));
 
                 if (server->watch_for_keystroke_handler != NULL) {
                         server->watch_for_keystroke_handler (server->user_data,
@@ -723,21 +955,111 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                         answer = server->has_active_vt_handler (server->user_data, server);
 
                 if (!answer) {
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                             NULL, 0))
                                 ply_trace ("could not finish writing nak: %m");
 
                         free (argument);
                         free (command);
                         return;
                 }
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_USE_VERSION) == 0) {
+                bool use_version_2;
+
+                ply_trace ("got request to use protocol version %s", argument);
+                use_version_2 = connection->protocol_version == 1 && argument != NULL &&
+                                strcmp (argument, PLY_BOOT_PROTOCOL_VERSION_2) == 0;
+
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     use_version_2 ? PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK
+                                                                   : PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                     NULL, 0))
+                        ply_trace ("could not finish writing protocol version reply: %m");
+
+                /* The reply above is the last one in version 1 framing */
+                if (use_version_2) {
+                        connection->protocol_version = 2;
+                        connection->buffer = ply_buffer_new ();
+                }
+
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_CHANNEL) == 0) {
+                int fd = -1;
+
+                ply_trace ("got progress channel request");
+
+                /* The page is passed along with the reply, which needs
+                 * version 2 framing
+                 */
+                if (connection->protocol_version >= 2 && connection->progress_page == NULL)
+                        fd = ply_boot_connection_create_progress_page (connection);
+
+                if (fd < 0) {
+                        ply_trace ("could not set up progress channel: %m");
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                             NULL, 0))
+                                ply_trace ("could not finish writing nak: %m");
+                } else {
+                        if (!ply_boot_connection_send_reply_with_fd (connection, request_id,
+                                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                                     fd))
+                                ply_trace ("could not finish writing progress channel reply: %m");
+                        close (fd);
+
+                        ply_boot_server_schedule_progress_poll (server);
+                }
+
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STARTUP_TIMES) == 0) {
+                char *report;
+
+                ply_trace ("got startup times request");
+                report = ply_phase_tracer_get_report ();
+
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
+                                                     report, strlen (report)))
+                        ply_trace ("could not finish writing startup times: %m");
+
+                free (report);
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS) == 0) {
+                char *statistics = NULL;
+
+                ply_trace ("got statistics request");
+                if (server->statistics_handler != NULL)
+                        statistics = server->statistics_handler (server->user_data, server);
+
+                if (statistics == NULL) {
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
+                                                             NULL, 0))
+                                ply_trace ("could not finish writing no answer reply: %m");
+                } else {
+                        if (!ply_boot_connection_send_reply (connection, request_id,
+                                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
+                                                             statistics, strlen (statistics)))
+                                ply_trace ("could not finish writing statistics: %m");
+                }
+
+                free (statistics);
+                free (argument);
+                free (command);
+                return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING) != 0) {
                 ply_error ("received unknown command '%s' from client", command);
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing ping reply: %m");
 
                 free (argument);
@@ -745,16 +1067,97 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 return;
         }
 
-        if (!ply_write (connection->fd,
-                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+        if (!ply_boot_connection_send_reply (connection, request_id,
+                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                             NULL, 0))
                 ply_trace ("could not finish writing ack: %m");
         free (argument);
         free (command);
 }
 
 static void
-ply_boot_connection_on_hangup (ply_boot_connection_t *connection)
+ply_boot_connection_drop (ply_boot_connection_t *connection)
+{
+        if (connection->watch != NULL && connection->server->loop != NULL) {
+                ply_event_loop_stop_watching_fd (connection->server->loop,
+                                                 connection->watch);
+                connection->watch = NULL;
+        }
+
+        ply_boot_connection_on_hangup (connection);
+}
+
+static void
+ply_boot_connection_process_frames (ply_boot_connection_t *connection)
+{
+        ply_buffer_append_from_fd (connection->buffer, connection->fd);
+
+        ply_boot_connection_take_reference (connection);
+        while (!connection->disconnected) {
+                const char *bytes;
+                size_t size;
+                uint32_t payload_size, request_id;
+                char *command, *argument;
+
+                bytes = ply_buffer_get_bytes (connection->buffer);
+                size = ply_buffer_get_size (connection->buffer);
+
+                if (size < PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE)
+                        break;
+
+                payload_size = ply_boot_protocol_get_uint32 (bytes);
+                request_id = ply_boot_protocol_get_uint32 (bytes + 4);
+
+                if (payload_size == 0 ||
+                    payload_size > PLY_BOOT_PROTOCOL_MAX_FRAME_PAYLOAD_SIZE) {
+                        ply_trace ("got malformed request frame, dropping connection");
+                        ply_boot_connection_drop (connection);
+                        break;
+                }
+
+                if (size < PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + payload_size)
+                        break;
+
+                bytes += PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE;
+                command = strndup (bytes, 1);
+                argument = NULL;
+                if (payload_size > 1)
+                        argument = strndup (bytes + 1, payload_size - 1);
+
+                ply_buffer_remove_bytes (connection->buffer,
+                                         PLY_BOOT_PROTOCOL_FRAME_HEADER_SIZE + payload_size);
+
+                ply_boot_connection_handle_request (connection, request_id,
+                                                    command, argument);
+        }
+        ply_boot_connection_drop_reference (connection);
+}
+
+static void
+ply_boot_connection_on_request (ply_boot_connection_t *connection)
+{
+        char *command, *argument;
+
+        assert (connection != NULL);
+        assert (connection->fd >= 0);
+
+        /* Version 2 connections can have many requests in one read */
+        if (connection->protocol_version >= 2) {
+                ply_boot_connection_process_frames (connection);
+                return;
+        }
+
+        if (!ply_boot_connection_read_request (connection,
+                                               &command, &argument)) {
+                ply_trace ("could not read connection request");
+                return;
+        }
+
+        ply_boot_connection_handle_request (connection, 0, command, argument);
+}
+
+static void
+ply_boot_connection_remove (ply_boot_connection_t *connection)
 {
         ply_list_node_t *node;
         ply_boot_server_t *server;
@@ -774,6 +1177,16 @@ ply_boot_connection_on_hangup (ply_boot_connection_t *connection)
         ply_list_remove_node (server->connections, node);
 }
 
+static void
+ply_boot_connection_on_hangup (ply_boot_connection_t *connection)
+{
+        /* Pick up what was written right before the client went away */
+        if (connection->progress_page != NULL)
+                ply_boot_connection_poll_progress_page (connection);
+
+        ply_boot_connection_remove (connection);
+}
+
 static void
 ply_boot_server_on_new_connection (ply_boot_server_t *server)
 {
@@ -812,6 +1225,7 @@ ply_boot_server_detach_from_event_loop (ply_boot_server_t *server)
 {
         assert (server != NULL);
         server->loop = NULL;
+        server->progress_poll_is_scheduled = false;
 }
 
 void
@@ -104,6 +104,8 @@ typedef bool (*ply_boot_server_has_active_vt_handler_t) (void              *user
                                                          ply_boot_server_t *server);
 typedef bool (*ply_boot_server_reload_handler_t) (void              *user_data,
                                                   ply_boot_server_t *server);
+typedef char *(*ply_boot_server_statistics_handler_t) (void              *user_data,
+                                                       ply_boot_server_t *server);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_boot_server_t *ply_boot_server_new (ply_boot_server_update_handler_t              update_handler,
@@ -127,6 +129,7 @@ ply_boot_server_t *ply_boot_server_new (ply_boot_server_update_handler_t
                                         ply_boot_server_quit_handler_t                quit_handler,
                                         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
                                         ply_boot_server_reload_handler_t              reload_handler,
+                                        ply_boot_server_statistics_handler_t          statistics_handler,
                                         void                                         *user_data);
 
 void ply_boot_server_free (ply_boot_server_t *server);
@@ -0,0 +1,27 @@
+/* ply-built-in-modules.h - plugins linked into plymouthd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_BUILT_IN_MODULES_H
+#define PLY_BUILT_IN_MODULES_H
+
+#include "ply-utils.h"
+
+/* Generated from the built-in-plugins build option, ends with an
+ * entry whose name is NULL */
+extern const ply_built_in_module_t ply_built_in_modules[];
+
+#endif /* PLY_BUILT_IN_MODULES_H */